@@ -1,15 +1,71 @@
 #include "Array.h"
 #include "Sort.h"
+#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 static const size_t ARRAY_LENGTH = 10000;
 static const size_t NBREP = 1;
 static const float SWAPPROP = 0.01;
+static const double THRESHOLD = 0.10;
+
+// Max length of a single line in a baseline file
+#define LINE_SIZE 256
+// Max length of an algorithm or distribution name
+#define NAME_SIZE 64
+
+typedef struct Distribution_t Distribution;
+
+struct Distribution_t {
+   const char *name;  // Name used in the baseline file
+   const char *label; // Name printed in the table
+   int *(*create)(size_t length);
+};
+
+typedef struct Result_t Result;
+
+struct Result_t {
+   char algorithm[NAME_SIZE];
+   char distribution[NAME_SIZE];
+   size_t length;
+   size_t nbRepetitions;
+   double mean;   // Average CPU time (in seconds)
+   double median; // Median CPU time (in seconds)
+   double ciLow;  // Lower bound of the 95% confidence interval of the median
+   double ciHigh; // Upper bound of the 95% confidence interval of the median
+   double nbComp; // Average number of comparisons
+};
 
 /* Prototypes */
 
+static int *createAlmostSortedDefault(size_t length);
+static double cpuTimeUsedToSort(int *array, size_t length);
+static int compareDoubles(const void *a, const void *b);
+static void summarize(double *samples, size_t n, Result *res);
+static bool runDistribution(const Distribution *dist, size_t length,
+                            size_t nbRepetitions, Result *res);
+static size_t loadBaseline(const char *filename, Result **records);
+static bool sameRecord(Result *r1, Result *r2);
+static bool saveBaseline(const char *filename, Result *results, size_t n);
+static bool compareBaseline(const char *filename, Result *results, size_t n,
+                            double threshold);
+
+static const Distribution DISTRIBUTIONS[] = {
+    {"sorted", "Sorted    ", createSortedArray},
+    {"decreasing", "Decreasing", createDecreasingArray},
+    {"random", "Random    ", createRandomArray},
+    {"almostsorted", "~Sorted   ", createAlmostSortedDefault},
+};
+
+#define NB_DISTRIBUTIONS (sizeof(DISTRIBUTIONS) / sizeof(DISTRIBUTIONS[0]))
+
+static int *createAlmostSortedDefault(size_t length) {
+   return createAlmostSortedArray(length, SWAPPROP);
+}
+
 /* ------------------------------------------------------------------------- *
  * Compute the CPU time (in seconds) used by the Sort function.
  *
@@ -34,94 +90,337 @@ static double cpuTimeUsedToSort(int *array, size_t length) {
    return ((double)(end - start)) / CLOCKS_PER_SEC;
 }
 
+static int compareDoubles(const void *a, const void *b) {
+   double a_ = *(const double *)a;
+   double b_ = *(const double *)b;
+   return (a_ > b_) - (a_ < b_);
+}
+
 /* ------------------------------------------------------------------------- *
- * Main
+ * Compute the median of the timing samples and a distribution-free 95%
+ * confidence interval around it (order statistics of a binomial(n, 1/2)).
+ *
+ * PARAMETERS
+ * samples      The CPU times of each repetition (sorted in place)
+ * n            Number of samples (pre-condition: 0 < n)
+ * res          The result in which median, ciLow and ciHigh are written
  * ------------------------------------------------------------------------- */
-int main(int argc, char **argv) {
-   size_t length = ARRAY_LENGTH;
-   size_t nbRepetitions = NBREP;
-   float swapProp = SWAPPROP;
+static void summarize(double *samples, size_t n, Result *res) {
+   qsort(samples, n, sizeof(double), compareDoubles);
 
-   srand(time(NULL)); // Use an integer seed to get a fix sequence
+   if (n % 2)
+      res->median = samples[n / 2];
+   else
+      res->median = (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
 
-   if (argc > 1) length = atoi(argv[1]);
-   if (argc > 2) nbRepetitions = atoi(argv[2]);
+   // Ranks (1-based) of the bounds: n/2 -+ 1.96 * sqrt(n)/2
+   double half = 1.96 * sqrt((double)n) / 2.0;
+   double lo = floor((double)n / 2.0 - half);
+   double hi = ceil((double)n / 2.0 + half + 1.0);
+   if (lo < 1.0) lo = 1.0;
+   if (hi > (double)n) hi = (double)n;
 
-   printf("Sorting times for arrays of size %zu (%zu repetitions)\n", length,
-          nbRepetitions);
-   printf("---------------------------------------------\n");
-   printf("Array type |    time [s]    |     nb comp.\n");
-   printf("---------------------------------------------\n");
+   res->ciLow = samples[(size_t)lo - 1];
+   res->ciHigh = samples[(size_t)hi - 1];
+}
+
+/* ------------------------------------------------------------------------- *
+ * Sort nbRepetitions arrays of the given distribution and summarize the
+ * CPU times and the number of comparisons.
+ *
+ * PARAMETERS
+ * dist           The distribution of the arrays to sort
+ * length         Number of elements in each array
+ * nbRepetitions  Number of arrays to sort (pre-condition: 0 < nbRepetitions)
+ * res            The result to fill (except for the algorithm name)
+ *
+ * RETURN
+ * res            true on success, false in case of allocation error
+ * ------------------------------------------------------------------------- */
+static bool runDistribution(const Distribution *dist, size_t length,
+                            size_t nbRepetitions, Result *res) {
+   double *samples = malloc(nbRepetitions * sizeof(double));
+   if (!samples) return false;
 
-   // ---------------------------- Sorted array ---------------------------- //
    double sec = 0.0;
    double nbComp = 0.0;
    for (size_t i = 0; i < nbRepetitions; i++) {
-
-      int *sorted = createSortedArray(length);
-      if (!sorted) {
-         fprintf(stderr, "Could not create sorted array. Aborting...\n");
-         return EXIT_FAILURE;
+      int *array = dist->create(length);
+      if (!array) {
+         free(samples);
+         return false;
       }
 
       resetCounter();
-      sec += cpuTimeUsedToSort(sorted, length) / nbRepetitions;
+      samples[i] = cpuTimeUsedToSort(array, length);
+      sec += samples[i] / nbRepetitions;
       nbComp += (double)getCounter() / (double)nbRepetitions;
-      free(sorted);
+      free(array);
    }
-   printf("Sorted     | %12.6f   | %12.1f\n", sec, nbComp);
 
-   // -------------------------- Decreasing array -------------------------- //
-   sec = 0.0;
-   nbComp = 0.0;
-   for (size_t i = 0; i < nbRepetitions; i++) {
-      int *decreasing = createDecreasingArray(length);
-      if (!decreasing) {
-         fprintf(stderr, "Could not create decreasing array. Aborting...\n");
-         return EXIT_FAILURE;
+   snprintf(res->distribution, NAME_SIZE, "%s", dist->name);
+   res->length = length;
+   res->nbRepetitions = nbRepetitions;
+   res->mean = sec;
+   res->nbComp = nbComp;
+   summarize(samples, nbRepetitions, res);
+
+   free(samples);
+   return true;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Load the records of a baseline file. Each non-empty line which does not
+ * start with '#' holds one record:
+ *   algorithm length distribution nbRepetitions median ciLow ciHigh nbComp
+ *
+ * PARAMETERS
+ * filename     Name of the baseline file
+ * records      Set to a new array of records (to be freed by the caller),
+ *              or NULL if the file does not exist or is empty
+ *
+ * RETURN
+ * n            The number of records read
+ * ------------------------------------------------------------------------- */
+static size_t loadBaseline(const char *filename, Result **records) {
+   *records = NULL;
+   FILE *fileObj = fopen(filename, "r");
+   if (!fileObj) return 0;
+
+   size_t n = 0, capacity = 0;
+   char line[LINE_SIZE];
+   while (fgets(line, sizeof(line), fileObj) != NULL) {
+      if (line[0] == '#' || line[0] == '\n') continue;
+
+      if (n == capacity) {
+         capacity = capacity ? 2 * capacity : 16;
+         Result *tmp = realloc(*records, capacity * sizeof(Result));
+         if (!tmp) {
+            fprintf(stderr, "loadBaseline: allocation error\n");
+            break;
+         }
+         *records = tmp;
       }
 
-      resetCounter();
-      sec += cpuTimeUsedToSort(decreasing, length) / nbRepetitions;
-      nbComp += (double)getCounter() / (double)nbRepetitions;
-      free(decreasing);
+      Result *r = &(*records)[n];
+      if (sscanf(line, "%63s %zu %63s %zu %lf %lf %lf %lf", r->algorithm,
+                 &r->length, r->distribution, &r->nbRepetitions, &r->median,
+                 &r->ciLow, &r->ciHigh, &r->nbComp) == 8)
+         n++;
+      else
+         fprintf(stderr, "Ignoring malformed baseline line: %s", line);
    }
-   printf("Decreasing | %12.6f   | %12.1f\n", sec, nbComp);
 
-   // ---------------------------- Random array ---------------------------- //
-   sec = 0.0;
-   nbComp = 0.0;
-   for (size_t i = 0; i < nbRepetitions; i++) {
-      int *random = createRandomArray(length);
-      if (!random) {
-         fprintf(stderr, "Could not create random array. Aborting...\n");
-         return EXIT_FAILURE;
+   fclose(fileObj);
+   return n;
+}
+
+static bool sameRecord(Result *r1, Result *r2) {
+   return r1->length == r2->length &&
+          strcmp(r1->algorithm, r2->algorithm) == 0 &&
+          strcmp(r1->distribution, r2->distribution) == 0;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Store the results in a baseline file. Records of other algorithms or
+ * sizes already present in the file are kept, records for the same
+ * (algorithm, length, distribution) are replaced.
+ *
+ * PARAMETERS
+ * filename     Name of the baseline file
+ * results      The results of this run
+ * n            Number of results
+ *
+ * RETURN
+ * res          true on success, false otherwise
+ * ------------------------------------------------------------------------- */
+static bool saveBaseline(const char *filename, Result *results, size_t n) {
+   Result *records;
+   size_t nbRecords = loadBaseline(filename, &records);
+
+   FILE *fileObj = fopen(filename, "w");
+   if (!fileObj) {
+      fprintf(stderr, "Could not open file '%s'\n", filename);
+      free(records);
+      return false;
+   }
+
+   fprintf(fileObj, "# algorithm length distribution nbRepetitions "
+                    "median[s] ciLow[s] ciHigh[s] nbComp\n");
+   for (size_t i = 0; i < nbRecords; i++) {
+      bool replaced = false;
+      for (size_t j = 0; j < n && !replaced; j++)
+         replaced = sameRecord(&records[i], &results[j]);
+      if (replaced) continue;
+      Result *r = &records[i];
+      fprintf(fileObj, "%s %zu %s %zu %.9f %.9f %.9f %.1f\n", r->algorithm,
+              r->length, r->distribution, r->nbRepetitions, r->median,
+              r->ciLow, r->ciHigh, r->nbComp);
+   }
+   for (size_t i = 0; i < n; i++) {
+      Result *r = &results[i];
+      fprintf(fileObj, "%s %zu %s %zu %.9f %.9f %.9f %.1f\n", r->algorithm,
+              r->length, r->distribution, r->nbRepetitions, r->median,
+              r->ciLow, r->ciHigh, r->nbComp);
+   }
+
+   free(records);
+   fclose(fileObj);
+   printf("Baseline saved in %s\n", filename);
+   return true;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Compare the results with a baseline file. A distribution is flagged as a
+ * regression when
+ *   - the lower bound of its 95% confidence interval is more than threshold
+ *     slower than the baseline median and above the baseline interval, or
+ *   - its number of comparisons grew by more than threshold.
+ * A distribution without a record in the file (e.g. a new length) is
+ * reported as missing and fails the comparison as well.
+ *
+ * PARAMETERS
+ * filename     Name of the baseline file
+ * results      The results of this run
+ * n            Number of results
+ * threshold    Relative increase tolerated (e.g. 0.10 for 10%)
+ *
+ * RETURN
+ * ok           true if every distribution has a record and no regression
+ *              was found, false otherwise
+ * ------------------------------------------------------------------------- */
+static bool compareBaseline(const char *filename, Result *results, size_t n,
+                            double threshold) {
+   Result *records;
+   size_t nbRecords = loadBaseline(filename, &records);
+   if (nbRecords == 0) {
+      fprintf(stderr, "No baseline found in '%s'\n", filename);
+      return false;
+   }
+
+   bool ok = true;
+   printf("\nComparison with %s (threshold %.1f%%)\n", filename,
+          100.0 * threshold);
+   printf("--------------------------------------------------------------\n");
+   printf("Array type |  base med. [s] |  curr med. [s] | time  | comp. |\n");
+   printf("--------------------------------------------------------------\n");
+   for (size_t i = 0; i < n; i++) {
+      Result *curr = &results[i];
+      Result *base = NULL;
+      for (size_t j = 0; j < nbRecords && !base; j++)
+         if (sameRecord(&records[j], curr)) base = &records[j];
+
+      const char *label = curr->distribution;
+      for (size_t d = 0; d < NB_DISTRIBUTIONS; d++)
+         if (strcmp(DISTRIBUTIONS[d].name, curr->distribution) == 0)
+            label = DISTRIBUTIONS[d].label;
+
+      if (!base) {
+         // A run that cannot be compared must not pass the check silently
+         printf("%s | %14s | %14.6f |   no baseline: MISSING\n", label, "-",
+                curr->median);
+         ok = false;
+         continue;
       }
 
-      resetCounter();
-      sec += cpuTimeUsedToSort(random, length) / nbRepetitions;
-      nbComp += (double)getCounter() / (double)nbRepetitions;
-      free(random);
+      double timeChange = base->median > 0.0
+                              ? curr->median / base->median - 1.0
+                              : (curr->median > 0.0 ? INFINITY : 0.0);
+      double compChange =
+          base->nbComp > 0.0 ? curr->nbComp / base->nbComp - 1.0 : 0.0;
+
+      // Even the optimistic end of the interval must exceed the threshold
+      bool slower = curr->ciLow > base->median * (1.0 + threshold) &&
+                    curr->ciLow > base->ciHigh;
+      bool moreComp = compChange > threshold;
+
+      printf("%s | %14.6f | %14.6f | %+5.0f%% | %+4.0f%% | %s\n", label,
+             base->median, curr->median, 100.0 * timeChange,
+             100.0 * compChange,
+             slower || moreComp ? "REGRESSION" : "ok");
+      ok = ok && !slower && !moreComp;
    }
-   printf("Random     | %12.6f   | %12.1f\n", sec, nbComp);
+   printf("--------------------------------------------------------------\n");
 
-   // ------------------------ Almost sorted array ------------------------ //
-   sec = 0.0;
-   nbComp = 0.0;
-   for (size_t i = 0; i < nbRepetitions; i++) {
-      int *almostsorted = createAlmostSortedArray(length, swapProp);
-      if (!almostsorted) {
-         fprintf(stderr, "Could not create random array. Aborting...\n");
+   free(records);
+   return ok;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Main
+ *
+ * USAGE
+ * ./sortname [length [nbRepetitions]] [--save file | --compare file]
+ *            [--threshold t]
+ *
+ * --save file       Store the medians and comparison counts in file
+ * --compare file    Compare against file, exit with failure on regression
+ * --threshold t     Relative regression threshold (default 0.10)
+ * ------------------------------------------------------------------------- */
+int main(int argc, char **argv) {
+   size_t length = ARRAY_LENGTH;
+   size_t nbRepetitions = NBREP;
+   double threshold = THRESHOLD;
+   const char *saveFile = NULL;
+   const char *compareFile = NULL;
+
+   srand(time(NULL)); // Use an integer seed to get a fix sequence
+
+   size_t nbPositional = 0;
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+         saveFile = argv[++i];
+      else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+         compareFile = argv[++i];
+      else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+         threshold = strtod(argv[++i], NULL);
+      else if (argv[i][0] != '-' && nbPositional < 2) {
+         if (nbPositional++ == 0)
+            length = atoi(argv[i]);
+         else
+            nbRepetitions = atoi(argv[i]);
+      } else {
+         fprintf(stderr, "Usage: %s [length [nbRepetitions]] "
+                         "[--save file | --compare file] [--threshold t]\n",
+                 argv[0]);
          return EXIT_FAILURE;
       }
+   }
+   if (nbRepetitions == 0) nbRepetitions = 1;
 
-      resetCounter();
-      sec += cpuTimeUsedToSort(almostsorted, length) / nbRepetitions;
-      nbComp += (double)getCounter() / (double)nbRepetitions;
-      free(almostsorted);
+   // The executable name identifies the algorithm in the baseline file
+   const char *algorithm = strrchr(argv[0], '/');
+   algorithm = algorithm ? algorithm + 1 : argv[0];
+
+   printf("Sorting times for arrays of size %zu (%zu repetitions)\n", length,
+          nbRepetitions);
+   printf("------------------------------------------------------------\n");
+   printf("Array type |    time [s]    |   median [s]   |     nb comp.\n");
+   printf("------------------------------------------------------------\n");
+
+   Result results[NB_DISTRIBUTIONS];
+   for (size_t d = 0; d < NB_DISTRIBUTIONS; d++) {
+      Result *res = &results[d];
+      if (!runDistribution(&DISTRIBUTIONS[d], length, nbRepetitions, res)) {
+         fprintf(stderr, "Could not create %s array. Aborting...\n",
+                 DISTRIBUTIONS[d].name);
+         return EXIT_FAILURE;
+      }
+      snprintf(res->algorithm, NAME_SIZE, "%s", algorithm);
+      printf("%s | %12.6f   | %12.6f   | %12.1f\n", DISTRIBUTIONS[d].label,
+             res->mean, res->median, res->nbComp);
+   }
+   printf("------------------------------------------------------------\n");
+
+   if (saveFile && !saveBaseline(saveFile, results, NB_DISTRIBUTIONS))
+      return EXIT_FAILURE;
+
+   if (compareFile &&
+       !compareBaseline(compareFile, results, NB_DISTRIBUTIONS, threshold)) {
+      fprintf(stderr, "Performance regression detected against %s\n",
+              compareFile);
+      return EXIT_FAILURE;
    }
-   printf("~Sorted    | %12.6f   | %12.1f\n", sec, nbComp);
-   printf("---------------------------------------------\n");
 
    return EXIT_SUCCESS;
 }
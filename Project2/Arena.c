@@ -0,0 +1,115 @@
+/* ========================================================================= *
+ * Arena definition
+ * ========================================================================= */
+
+#include "Arena.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Default size of a block (in bytes)
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Union of the types with the strictest alignment requirements
+typedef union {
+   long double ld;
+   long long ll;
+   void *p;
+   void (*f)(void);
+} ArenaAlign;
+
+typedef struct ArenaBlock_t ArenaBlock;
+
+struct ArenaBlock_t {
+   ArenaBlock *next;
+   size_t capacity; // Size of data (in bytes)
+   size_t used;     // Number of bytes of data already allocated
+   ArenaAlign data[];
+};
+
+struct Arena_t {
+   ArenaBlock *head; // Block in which objects are currently allocated
+   size_t blockSize;
+   size_t size;
+};
+
+static ArenaBlock *arenaBlockNew(size_t capacity) {
+   ArenaBlock *b = malloc(sizeof(ArenaBlock) + capacity);
+   if (b == NULL) {
+      printf("arenaBlockNew: allocation error\n");
+      return NULL;
+   }
+   b->next = NULL;
+   b->capacity = capacity;
+   b->used = 0;
+   return b;
+}
+
+Arena *arenaNew(size_t blockSize) {
+   Arena *arena = malloc(sizeof(Arena));
+   if (arena == NULL) {
+      printf("arenaNew: allocation error\n");
+      return NULL;
+   }
+   arena->head = NULL;
+   arena->blockSize = blockSize > 0 ? blockSize : ARENA_BLOCK_SIZE;
+   arena->size = 0;
+   return arena;
+}
+
+void arenaFree(Arena *arena) {
+   assert(arena != NULL);
+   ArenaBlock *b = arena->head;
+   while (b != NULL) {
+      ArenaBlock *next = b->next;
+      free(b);
+      b = next;
+   }
+   free(arena);
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+   assert(arena != NULL);
+
+   // Round the size up so that the next object stays aligned
+   size_t align = sizeof(ArenaAlign);
+   size = (size + align - 1) / align * align;
+   if (size == 0) size = align;
+
+   ArenaBlock *b = arena->head;
+   if (b != NULL && b->capacity - b->used >= size) {
+      void *ptr = (char *)b->data + b->used;
+      b->used += size;
+      return ptr;
+   }
+
+   if (size > arena->blockSize / 4) {
+      // Large object: give it its own block, behind the current one so
+      // that the free space of the latter is not lost
+      ArenaBlock *large = arenaBlockNew(size);
+      if (large == NULL) return NULL;
+      large->used = size;
+      if (b != NULL) {
+         large->next = b->next;
+         b->next = large;
+      } else {
+         arena->head = large;
+      }
+      arena->size += size;
+      return large->data;
+   }
+
+   ArenaBlock *nb = arenaBlockNew(arena->blockSize);
+   if (nb == NULL) return NULL;
+   nb->next = b;
+   nb->used = size;
+   arena->head = nb;
+   arena->size += arena->blockSize;
+   return nb->data;
+}
+
+size_t arenaSize(Arena *arena) {
+   assert(arena != NULL);
+   return arena->size;
+}
@@ -0,0 +1,67 @@
+/* ========================================================================= *
+ * Arena interface
+ * Region allocator: objects are carved out of large contiguous blocks and
+ * are all released at once by arenaFree().
+ * ========================================================================= */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/* Opaque Structure */
+typedef struct Arena_t Arena;
+
+/* ------------------------------------------------------------------------- *
+ * Creates an empty arena.
+ *
+ * The Arena must later be deleted by calling arenaFree().
+ *
+ * PARAMETERS
+ * blockSize    Size (in bytes) of the blocks requested to malloc, or 0 for
+ *              a default size. Objects allocated one after the other are
+ *              contiguous within a block.
+ *
+ * RETURN
+ * arena        A pointer to the Arena, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+Arena *arenaNew(size_t blockSize);
+
+/* ------------------------------------------------------------------------- *
+ * Frees the arena and every object allocated in it. The cost depends on the
+ * number of blocks, not on the number of objects.
+ *
+ * PARAMETERS
+ * arena        A valid pointer to an Arena object
+ * ------------------------------------------------------------------------- */
+
+void arenaFree(Arena *arena);
+
+/* ------------------------------------------------------------------------- *
+ * Allocates an object in the arena. The memory is suitably aligned for any
+ * type, is not initialised and must not be passed to free().
+ *
+ * PARAMETERS
+ * arena        A valid pointer to an Arena object
+ * size         Size of the object (in bytes)
+ *
+ * RETURN
+ * ptr          A pointer to the object, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+void *arenaAlloc(Arena *arena, size_t size);
+
+/* ------------------------------------------------------------------------- *
+ * Returns the amount of memory requested to malloc by the arena so far.
+ *
+ * PARAMETERS
+ * arena        A valid pointer to an Arena object
+ *
+ * RETURN
+ * nb           The total size of the blocks of the arena (in bytes)
+ * ------------------------------------------------------------------------- */
+
+size_t arenaSize(Arena *arena);
+
+#endif // !_ARENA_H_
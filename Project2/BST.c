@@ -14,7 +14,9 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "Arena.h"
 #include "BST.h"
 #include "List.h"
 
@@ -28,61 +30,167 @@ struct BNode_t {
    BNode *right;
    void *key;
    void *value;
+   tuple *dups;  // Other elements with an equal key, in insertion order
+   size_t ndups;
+   int height; // Height of the subtree (leaf: 1), only kept if balanced
 };
 
 struct BST_t {
    BNode *root;
    size_t size;
    int (*compfn)(void *, void *);
+   bool balanced;
+   Arena *arena; // Arena of the nodes, or NULL if they are malloc'ed
+};
+
+struct BSTCursor_t {
+   BST *bst;
+   BNode *next;  // Node of the next element, or NULL once the range is done
+   size_t pos;   // Next element of the node: 0 for its own, i for dups[i-1]
+   void *bound;  // Key at which the traversal stops, or NULL
+   bool reverse; // Whether the keys are traversed by decreasing order
 };
 
 // Prototypes of static functions
 
-static void bstFreeRec(BNode *n, bool freeKey, bool freeValue);
+static BNode *bnNew(Arena *arena, void *key, void *value);
 
-static BNode *bnNew(void *key, void *value);
+/**
+ * \brief Append an element to the duplicates of a node
+ *
+ * \param bst The BST (for its arena)
+ * \param n The node, whose key is equal to key
+ * \param key Key of the element
+ * \param value Value of the element
+ * \return false in case of allocation error
+ */
+static bool bnAddDup(BST *bst, BNode *n, void *key, void *value);
+
+static BST *bstNewMode(int comparison_fn_t(void *, void *), bool balanced);
 
 /**
- * \brief Traverse the BST to sum the depths and the number of nodes
- * 
- * \param node Current node to traverse
- * \param depth Current node depth
- * \param total_depth Summed depth of all the nodes
- * \param num_keys Number of nodes
+ * \brief In-order successor of a node (using the parent pointers)
+ *
+ * \param n A node of the BST
+ * \return The next node in the increasing order of the keys, or NULL
  */
-static void bstTraverse(BNode *node, float depth, int *total_depth, int *num_keys);
+static BNode *bnSuccessor(BNode *n);
 
 /**
- * \brief Traverse the BST to do a range search
- * 
- * \param node Current node to traverse
- * \param result List of the values that are in the searched range
- * \param compfn Function used to compare the keys
- * \param keymin Minimal key of the range
- * \param keymax Maximal key of the range
- * \result true Success
- * \result false Failure (allocation error)
+ * \brief In-order predecessor of a node (using the parent pointers)
+ *
+ * \param n A node of the BST
+ * \return The previous node in the increasing order of the keys, or NULL
  */
-static bool bstTraverseRangeSearch(BNode *node, List *result,
-                            int (*compfn)(void *, void *), void *keymin,
-                            void *keymax);
+static BNode *bnPredecessor(BNode *n);
+
+/**
+ * \brief First node (in the increasing order) whose key is >= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the first node of the BST
+ * \return The node, or NULL if all the keys are smaller
+ */
+static BNode *bstLowerBound(BST *bst, void *key);
+
+/**
+ * \brief Last node (in the increasing order) whose key is <= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the last node of the BST
+ * \return The node, or NULL if all the keys are larger
+ */
+static BNode *bstUpperBound(BST *bst, void *key);
+
+static int bnHeight(BNode *n);
+
+static void bnUpdateHeight(BNode *n);
+
+/**
+ * \brief Rotate the subtree rooted at x to the left (x->right becomes its
+ * root) and fix the parent pointers and the root of the BST
+ *
+ * \param bst The BST containing x
+ * \param x Root of the subtree to rotate (x->right != NULL)
+ * \return The new root of the subtree
+ */
+static BNode *bstRotateLeft(BST *bst, BNode *x);
+
+/**
+ * \brief Rotate the subtree rooted at x to the right (x->left becomes its
+ * root) and fix the parent pointers and the root of the BST
+ *
+ * \param bst The BST containing x
+ * \param x Root of the subtree to rotate (x->left != NULL)
+ * \return The new root of the subtree
+ */
+static BNode *bstRotateRight(BST *bst, BNode *x);
+
+/**
+ * \brief Restore the AVL property on the path from n up to the root
+ *
+ * \param bst The BST containing n
+ * \param n Lowest node whose subtree changed
+ */
+static void bstRebalance(BST *bst, BNode *n);
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param key Key of the element (unused)
+ * \param value Value of the element
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool bstAppendValue(void *key, void *value, void *ctx);
 
 // Function definitions
 
-static BNode *bnNew(void *key, void *value) {
-   BNode *n = malloc(sizeof(BNode));
+static BNode *bnNew(Arena *arena, void *key, void *value) {
+   BNode *n =
+       arena ? arenaAlloc(arena, sizeof(BNode)) : malloc(sizeof(BNode));
    if (n == NULL) {
       printf("bnNew: allocation error\n");
       return NULL;
    }
+   n->parent = NULL;
    n->left = NULL;
    n->right = NULL;
    n->key = key;
    n->value = value;
+   n->dups = NULL;
+   n->ndups = 0;
+   n->height = 1;
    return n;
 }
 
-BST *bstNew(int comparison_fn_t(void *, void *)) {
+static bool bnAddDup(BST *bst, BNode *n, void *key, void *value) {
+   // The capacity is the next power of 2: the array grows when full
+   size_t ndups = n->ndups;
+   if ((ndups & (ndups - 1)) == 0) {
+      size_t capacity = ndups == 0 ? 1 : 2 * ndups;
+      tuple *dups;
+      if (bst->arena != NULL) {
+         // The old array is released with the arena
+         dups = arenaAlloc(bst->arena, capacity * sizeof(tuple));
+         if (dups != NULL && ndups > 0)
+            memcpy(dups, n->dups, ndups * sizeof(tuple));
+      } else {
+         dups = realloc(n->dups, capacity * sizeof(tuple));
+      }
+      if (dups == NULL) {
+         printf("bnAddDup: allocation error\n");
+         return false;
+      }
+      n->dups = dups;
+   }
+   n->dups[ndups].key = key;
+   n->dups[ndups].value = value;
+   n->ndups++;
+   return true;
+}
+
+static BST *bstNewMode(int comparison_fn_t(void *, void *), bool balanced) {
    assert(comparison_fn_t != NULL);
    BST *bst = malloc(sizeof(BST));
    if (bst == NULL) {
@@ -92,29 +200,129 @@ BST *bstNew(int comparison_fn_t(void *, void *)) {
    bst->root = NULL;
    bst->size = 0;
    bst->compfn = comparison_fn_t;
+   bst->balanced = balanced;
+   bst->arena = NULL;
    return bst;
 }
 
+BST *bstNew(int comparison_fn_t(void *, void *)) {
+   return bstNewMode(comparison_fn_t, false);
+}
+
+BST *bstNewBalanced(int comparison_fn_t(void *, void *)) {
+   return bstNewMode(comparison_fn_t, true);
+}
+
+void bstSetArena(BST *bst, Arena *arena) {
+   assert(bst != NULL && bst->root == NULL);
+   bst->arena = arena;
+}
+
 void bstFree(BST *bst, bool freeKey, bool freeValue) {
-   bstFreeRec(bst->root, freeKey, freeValue);
+   // Arena nodes are released with the arena
+   if (bst->arena != NULL && !freeKey && !freeValue) {
+      free(bst);
+      return;
+   }
+   // Post-order walk along the parent pointers (no recursion: a degenerate
+   // tree would overflow the call stack)
+   BNode *n = bst->root;
+   while (n != NULL) {
+      if (n->left != NULL) {
+         n = n->left;
+      } else if (n->right != NULL) {
+         n = n->right;
+      } else {
+         BNode *parent = n->parent;
+         if (parent != NULL) {
+            if (parent->left == n)
+               parent->left = NULL;
+            else
+               parent->right = NULL;
+         }
+         if (freeKey) free(n->key);
+         if (freeValue) free(n->value);
+         for (size_t i = 0; i < n->ndups; i++) {
+            if (freeKey) free(n->dups[i].key);
+            if (freeValue) free(n->dups[i].value);
+         }
+         if (bst->arena == NULL) {
+            free(n->dups);
+            free(n);
+         }
+         n = parent;
+      }
+   }
    free(bst);
 }
 
-void bstFreeRec(BNode *n, bool freeKey, bool freeValue) {
-   if (n == NULL) return;
-   bstFreeRec(n->left, freeKey, freeValue);
-   bstFreeRec(n->right, freeKey, freeValue);
-   if (freeKey) free(n->key);
-   if (freeValue) free(n->value);
-   free(n);
+size_t bstSize(BST *bst) { return bst->size; }
+
+static int bnHeight(BNode *n) { return n == NULL ? 0 : n->height; }
+
+static void bnUpdateHeight(BNode *n) {
+   int hl = bnHeight(n->left);
+   int hr = bnHeight(n->right);
+   n->height = 1 + (hl > hr ? hl : hr);
+}
+
+static BNode *bstRotateLeft(BST *bst, BNode *x) {
+   BNode *y = x->right;
+   x->right = y->left;
+   if (y->left != NULL) y->left->parent = x;
+   y->parent = x->parent;
+   if (x->parent == NULL)
+      bst->root = y;
+   else if (x->parent->left == x)
+      x->parent->left = y;
+   else
+      x->parent->right = y;
+   y->left = x;
+   x->parent = y;
+   bnUpdateHeight(x);
+   bnUpdateHeight(y);
+   return y;
 }
 
-size_t bstSize(BST *bst) { return bst->size; }
+static BNode *bstRotateRight(BST *bst, BNode *x) {
+   BNode *y = x->left;
+   x->left = y->right;
+   if (y->right != NULL) y->right->parent = x;
+   y->parent = x->parent;
+   if (x->parent == NULL)
+      bst->root = y;
+   else if (x->parent->right == x)
+      x->parent->right = y;
+   else
+      x->parent->left = y;
+   y->right = x;
+   x->parent = y;
+   bnUpdateHeight(x);
+   bnUpdateHeight(y);
+   return y;
+}
+
+static void bstRebalance(BST *bst, BNode *n) {
+   while (n != NULL) {
+      bnUpdateHeight(n);
+      int balance = bnHeight(n->left) - bnHeight(n->right);
+      if (balance > 1) { // left-heavy
+         if (bnHeight(n->left->left) < bnHeight(n->left->right))
+            bstRotateLeft(bst, n->left);
+         n = bstRotateRight(bst, n);
+      } else if (balance < -1) { // right-heavy
+         if (bnHeight(n->right->right) < bnHeight(n->right->left))
+            bstRotateRight(bst, n->right);
+         n = bstRotateLeft(bst, n);
+      }
+      n = n->parent;
+   }
+}
 
 bool bstInsert(BST *bst, void *key, void *value) {
    assert(bst != NULL);
    if (bst->root == NULL) {
-      bst->root = bnNew(key, value);
+      bst->root = bnNew(bst->arena, key, value);
       if (bst->root == NULL) {
          return false;
       }
@@ -123,26 +331,34 @@ bool bstInsert(BST *bst, void *key, void *value) {
    }
    BNode *prev = NULL;
    BNode *n = bst->root;
+   int cmp = 0;
    while (n != NULL) {
       prev = n;
-      int cmp = bst->compfn(key, n->key);
-      if (cmp <= 0) {
+      cmp = bst->compfn(key, n->key);
+      if (cmp == 0) {
+         // Duplicates share the node of their key: the height of the tree
+         // only depends on the number of distinct keys
+         if (!bnAddDup(bst, n, key, value)) return false;
+         bst->size++;
+         return true;
+      } else if (cmp < 0) {
          n = n->left;
-      } else if (cmp > 0) {
+      } else {
          n = n->right;
       }
    }
-   BNode *new = bnNew(key, value);
+   BNode *new = bnNew(bst->arena, key, value);
    if (new == NULL) {
       return false;
    }
    new->parent = prev;
-   if (bst->compfn(key, prev->key) <= 0) {
+   if (cmp < 0) {
       prev->left = new;
    } else {
       prev->right = new;
    }
    bst->size++;
+   if (bst->balanced) bstRebalance(bst, prev);
    return true;
 }
 
@@ -162,69 +378,178 @@ void *bstSearch(BST *bst, void *key) {
    return NULL;
 }
 
-static void bstTraverse(BNode *node, float depth, int *total_depth, int *num_keys) {
-   if (node == NULL) {
-      return;
-   }
-
-   *total_depth += depth;
-   (*num_keys)++;
-
-   bstTraverse(node->left, depth + 1.0, total_depth, num_keys);
-   bstTraverse(node->right, depth + 1.0, total_depth, num_keys);
-}
-
 double bstAverageNodeDepth(BST *bst) {
    assert(bst != NULL);
 
-   int total_depth = 0.0;
-   int num_keys = 0;
+   double total_depth = 0.0;
+   size_t num_keys = 0;
 
-   bstTraverse(bst->root, 0.0, &total_depth, &num_keys);
+   // Iterative pre-order walk: prev tells from where we came into n
+   BNode *prev = NULL;
+   BNode *n = bst->root;
+   size_t depth = 0;
+   while (n != NULL) {
+      BNode *next;
+      if (prev == n->parent) { // first visit
+         total_depth += depth;
+         num_keys++;
+         next = n->left != NULL ? n->left
+                                : (n->right != NULL ? n->right : n->parent);
+      } else if (prev == n->left && n->right != NULL) { // left subtree done
+         next = n->right;
+      } else { // both subtrees done
+         next = n->parent;
+      }
+      if (next == n->parent)
+         depth--;
+      else
+         depth++;
+      prev = n;
+      n = next;
+   }
 
-   return (double)total_depth / (double)num_keys;
+   return total_depth / (double)num_keys;
 }
 
-static bool bstTraverseRangeSearch(BNode *n, List *result,
-                            int (*compfn)(void *, void *), void *keymin,
-                            void *keymax) {
-   if (n == NULL) return true;
+static BNode *bnSuccessor(BNode *n) {
+   if (n->right != NULL) {
+      n = n->right;
+      while (n->left != NULL)
+         n = n->left;
+      return n;
+   }
+   while (n->parent != NULL && n->parent->right == n)
+      n = n->parent;
+   return n->parent;
+}
 
-   bool error = false;
+static BNode *bnPredecessor(BNode *n) {
+   if (n->left != NULL) {
+      n = n->left;
+      while (n->right != NULL)
+         n = n->right;
+      return n;
+   }
+   while (n->parent != NULL && n->parent->left == n)
+      n = n->parent;
+   return n->parent;
+}
 
-   if (compfn(n->key, keymin) < 0) { // key < keymin -- we go right
-      bstTraverseRangeSearch(n->right, result, compfn, keymin, keymax);
-   } else if (compfn(n->key, keymax) > 0) { // key > keymax -- we go left
-      bstTraverseRangeSearch(n->left, result, compfn, keymin, keymax);
-   } else {
-      bstTraverseRangeSearch(n->left, result, compfn, keymin, keymax);
-      error = error || !listInsertLast(result, n->value);
-      bstTraverseRangeSearch(n->right, result, compfn, keymin, keymax);
+static BNode *bstLowerBound(BST *bst, void *key) {
+   BNode *first = NULL;
+   BNode *n = bst->root;
+   while (n != NULL) {
+      if (key == NULL || bst->compfn(n->key, key) >= 0) {
+         first = n;
+         n = n->left;
+      } else {
+         n = n->right;
+      }
    }
+   return first;
+}
 
-   if (error) {
-      printf("bstTraverseRangeSearch: error durring allocation. Stopping ...\n");
-      return false;
+static BNode *bstUpperBound(BST *bst, void *key) {
+   BNode *last = NULL;
+   BNode *n = bst->root;
+   while (n != NULL) {
+      if (key == NULL || bst->compfn(n->key, key) <= 0) {
+         last = n;
+         n = n->right;
+      } else {
+         n = n->left;
+      }
    }
+   return last;
+}
 
+bool bstRangeVisit(BST *bst, void *keymin, void *keymax,
+                   bool visit(void *key, void *value, void *ctx), void *ctx) {
+   assert(bst != NULL && keymin != NULL && keymax != NULL && visit != NULL);
+
+   // Find the first node (in the increasing order) whose key >= keymin,
+   // then walk the successors until keymax is exceeded
+   for (BNode *n = bstLowerBound(bst, keymin);
+        n != NULL && bst->compfn(n->key, keymax) <= 0; n = bnSuccessor(n)) {
+      if (!visit(n->key, n->value, ctx)) return false;
+      for (size_t i = 0; i < n->ndups; i++) {
+         if (!visit(n->dups[i].key, n->dups[i].value, ctx)) return false;
+      }
+   }
    return true;
 }
 
+static bool bstAppendValue(void *key, void *value, void *ctx) {
+   (void)key;
+   return listInsertLast((List *)ctx, value);
+}
+
 List *bstRangeSearch(BST *bst, void *keymin, void *keymax) {
    assert(bst != NULL && keymin != NULL && keymax != NULL);
 
    if (bst->compfn(keymin, keymax) > 0) return NULL;
 
    List *result = listNew();
-   if (bst->root == NULL) {
-      return result;
-   }
-   bool error = !bstTraverseRangeSearch(bst->root, result, bst->compfn, keymin, keymax);
+   if (result == NULL) return NULL;
 
-   if (error) {
-      printf("bstRangeSearch: error durring allocation. Stopping and freeing ...\n");
+   if (!bstRangeVisit(bst, keymin, keymax, bstAppendValue, result)) {
+      printf("bstRangeSearch: error durring allocation. Stopping and "
+             "freeing ...\n");
       listFree(result, false);
       return NULL;
    }
    return result;
 }
+
+BSTCursor *bstRangeCursorOpen(BST *bst, void *keyMin, void *keyMax,
+                              bool reverse) {
+   assert(bst != NULL);
+   BSTCursor *cursor = malloc(sizeof(BSTCursor));
+   if (cursor == NULL) {
+      printf("bstRangeCursorOpen: allocation error\n");
+      return NULL;
+   }
+   // The cursor starts at one end of the range; the other end is only
+   // checked when it is reached
+   cursor->bst = bst;
+   cursor->reverse = reverse;
+   cursor->next = reverse ? bstUpperBound(bst, keyMax)
+                          : bstLowerBound(bst, keyMin);
+   cursor->pos = reverse && cursor->next != NULL ? cursor->next->ndups : 0;
+   cursor->bound = reverse ? keyMin : keyMax;
+   return cursor;
+}
+
+bool bstRangeCursorNext(BSTCursor *cursor, void **key, void **value) {
+   assert(cursor != NULL);
+   BNode *n = cursor->next;
+   if (n == NULL) return false;
+   if (cursor->bound != NULL) {
+      int cmp = cursor->bst->compfn(n->key, cursor->bound);
+      if (cursor->reverse ? cmp < 0 : cmp > 0) {
+         cursor->next = NULL;
+         return false;
+      }
+   }
+   size_t pos = cursor->pos;
+   if (key != NULL) *key = pos == 0 ? n->key : n->dups[pos - 1].key;
+   if (value != NULL) *value = pos == 0 ? n->value : n->dups[pos - 1].value;
+
+   // Elements of the same node first (from the last one if reverse)
+   if (cursor->reverse) {
+      if (pos > 0) {
+         cursor->pos--;
+      } else {
+         cursor->next = bnPredecessor(n);
+         if (cursor->next != NULL) cursor->pos = cursor->next->ndups;
+      }
+   } else if (pos < n->ndups) {
+      cursor->pos++;
+   } else {
+      cursor->next = bnSuccessor(n);
+      cursor->pos = 0;
+   }
+   return true;
+}
+
+void bstRangeCursorClose(BSTCursor *cursor) { free(cursor); }
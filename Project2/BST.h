@@ -5,6 +5,7 @@
 #ifndef _BST_H_
 #define _BST_H_
 
+#include "Arena.h"
 #include "List.h"
 #include <stdbool.h>
 #include <stddef.h>
@@ -12,6 +13,9 @@
 /* Opaque Structure */
 typedef struct BST_t BST;
 
+/* Opaque Structure */
+typedef struct BSTCursor_t BSTCursor;
+
 typedef struct tuple_t {
    void *key;
    void *value;
@@ -48,6 +52,37 @@ typedef struct tuple_t {
 
 BST *bstNew(int comparison_fn_t(void *, void *));
 
+/* ------------------------------------------------------------------------- *
+ * Creates an empty self-balancing BST (AVL tree). It behaves exactly as a
+ * BST created by bstNew() but guarantees a height in O(log n), hence
+ * O(log n) insertions and searches and O(log n + k) range searches, whatever
+ * the insertion order.
+ *
+ * The BST must later be deleted by calling freeBST().
+ *
+ * ARGUMENT
+ * comparison_fn_t      A comparison function (see bstNew())
+ *
+ * RETURN
+ * bst                  A pointer to the BST, or NULL in case of
+ *                      error
+ * ------------------------------------------------------------------------- */
+
+BST *bstNewBalanced(int comparison_fn_t(void *, void *));
+
+/* ------------------------------------------------------------------------- *
+ * Makes the BST allocate its nodes in the given arena rather than with
+ * malloc. Nodes inserted one after the other are then contiguous in memory
+ * and are released all at once by arenaFree(): bstFree() only walks the
+ * tree if keys or values must be freed.
+ *
+ * PARAMETERS
+ * bst          A valid pointer to an empty BST object
+ * arena        A valid pointer to an Arena object, which must outlive bst
+ * ------------------------------------------------------------------------- */
+
+void bstSetArena(BST *bst, Arena *arena);
+
 /* ------------------------------------------------------------------------- *
  * Frees the allocated memory of the given BST.
  *
@@ -139,4 +174,74 @@ double bstAverageNodeDepth(BST *bst);
 
 List *bstRangeSearch(BST *bst, void *keyMin, void *keyMax);
 
+/* ------------------------------------------------------------------------- *
+ * Calls visit on every element of the provided BST whose key is included in
+ * a range [keyMin, keyMax], in the increasing order of the keys, without
+ * allocating any memory. The traversal stops as soon as visit returns
+ * false.
+ *
+ * PARAMETERS
+ * bst          A valid pointer to a BST object
+ * keyMin       Lower bound of the range (inclusive)
+ * keyMax       Upper bound of the range (inclusive)
+ * visit        Function called with the key and the value of each element
+ *              and with ctx. Returns true to continue, false to stop.
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the elements of the range were visited, false if
+ *              the traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool bstRangeVisit(BST *bst, void *keyMin, void *keyMax,
+                   bool visit(void *key, void *value, void *ctx), void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Opens a cursor on the elements of the provided BST whose keys are included
+ * in a range [keyMin, keyMax]. The elements are then obtained one at a time
+ * by bstRangeCursorNext(), in the increasing (or decreasing) order of the
+ * keys. Opening the cursor costs O(log n) and each call to
+ * bstRangeCursorNext() O(1) amortised, whatever the size of the range: a
+ * caller reading only the first k elements pays for these k elements only.
+ *
+ * The cursor must later be deleted by calling bstRangeCursorClose(). The
+ * BST must not be modified while the cursor is open.
+ *
+ * PARAMETERS
+ * bst          A valid pointer to a BST object
+ * keyMin       Lower bound of the range (inclusive), or NULL for no bound
+ * keyMax       Upper bound of the range (inclusive), or NULL for no bound
+ * reverse      Whether to traverse the range by decreasing keys
+ *
+ * RETURN
+ * cursor       A pointer to the cursor, or NULL in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+BSTCursor *bstRangeCursorOpen(BST *bst, void *keyMin, void *keyMax,
+                              bool reverse);
+
+/* ------------------------------------------------------------------------- *
+ * Moves a cursor to the next element of its range.
+ *
+ * PARAMETERS
+ * cursor       A valid pointer to a BSTCursor object
+ * key          Set to the key of the element (unless NULL)
+ * value        Set to the value of the element (unless NULL)
+ *
+ * RETURN
+ * res          true if an element was found, false if the whole range was
+ *              traversed (key and value are then left unchanged)
+ * ------------------------------------------------------------------------- */
+
+bool bstRangeCursorNext(BSTCursor *cursor, void **key, void **value);
+
+/* ------------------------------------------------------------------------- *
+ * Frees a cursor (but not the keys and values of the BST).
+ *
+ * PARAMETERS
+ * cursor       A valid pointer to a BSTCursor object
+ * ------------------------------------------------------------------------- */
+
+void bstRangeCursorClose(BSTCursor *cursor);
+
 #endif // !_BST_H_
@@ -9,18 +9,34 @@
  *
  * ========================================================================= */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "Arena.h"
 #include "BST2d.h"
+#include "KnnHeap.h"
 #include "List.h"
 #include "Point.h"
 
 // Structures
 
+// Element of a node other than its own (same position)
+
+typedef struct Dup2d_t Dup2d;
+
+struct Dup2d_t {
+   Point *key;
+   void *value;
+};
+
 typedef struct BNode2d_t BNode2d;
 
 struct BNode2d_t {
@@ -28,33 +44,186 @@ struct BNode2d_t {
    BNode2d *right;
    Point *key;
    void *value;
-   int depth;
+   Dup2d *dups;  // Other elements at the same position (malloc'ed), or NULL
+   size_t ndups;
+   int depth;    // Depth of the node (its splitting axis is depth % 2)
+   bool deleted; // Removed elements, whose node remains until a rebuild
+   size_t count; // Number of elements (of nodes not deleted) in the subtree
+   double xmin;  // Bounding box of the points of the subtree
+   double ymin;
+   double xmax;
+   double ymax;
 };
 
 struct BST2d_t {
    BNode2d *root;
-   size_t size;
+   size_t size;        // Number of elements
+   size_t nnodes;      // Number of nodes in the tree, deleted ones included
+   size_t ndeleted;    // Number of deleted nodes in the tree
+   size_t nbuckets;    // Number of nodes with a dups array
+   BNode2d *freeNodes; // Nodes to reuse, linked by their left pointer
+   Arena *arena;       // Arena of the nodes, or NULL if they are malloc'ed
+   bool ownsArena;     // Whether the arena must be freed with the tree
+};
+
+// Position-value pair used while building the tree
+
+typedef struct Entry2d_t Entry2d;
+
+struct Entry2d_t {
+   double coord[2]; // Copy of (x, y) to avoid calling ptGetx/ptGety
+   Point *key;
+   void *value;
+   Dup2d *dups; // Other elements at this position, when rebuilding
+   size_t ndups;
+};
+
+// Ranges smaller than these are partitioned (resp. built) by one thread
+#define PAR_SELECT_MIN 65536
+#define PAR_BUILD_MIN 16384
+
+// Balance of the scapegoat rebuilds: a subtree is rebuilt when one of its
+// children holds more than this fraction of its elements (and a node is too
+// deep), and the whole tree when less than this fraction of its nodes are
+// not deleted. (The weights are the elements rather than the nodes, so a
+// position with many duplicates may defer a rebuild to a later insertion)
+#define SCAPEGOAT_ALPHA 0.7
+
+// Subtree to build, possibly on its own thread
+
+typedef struct Build2d_t Build2d;
+
+struct Build2d_t {
+   Entry2d *entries; // Entries of the whole tree (reordered)
+   Entry2d *tmp;     // Scratch array for the parallel partitions, or NULL
+   BNode2d *nodes;   // nodes[i] will hold the entry whose final index is i
+   BNode2d **pool;   // If not NULL, *pool[i] is used instead of nodes[i]
+   size_t lo;        // The subtree holds entries[lo..hi)
+   size_t hi;
+   int depth;
+   size_t nthreads; // Number of threads available for the subtree
+   BNode2d *root;   // Set to the root of the subtree
+   size_t nnodes;   // Set to the number of nodes of the subtree
+   size_t nbuckets; // Set to the number of its nodes with a dups array
+   bool error;      // Set if a dups array could not be allocated
+};
+
+// Chunk of a range partitioned around a pivot by one of several threads
+
+typedef struct Partition2d_t Partition2d;
+
+struct Partition2d_t {
+   Entry2d *entries;
+   Entry2d *tmp;
+   size_t lo; // The chunk is entries[lo..hi)
+   size_t hi;
+   int axis;
+   double pivot;
+   size_t count[3];  // Entries of the chunk <, == and > pivot
+   size_t offset[3]; // Where these entries go in tmp
 };
 
 // Prototypes of static functions
 
-static BNode2d *bn2dNew(Point *key, void *value);
+/**
+ * \brief Allocate a node, reusing one of the free nodes of the tree if any
+ *
+ * \param b2d The tree
+ * \param key Position of the node
+ * \param value Value of the node
+ * \return The node, or NULL in case of allocation error
+ */
+static BNode2d *bn2dNew(BST2d *b2d, Point *key, void *value);
+
+static void bst2dFreeRec(BNode2d *n, bool freeKey, bool freeValue,
+                         bool freeNode);
+
+/**
+ * \brief Enlarge the bounding box of n to contain the one of child
+ *
+ * \param n A node
+ * \param child A child of n
+ */
+static void bn2dExtendBox(BNode2d *n, BNode2d *child);
 
-static void bst2dFreeRec(BNode2d *n, bool freeKey, bool freeValue);
+/**
+ * \brief Count the points of a subtree in the ball, without traversing the
+ * subtrees whose bounding box is entirely inside or outside of the ball
+ *
+ * \param node Root of the subtree
+ * \param qx x coordinate of the center of the ball
+ * \param qy y coordinate of the center of the ball
+ * \param r2 Squared radius of the ball
+ * \return The number of points of the subtree in the ball
+ */
+static size_t bst2dCountRec(BNode2d *node, double qx, double qy, double r2);
+
+/**
+ * \brief Squared distance from q to the bounding box of a subtree
+ *
+ * \param n Root of the subtree
+ * \param qx x coordinate of q
+ * \param qy y coordinate of q
+ * \return 0 if q is inside the box, the squared distance to the box
+ * otherwise
+ */
+static double bn2dBoxSqrDistance(BNode2d *n, double qx, double qy);
+
+/**
+ * \brief Offer the points of a subtree to the heap of the k nearest
+ * neighbours, closest child first
+ *
+ * \param node Root of the subtree
+ * \param qx x coordinate of the query
+ * \param qy y coordinate of the query
+ * \param heap The current k nearest neighbours
+ */
+static void bst2dKnnRec(BNode2d *node, double qx, double qy, KnnHeap *heap);
 
 /**
- * \brief Traverse the BST2d and does a ball search
+ * \brief Traverse the BST2d and call visit on the values in the ball
  * 
  * \param node Current node to traverse
- * \param result List of the values that are in the searched range
- * \param q Point to range from
+ * \param qx x coordinate of the center of the ball
+ * \param qy y coordinate of the center of the ball
  * \param r Range of the ball search
  * \param depth Current depth of the node
- * \result true Success
- * \result false Failure (allocation error)
+ * \param visit Function called on each value in the ball
+ * \param ctx Context passed to visit
+ * \result true The whole subtree was traversed
+ * \result false The traversal was stopped by visit
+ */
+static bool bst2dTraverseBallVisit(BNode2d *node, double qx, double qy,
+                                   double r, int depth,
+                                   bool visit(void *value, void *ctx),
+                                   void *ctx);
+
+/**
+ * \brief Traverse the BST2d and call visit on the values in the box
+ * [lo[0], hi[0]] x [lo[1], hi[1]]
+ *
+ * \param node Current node to traverse
+ * \param lo Lower bounds of the box
+ * \param hi Upper bounds of the box
+ * \param visit Function called on each value in the box
+ * \param ctx Context passed to visit
+ * \result true The whole subtree was traversed
+ * \result false The traversal was stopped by visit
  */
-static bool bst2dTraverseBallSearch(BNode2d *node, List *result, Point *q, double r,
-                             int depth);
+static bool bst2dTraverseBoxVisit(BNode2d *node, const double *lo,
+                                  const double *hi,
+                                  bool visit(void *value, void *ctx),
+                                  void *ctx);
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param value Value in the ball
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool bst2dAppendValue(void *value, void *ctx);
+
 /**
  * \brief Traverse the BST2d to sum the depths and the number of nodes
  * 
@@ -65,19 +234,261 @@ static bool bst2dTraverseBallSearch(BNode2d *node, List *result, Point *q, doubl
  */
 static void bst2dTraverse(BNode2d *node, int depth, int *total_depth, int *num_keys);
 
+/**
+ * \brief Reorder entries[lo..hi) so that entries[k] holds the k-th smallest
+ * coordinate along axis (quickselect with a median-of-three pivot and
+ * three-way partitioning). On return, the entries whose coordinate is
+ * equal to the one of entries[k] are entries[first..last), the smaller
+ * ones are before and the larger ones after.
+ *
+ * \param entries Array of entries
+ * \param lo First index of the range
+ * \param hi One past the last index of the range
+ * \param k Index of the entry to select (lo <= k < hi)
+ * \param axis 0 to select along x, 1 along y
+ * \param first Set to the first index of the entries equal to entries[k]
+ * \param last Set to one past the last one
+ */
+static void entrySelect(Entry2d *entries, size_t lo, size_t hi, size_t k,
+                        int axis, size_t *first, size_t *last);
+
+/**
+ * \brief Same as entrySelect, but the large ranges are partitioned by
+ * nthreads threads, using tmp as scratch space
+ */
+static void entrySelectParallel(Entry2d *entries, Entry2d *tmp, size_t lo,
+                                size_t hi, size_t k, int axis,
+                                size_t nthreads, size_t *first,
+                                size_t *last);
+
+/**
+ * \brief Count the entries of a chunk smaller than, equal to and larger
+ * than the pivot
+ *
+ * \param arg The Partition2d of the chunk
+ * \return NULL
+ */
+static void *partitionCount(void *arg);
+
+/**
+ * \brief Copy the entries of a chunk to their place in tmp
+ *
+ * \param arg The Partition2d of the chunk
+ * \return NULL
+ */
+static void *partitionScatter(void *arg);
+
+/**
+ * \brief Copy back tmp[lo..hi) of a chunk to the entries
+ *
+ * \param arg The Partition2d of the chunk
+ * \return NULL
+ */
+static void *partitionCopyBack(void *arg);
+
+/**
+ * \brief Call fn on the n chunks, each one on its own thread (the calling
+ * one included), and wait for them
+ *
+ * \param fn Function to call
+ * \param parts The chunks
+ * \param n The number of chunks
+ */
+static void partitionRun(void *fn(void *), Partition2d *parts, size_t n);
+
+/**
+ * \brief Build a balanced subtree, splitting the available threads between
+ * its two subtrees
+ *
+ * \param build The subtree to build
+ */
+static void bst2dBuildRec(Build2d *build);
+
+/**
+ * \brief Thread building a subtree
+ *
+ * \param arg The Build2d of the subtree
+ * \return NULL
+ */
+static void *bst2dBuildTask(void *arg);
+
+/**
+ * \brief Child of n whose subtree holds the position (x, y), equal
+ * coordinates being on the right
+ *
+ * \param n A node
+ * \param x x coordinate of the position
+ * \param y y coordinate of the position
+ * \return The address of the left or right pointer of n
+ */
+static BNode2d **bn2dChild(BNode2d *n, double x, double y);
+
+/**
+ * \brief Largest depth allowed before a scapegoat is searched for
+ *
+ * \param nnodes Number of nodes of the tree
+ * \return floor(log(nnodes) / log(1 / SCAPEGOAT_ALPHA))
+ */
+static int bst2dMaxDepth(size_t nnodes);
+
+/**
+ * \brief Link a new leaf in the tree, then rebuild the subtree of a
+ * scapegoat if the leaf is too deep
+ *
+ * \param b2d The tree
+ * \param leaf The leaf, initialised with its position and value
+ */
+static void bst2dInsertNode(BST2d *b2d, BNode2d *leaf);
+
+/**
+ * \brief Find the node of a position (deleted or not)
+ *
+ * \param b2d The tree
+ * \param x x coordinate of the position
+ * \param y y coordinate of the position
+ * \return The node, or NULL if the position has no node in the tree
+ */
+static BNode2d *bst2dFindPosition(BST2d *b2d, double x, double y);
+
+/**
+ * \brief Find a node holding a position-value pair
+ *
+ * \param b2d The tree
+ * \param x x coordinate of the position
+ * \param y y coordinate of the position
+ * \param value The value
+ * \param index Set to the index of the pair in the node: 0 for its own
+ * element, i for dups[i - 1]
+ * \return The node, or NULL if the pair is not in the tree
+ */
+static BNode2d *bst2dFindNode(BST2d *b2d, double x, double y, void *value,
+                              size_t *index);
+
+/**
+ * \brief Add to the count of the nodes from the root to target (included)
+ *
+ * \param b2d The tree
+ * \param target A node of the tree
+ * \param add 1 or -1
+ */
+static void bst2dCountPath(BST2d *b2d, BNode2d *target, int add);
+
+/**
+ * \brief Make room for one more element in a node (nothing to do if it is
+ * deleted)
+ *
+ * \param b2d The tree
+ * \param n A node of the tree
+ * \return false in case of allocation error
+ */
+static bool bn2dReserve(BST2d *b2d, BNode2d *n);
+
+/**
+ * \brief Add an element to a node with room for it (see bn2dReserve)
+ *
+ * \param b2d The tree
+ * \param n The node of the position of key
+ * \param key Position of the element
+ * \param value Value of the element
+ */
+static void bst2dAddToNode(BST2d *b2d, BNode2d *n, Point *key, void *value);
+
+/**
+ * \brief Remove an element of a node. When it was the last one, a leaf is
+ * unlinked and freed, other nodes are marked as deleted
+ *
+ * \param b2d The tree
+ * \param target A node of the tree not deleted yet
+ * \param index Index of the element in the node (see bst2dFindNode)
+ */
+static void bst2dRemoveElement(BST2d *b2d, BNode2d *target, size_t index);
+
+/**
+ * \brief Call visit on the values of a node (none if it is deleted)
+ *
+ * \param n The node
+ * \param visit Function called on each value
+ * \param ctx Context passed to visit
+ * \return false if visit stopped
+ */
+static bool bn2dVisit(BNode2d *n, bool visit(void *value, void *ctx),
+                      void *ctx);
+
+/**
+ * \brief Rebuild the whole tree if too many of its nodes are deleted
+ *
+ * \param b2d The tree
+ */
+static void bst2dCompact(BST2d *b2d);
+
+/**
+ * \brief Move the elements of the live nodes of a subtree (with their dups)
+ * to entries and these nodes to pool, and give the deleted nodes back to
+ * the tree
+ *
+ * \param b2d The tree
+ * \param n Root of the subtree
+ * \param entries Array receiving the elements
+ * \param pool Array receiving the nodes of the elements
+ * \param i Number of elements stored so far, updated
+ */
+static void bst2dCollect(BST2d *b2d, BNode2d *n, Entry2d *entries,
+                         BNode2d **pool, size_t *i);
+
+/**
+ * \brief Rebuild a subtree into a balanced one, without its deleted nodes
+ *
+ * \param b2d The tree
+ * \param link Address of the pointer to the root of the subtree
+ * \return false in case of allocation error (the subtree is unchanged)
+ */
+static bool bst2dRebuild(BST2d *b2d, BNode2d **link);
+
+/**
+ * \brief Initialise a leaf
+ *
+ * \param n The node
+ * \param key Position of the node
+ * \param value Value of the node
+ */
+static void bn2dInit(BNode2d *n, Point *key, void *value);
+
 // Function definitions
 
-static BNode2d *bn2dNew(Point *key, void *value) {
-   BNode2d *n = malloc(sizeof(BNode2d));
+static BNode2d *bn2dNew(BST2d *b2d, Point *key, void *value) {
+   BNode2d *n = b2d->freeNodes;
+   if (n != NULL)
+      b2d->freeNodes = n->left;
+   else
+      n = b2d->arena ? arenaAlloc(b2d->arena, sizeof(BNode2d))
+                     : malloc(sizeof(BNode2d));
    if (n == NULL) {
       printf("bn2dNew: allocation error\n");
       return NULL;
    }
+   bn2dInit(n, key, value);
+   return n;
+}
+
+static void bn2dInit(BNode2d *n, Point *key, void *value) {
    n->left = NULL;
    n->right = NULL;
    n->key = key;
    n->value = value;
-   return n;
+   n->dups = NULL;
+   n->ndups = 0;
+   n->depth = 0;
+   n->deleted = false;
+   n->count = 1;
+   n->xmin = n->xmax = ptGetx(key);
+   n->ymin = n->ymax = ptGety(key);
+}
+
+static void bn2dExtendBox(BNode2d *n, BNode2d *child) {
+   if (child->xmin < n->xmin) n->xmin = child->xmin;
+   if (child->xmax > n->xmax) n->xmax = child->xmax;
+   if (child->ymin < n->ymin) n->ymin = child->ymin;
+   if (child->ymax > n->ymax) n->ymax = child->ymax;
 }
 
 BST2d *bst2dNew(void) {
@@ -88,21 +499,343 @@ BST2d *bst2dNew(void) {
    }
    bst2d->root = NULL;
    bst2d->size = 0;
+   bst2d->nnodes = 0;
+   bst2d->ndeleted = 0;
+   bst2d->nbuckets = 0;
+   bst2d->freeNodes = NULL;
+   bst2d->arena = NULL;
+   bst2d->ownsArena = false;
+   return bst2d;
+}
+
+void bst2dSetArena(BST2d *bst2d, Arena *arena) {
+   assert(bst2d != NULL && bst2d->root == NULL && !bst2d->ownsArena);
+   bst2d->arena = arena;
+}
+
+static void entrySwap(Entry2d *entries, size_t i, size_t j) {
+   Entry2d tmp = entries[i];
+   entries[i] = entries[j];
+   entries[j] = tmp;
+}
+
+static void entrySelect(Entry2d *entries, size_t lo, size_t hi, size_t k,
+                        int axis, size_t *first, size_t *last) {
+   // Entries before lo (resp. from hi) are smaller (resp. larger) than the
+   // selected one
+   while (hi - lo > 1) {
+      // Median of three pivot
+      double a = entries[lo].coord[axis];
+      double b = entries[lo + (hi - lo) / 2].coord[axis];
+      double c = entries[hi - 1].coord[axis];
+      double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                           : (a < c ? a : (b < c ? c : b));
+
+      // Three-way partition: [lo, lt) < pivot, [lt, gt) == pivot,
+      // [gt, hi) > pivot
+      size_t lt = lo, i = lo, gt = hi;
+      while (i < gt) {
+         double v = entries[i].coord[axis];
+         if (v < pivot)
+            entrySwap(entries, lt++, i++);
+         else if (v > pivot)
+            entrySwap(entries, i, --gt);
+         else
+            i++;
+      }
+
+      if (k < lt) {
+         hi = lt;
+      } else if (k >= gt) {
+         lo = gt;
+      } else {
+         *first = lt;
+         *last = gt;
+         return;
+      }
+   }
+   *first = lo;
+   *last = hi;
+}
+
+static void *partitionCount(void *arg) {
+   Partition2d *part = arg;
+   part->count[0] = part->count[1] = part->count[2] = 0;
+   for (size_t i = part->lo; i < part->hi; i++) {
+      double v = part->entries[i].coord[part->axis];
+      part->count[v < part->pivot ? 0 : (v > part->pivot ? 2 : 1)]++;
+   }
+   return NULL;
+}
+
+static void *partitionScatter(void *arg) {
+   Partition2d *part = arg;
+   size_t offset[3] = {part->offset[0], part->offset[1], part->offset[2]};
+   for (size_t i = part->lo; i < part->hi; i++) {
+      double v = part->entries[i].coord[part->axis];
+      part->tmp[offset[v < part->pivot ? 0 : (v > part->pivot ? 2 : 1)]++] =
+          part->entries[i];
+   }
+   return NULL;
+}
+
+static void *partitionCopyBack(void *arg) {
+   Partition2d *part = arg;
+   for (size_t i = part->lo; i < part->hi; i++)
+      part->entries[i] = part->tmp[i];
+   return NULL;
+}
+
+static void partitionRun(void *fn(void *), Partition2d *parts, size_t n) {
+   pthread_t threads[n];
+   bool started[n];
+   for (size_t t = 1; t < n; t++)
+      started[t] = pthread_create(&threads[t], NULL, fn, &parts[t]) == 0;
+   fn(&parts[0]);
+   for (size_t t = 1; t < n; t++) {
+      if (started[t])
+         pthread_join(threads[t], NULL);
+      else // Could not start a thread: do its work here
+         fn(&parts[t]);
+   }
+}
+
+static void entrySelectParallel(Entry2d *entries, Entry2d *tmp, size_t lo,
+                                size_t hi, size_t k, int axis,
+                                size_t nthreads, size_t *first,
+                                size_t *last) {
+   // Same steps as entrySelect, but the partitions of large ranges are
+   // stable: each thread counts the classes of its chunk, then copies its
+   // entries to their final place in tmp, which is copied back
+   while (nthreads > 1 && tmp != NULL && hi - lo >= PAR_SELECT_MIN) {
+      double a = entries[lo].coord[axis];
+      double b = entries[lo + (hi - lo) / 2].coord[axis];
+      double c = entries[hi - 1].coord[axis];
+      double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                           : (a < c ? a : (b < c ? c : b));
+
+      Partition2d parts[nthreads];
+      for (size_t t = 0; t < nthreads; t++) {
+         parts[t].entries = entries;
+         parts[t].tmp = tmp;
+         parts[t].lo = lo + (hi - lo) * t / nthreads;
+         parts[t].hi = lo + (hi - lo) * (t + 1) / nthreads;
+         parts[t].axis = axis;
+         parts[t].pivot = pivot;
+      }
+      partitionRun(partitionCount, parts, nthreads);
+
+      size_t start[3] = {lo, lo, lo};
+      for (size_t t = 0; t < nthreads; t++) {
+         start[1] += parts[t].count[0];
+         start[2] += parts[t].count[0] + parts[t].count[1];
+      }
+      size_t lt = start[1], gt = start[2];
+      for (size_t t = 0; t < nthreads; t++) {
+         for (int cls = 0; cls < 3; cls++) {
+            parts[t].offset[cls] = start[cls];
+            start[cls] += parts[t].count[cls];
+         }
+      }
+      partitionRun(partitionScatter, parts, nthreads);
+      partitionRun(partitionCopyBack, parts, nthreads);
+
+      if (k < lt) {
+         hi = lt;
+      } else if (k >= gt) {
+         lo = gt;
+      } else {
+         *first = lt;
+         *last = gt;
+         return;
+      }
+   }
+   entrySelect(entries, lo, hi, k, axis, first, last);
+}
+
+static void *bst2dBuildTask(void *arg) {
+   bst2dBuildRec(arg);
+   return NULL;
+}
+
+static void bst2dBuildRec(Build2d *build) {
+   size_t lo = build->lo, hi = build->hi;
+   build->root = NULL;
+   build->nnodes = 0;
+   build->nbuckets = 0;
+   build->error = false;
+   if (lo >= hi) return;
+
+   int axis = build->depth % 2;
+   Entry2d *entries = build->entries;
+   size_t first, last;
+   entrySelectParallel(entries, build->tmp, lo, hi, lo + (hi - lo) / 2, axis,
+                       build->nthreads, &first, &last);
+
+   // Entries equal to the median must go right, so the splitting node is
+   // the first of them. To make the shape of the tree depend only on the
+   // positions (and not on the order of the entries or on the number of
+   // threads), the one with the smallest other coordinate is chosen
+   size_t split = first;
+   for (size_t i = first + 1; i < last; i++) {
+      if (entries[i].coord[1 - axis] < entries[split].coord[1 - axis])
+         split = i;
+   }
+   entrySwap(entries, first, split);
+   split = first;
+
+   // The other entries at the same position follow it: they all go in its
+   // node (when rebuilding, the positions are distinct already)
+   size_t end = split + 1;
+   for (size_t i = end; i < last; i++) {
+      if (entries[i].coord[1 - axis] == entries[split].coord[1 - axis])
+         entrySwap(entries, end++, i);
+   }
+
+   BNode2d *n = build->pool ? build->pool[split] : &build->nodes[split];
+   bn2dInit(n, entries[split].key, entries[split].value);
+   n->depth = build->depth;
+   n->dups = entries[split].dups;
+   n->ndups = entries[split].ndups;
+   bool error = false;
+   if (end - split > 1) {
+      // Capacity rounded up to a power of 2, as grown by bn2dReserve
+      size_t capacity = 1;
+      while (capacity < end - split - 1)
+         capacity *= 2;
+      n->dups = malloc(capacity * sizeof(Dup2d));
+      if (n->dups == NULL) {
+         printf("bst2dBuild: allocation error\n");
+         error = true;
+      } else {
+         for (size_t i = split + 1; i < end; i++) {
+            n->dups[n->ndups].key = entries[i].key;
+            n->dups[n->ndups++].value = entries[i].value;
+         }
+      }
+   }
+
+   Build2d left = *build, right = *build;
+   left.hi = split;
+   right.lo = end;
+   left.depth = right.depth = build->depth + 1;
+
+   // The left subtree is built by a new thread with half of the threads
+   pthread_t thread;
+   bool started = false;
+   if (build->nthreads > 1 && hi - lo >= PAR_BUILD_MIN) {
+      left.nthreads = build->nthreads / 2;
+      right.nthreads = build->nthreads - left.nthreads;
+      started = pthread_create(&thread, NULL, bst2dBuildTask, &left) == 0;
+      if (!started) left.nthreads = right.nthreads = 1;
+   }
+   if (!started) bst2dBuildRec(&left);
+   bst2dBuildRec(&right);
+   if (started) pthread_join(thread, NULL);
+
+   n->left = left.root;
+   n->right = right.root;
+   n->count = 1 + n->ndups;
+   if (n->left != NULL) {
+      n->count += n->left->count;
+      bn2dExtendBox(n, n->left);
+   }
+   if (n->right != NULL) {
+      n->count += n->right->count;
+      bn2dExtendBox(n, n->right);
+   }
+   build->root = n;
+   build->nnodes = 1 + left.nnodes + right.nnodes;
+   build->nbuckets = (n->dups != NULL) + left.nbuckets + right.nbuckets;
+   build->error = error || left.error || right.error;
+}
+
+BST2d *bst2dBuild(Point **points, void **values, size_t n) {
+   return bst2dBuildParallel(points, values, n, 1);
+}
+
+BST2d *bst2dBuildParallel(Point **points, void **values, size_t n,
+                          size_t nthreads) {
+   assert(n == 0 || (points != NULL && values != NULL));
+   if (nthreads == 0) {
+      long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+      nthreads = nproc > 0 ? (size_t)nproc : 1;
+   }
+   BST2d *bst2d = bst2dNew();
+   if (bst2d == NULL) return NULL;
+   if (n == 0) return bst2d;
+
+   // All the nodes are allocated at once in the tree's own arena (later
+   // insertions use the next blocks)
+   bst2d->arena = arenaNew(0);
+   bst2d->ownsArena = bst2d->arena != NULL;
+   BNode2d *nodes =
+       bst2d->arena ? arenaAlloc(bst2d->arena, n * sizeof(BNode2d)) : NULL;
+   Entry2d *entries = malloc(n * sizeof(Entry2d));
+   Entry2d *tmp = NULL;
+   if (nthreads > 1 && n >= PAR_SELECT_MIN)
+      tmp = malloc(n * sizeof(Entry2d));
+   if (entries == NULL || nodes == NULL) {
+      printf("bst2dBuild: allocation error\n");
+      free(entries);
+      free(tmp);
+      bst2dFree(bst2d, false, false);
+      return NULL;
+   }
+   for (size_t i = 0; i < n; i++) {
+      entries[i].coord[0] = ptGetx(points[i]);
+      entries[i].coord[1] = ptGety(points[i]);
+      entries[i].key = points[i];
+      entries[i].value = values[i];
+      entries[i].dups = NULL;
+      entries[i].ndups = 0;
+   }
+
+   // (Without tmp, the partitions are done by a single thread. The nodes
+   // of the duplicates of a position remain unused)
+   Build2d build = {entries, tmp,  nodes, NULL, 0, n, 0, nthreads,
+                    NULL,    0,    0,     false};
+   bst2dBuildRec(&build);
+   free(entries);
+   free(tmp);
+   bst2d->root = build.root;
+   bst2d->size = n;
+   bst2d->nnodes = build.nnodes;
+   bst2d->nbuckets = build.nbuckets;
+   if (build.error) {
+      bst2dFree(bst2d, false, false);
+      return NULL;
+   }
    return bst2d;
 }
 
-static void bst2dFreeRec(BNode2d *n, bool freeKey, bool freeValue) {
+static void bst2dFreeRec(BNode2d *n, bool freeKey, bool freeValue,
+                         bool freeNode) {
    if (n == NULL) return;
-   bst2dFreeRec(n->left, freeKey, freeValue);
-   bst2dFreeRec(n->right, freeKey, freeValue);
-   if (freeKey) ptFree(n->key);
-   if (freeValue) free(n->value);
-   free(n);
+   bst2dFreeRec(n->left, freeKey, freeValue, freeNode);
+   bst2dFreeRec(n->right, freeKey, freeValue, freeNode);
+   // (The elements of the deleted nodes were handed back by bst2dDelete)
+   if (freeKey && !n->deleted) ptFree(n->key);
+   if (freeValue && !n->deleted) free(n->value);
+   for (size_t i = 0; i < n->ndups; i++) {
+      if (freeKey) ptFree(n->dups[i].key);
+      if (freeValue) free(n->dups[i].value);
+   }
+   free(n->dups);
+   if (freeNode) free(n);
 }
 
 void bst2dFree(BST2d *bst2d, bool freeKey, bool freeValue) {
    assert(bst2d != NULL);
-   bst2dFreeRec(bst2d->root, freeKey, freeValue);
+   // Arena nodes are released with the arena (but not their dups arrays)
+   if (bst2d->arena == NULL || freeKey || freeValue || bst2d->nbuckets > 0)
+      bst2dFreeRec(bst2d->root, freeKey, freeValue, bst2d->arena == NULL);
+   while (bst2d->arena == NULL && bst2d->freeNodes != NULL) {
+      BNode2d *n = bst2d->freeNodes;
+      bst2d->freeNodes = n->left;
+      free(n);
+   }
+   if (bst2d->ownsArena) arenaFree(bst2d->arena);
    free(bst2d);
 }
 
@@ -111,59 +844,272 @@ size_t bst2dSize(BST2d *bst2d) {
    return bst2d->size;
 }
 
+static BNode2d **bn2dChild(BNode2d *n, double x, double y) {
+   if (n->depth % 2) return y >= ptGety(n->key) ? &n->right : &n->left;
+   return x >= ptGetx(n->key) ? &n->right : &n->left;
+}
+
+static int bst2dMaxDepth(size_t nnodes) {
+   return (int)floor(log((double)nnodes) / log(1.0 / SCAPEGOAT_ALPHA));
+}
+
+static void bst2dInsertNode(BST2d *b2d, BNode2d *leaf) {
+   double x = ptGetx(leaf->key), y = ptGety(leaf->key);
+   BNode2d **link = &b2d->root;
+   int depth = 0;
+   while (*link != NULL) {
+      // Every node on the path gets the new point in its subtree
+      BNode2d *n = *link;
+      n->count++;
+      if (x < n->xmin) n->xmin = x;
+      if (x > n->xmax) n->xmax = x;
+      if (y < n->ymin) n->ymin = y;
+      if (y > n->ymax) n->ymax = y;
+      link = bn2dChild(n, x, y);
+      depth++;
+   }
+   leaf->depth = depth;
+   *link = leaf;
+   b2d->size++;
+   b2d->nnodes++;
+   if (depth <= bst2dMaxDepth(b2d->nnodes)) return;
+
+   // The leaf is too deep: its deepest ancestor with a child holding more
+   // than SCAPEGOAT_ALPHA of its elements is the scapegoat
+   BNode2d **scapegoat = NULL;
+   for (link = &b2d->root; *link != leaf; link = bn2dChild(*link, x, y)) {
+      BNode2d *n = *link;
+      double max = SCAPEGOAT_ALPHA * (double)n->count;
+      if ((n->left != NULL && (double)n->left->count > max) ||
+          (n->right != NULL && (double)n->right->count > max))
+         scapegoat = link;
+   }
+   // (If the rebuild fails, the tree is only left unbalanced)
+   if (scapegoat != NULL) bst2dRebuild(b2d, scapegoat);
+}
+
+static BNode2d *bst2dFindPosition(BST2d *b2d, double x, double y) {
+   // A position has at most one node, on the path of its insertion
+   BNode2d *n = b2d->root;
+   while (n != NULL) {
+      if (ptGetx(n->key) == x && ptGety(n->key) == y) return n;
+      n = *bn2dChild(n, x, y);
+   }
+   return NULL;
+}
+
+static bool bn2dReserve(BST2d *b2d, BNode2d *n) {
+   // The capacity of dups is the next power of 2: it grows when full
+   size_t ndups = n->ndups;
+   if (n->deleted || (ndups & (ndups - 1)) != 0) return true;
+   Dup2d *dups = realloc(n->dups, (ndups == 0 ? 1 : 2 * ndups) *
+                                      sizeof(Dup2d));
+   if (dups == NULL) {
+      printf("bn2dReserve: allocation error\n");
+      return false;
+   }
+   if (n->dups == NULL) b2d->nbuckets++;
+   n->dups = dups;
+   return true;
+}
+
+static void bst2dCountPath(BST2d *b2d, BNode2d *target, int add) {
+   double x = ptGetx(target->key), y = ptGety(target->key);
+   BNode2d *n = b2d->root;
+   while (n != target) {
+      n->count += add;
+      n = *bn2dChild(n, x, y);
+   }
+   target->count += add;
+}
+
+static void bst2dAddToNode(BST2d *b2d, BNode2d *n, Point *key, void *value) {
+   if (n->deleted) {
+      // The node of the position comes back to life
+      n->key = key;
+      n->value = value;
+      n->deleted = false;
+      b2d->ndeleted--;
+   } else {
+      n->dups[n->ndups].key = key;
+      n->dups[n->ndups++].value = value;
+   }
+   bst2dCountPath(b2d, n, +1);
+   b2d->size++;
+}
+
 bool bst2dInsert(BST2d *b2d, Point *point, void *value) {
-   assert(b2d != NULL);
-   if (b2d->root == NULL) {
-      b2d->root = bn2dNew(point, value);
-      b2d->size++;
+   assert(b2d != NULL && point != NULL);
+   // Duplicates share the node of their position: the depth of the tree
+   // only depends on the number of distinct positions
+   BNode2d *n = bst2dFindPosition(b2d, ptGetx(point), ptGety(point));
+   if (n != NULL) {
+      if (!bn2dReserve(b2d, n)) return false;
+      bst2dAddToNode(b2d, n, point, value);
       return true;
    }
+   BNode2d *leaf = bn2dNew(b2d, point, value);
+   if (leaf == NULL) return false;
+   bst2dInsertNode(b2d, leaf);
+   return true;
+}
 
-   BNode2d *n = b2d->root;
-   int depth = 0;
-   Point *currpt;
+static BNode2d *bst2dFindNode(BST2d *b2d, double x, double y, void *value,
+                              size_t *index) {
+   BNode2d *n = bst2dFindPosition(b2d, x, y);
+   if (n == NULL || n->deleted) return NULL;
+   if (n->value == value) {
+      *index = 0;
+      return n;
+   }
+   for (size_t i = 0; i < n->ndups; i++) {
+      if (n->dups[i].value == value) {
+         *index = i + 1;
+         return n;
+      }
+   }
+   return NULL;
+}
+
+static void bst2dRemoveElement(BST2d *b2d, BNode2d *target, size_t index) {
+   b2d->size--;
+   if (target->ndups > 0) {
+      // The node keeps the other elements, in their order
+      if (index == 0) {
+         target->key = target->dups[0].key;
+         target->value = target->dups[0].value;
+         index = 1;
+      }
+      memmove(target->dups + index - 1, target->dups + index,
+              (target->ndups - index) * sizeof(Dup2d));
+      if (--target->ndups == 0) {
+         free(target->dups);
+         target->dups = NULL;
+         b2d->nbuckets--;
+      }
+      bst2dCountPath(b2d, target, -1);
+      return;
+   }
+
+   // The bounding boxes are not shrunk: they remain valid, only less tight
+   double x = ptGetx(target->key), y = ptGety(target->key);
+   BNode2d **link = &b2d->root;
+   while (*link != target) {
+      (*link)->count--;
+      link = bn2dChild(*link, x, y);
+   }
+   if (target->left == NULL && target->right == NULL) {
+      *link = NULL;
+      target->left = b2d->freeNodes;
+      b2d->freeNodes = target;
+      b2d->nnodes--;
+   } else {
+      target->count--;
+      target->deleted = true;
+      b2d->ndeleted++;
+   }
+}
+
+static void bst2dCompact(BST2d *b2d) {
+   if ((double)(b2d->nnodes - b2d->ndeleted) <
+       SCAPEGOAT_ALPHA * (double)b2d->nnodes)
+      bst2dRebuild(b2d, &b2d->root);
+}
+
+bool bst2dDelete(BST2d *b2d, Point *point, void *value) {
+   assert(b2d != NULL && point != NULL);
+   size_t index;
+   BNode2d *target =
+       bst2dFindNode(b2d, ptGetx(point), ptGety(point), value, &index);
+   if (target == NULL) return false;
+   bst2dRemoveElement(b2d, target, index);
+   bst2dCompact(b2d);
+   return true;
+}
+
+bool bst2dUpdate(BST2d *b2d, Point *point, void *value, Point *newPoint) {
+   assert(b2d != NULL && point != NULL && newPoint != NULL);
+   size_t index;
+   BNode2d *target =
+       bst2dFindNode(b2d, ptGetx(point), ptGety(point), value, &index);
+   if (target == NULL) return false;
+
+   double x = ptGetx(newPoint), y = ptGety(newPoint);
+   if (x == ptGetx(target->key) && y == ptGety(target->key)) {
+      // Same position: only the key of the element changes
+      if (index == 0)
+         target->key = newPoint;
+      else
+         target->dups[index - 1].key = newPoint;
+      return true;
+   }
+
+   // The room for the element at its new position is allocated first, so
+   // that nothing changes on error
+   BNode2d *n = bst2dFindPosition(b2d, x, y);
+   if (n != NULL) {
+      if (!bn2dReserve(b2d, n)) return false;
+      bst2dRemoveElement(b2d, target, index);
+      bst2dAddToNode(b2d, n, newPoint, value);
+   } else {
+      BNode2d *leaf = bn2dNew(b2d, newPoint, value);
+      if (leaf == NULL) return false;
+      bst2dRemoveElement(b2d, target, index);
+      bst2dInsertNode(b2d, leaf);
+   }
+   bst2dCompact(b2d);
+   return true;
+}
+
+static void bst2dCollect(BST2d *b2d, BNode2d *n, Entry2d *entries,
+                         BNode2d **pool, size_t *i) {
    while (n != NULL) {
-      currpt = n->key;
-      if (!(depth % 2)) {                       // compare x
-         if (ptGetx(point) >= ptGetx(currpt)) { // right
-            if (n->right == NULL) {             // insert point right
-               n->right = bn2dNew(point, value);
-               b2d->size++;
-               return true;
-            } else { // continue search in right subtree
-               n = n->right;
-            }                      // end if
-         } else {                  // left
-            if (n->left == NULL) { // insert point left
-               n->left = bn2dNew(point, value);
-               b2d->size++;
-               return true;
-            } else { // continue search in left subtree
-               n = n->left;
-            }                                   // end if
-         }                                      // end if
-      } else {                                  // compare y
-         if (ptGety(point) >= ptGety(currpt)) { // right
-            if (n->right == NULL) {             // insert point right
-               n->right = bn2dNew(point, value);
-               b2d->size++;
-               return true;
-            } else { // continue search in right subtree
-               n = n->right;
-            }                      // end if
-         } else {                  // left
-            if (n->left == NULL) { // insert point left
-               n->left = bn2dNew(point, value);
-               b2d->size++;
-               return true;
-            } else { // continue search in left subtree
-               n = n->left;
-            } // end if
-         }    // end if
-      }       // end if
-      depth++;
+      BNode2d *right = n->right;
+      bst2dCollect(b2d, n->left, entries, pool, i);
+      if (n->deleted) {
+         n->left = b2d->freeNodes;
+         b2d->freeNodes = n;
+         b2d->nnodes--;
+         b2d->ndeleted--;
+      } else {
+         // (The dups array goes along to the new node of the position)
+         entries[*i].coord[0] = ptGetx(n->key);
+         entries[*i].coord[1] = ptGety(n->key);
+         entries[*i].key = n->key;
+         entries[*i].value = n->value;
+         entries[*i].dups = n->dups;
+         entries[*i].ndups = n->ndups;
+         pool[(*i)++] = n;
+      }
+      n = right;
+   }
+}
+
+static bool bst2dRebuild(BST2d *b2d, BNode2d **link) {
+   BNode2d *root = *link;
+   // (Upper bound of the number of live nodes: duplicates share a node)
+   size_t n = root->count;
+   int depth = root->depth;
+   Entry2d *entries = malloc((n > 0 ? n : 1) * sizeof(Entry2d));
+   BNode2d **pool = malloc((n > 0 ? n : 1) * sizeof(BNode2d *));
+   if (entries == NULL || pool == NULL) {
+      printf("bst2dRebuild: allocation error\n");
+      free(entries);
+      free(pool);
+      return false;
    }
-   return false;
+
+   // The nodes of the elements are reused for the new subtree, whose
+   // splitting axes start with the one of its old root
+   size_t i = 0;
+   bst2dCollect(b2d, root, entries, pool, &i);
+   Build2d build = {entries, NULL, NULL, pool, 0, i, depth, 1,
+                    NULL,    0,    0,    false};
+   bst2dBuildRec(&build);
+   *link = build.root;
+   free(entries);
+   free(pool);
+   return true;
 }
 
 void *bst2dSearch(BST2d *b2d, Point *q) {
@@ -175,14 +1121,10 @@ void *bst2dSearch(BST2d *b2d, Point *q) {
       currpt = n->key;
       if (!(depth % 2)) { // compare x
          if (ptGetx(q) == ptGetx(currpt)) {
-            if (ptGety(q) == ptGety(currpt)) {
+            if (ptGety(q) == ptGety(currpt) && !n->deleted) {
                return n->value;
-            } else {
-               if (ptGety(q) >= ptGety(currpt)) {
-                  n = n->right;
-               } else {
-                  n = n->left;
-               }
+            } else { // equal x are inserted on the right
+               n = n->right;
             }
          } else {
             if (ptGetx(q) >= ptGetx(currpt)) {
@@ -193,14 +1135,10 @@ void *bst2dSearch(BST2d *b2d, Point *q) {
          }
       } else { // compare y
          if (ptGety(q) == ptGety(currpt)) {
-            if (ptGetx(q) == ptGetx(currpt)) {
+            if (ptGetx(q) == ptGetx(currpt) && !n->deleted) {
                return n->value;
-            } else {
-               if (ptGetx(q) >= ptGetx(currpt)) {
-                  n = n->right;
-               } else {
-                  n = n->left;
-               }
+            } else { // equal y are inserted on the right
+               n = n->right;
             }
          } else {
             if (ptGety(q) >= ptGety(currpt)) {
@@ -215,68 +1153,189 @@ void *bst2dSearch(BST2d *b2d, Point *q) {
    return NULL;
 }
 
-static bool bst2dTraverseBallSearch(BNode2d *node, List *result, Point *q, double r,
-                             int depth) {
-   if (node == NULL)
-      return true;
+static bool bn2dVisit(BNode2d *n, bool visit(void *value, void *ctx),
+                      void *ctx) {
+   if (n->deleted) return true;
+   if (!visit(n->value, ctx)) return false;
+   for (size_t i = 0; i < n->ndups; i++) {
+      if (!visit(n->dups[i].value, ctx)) return false;
+   }
+   return true;
+}
 
-   bool error = false;
+static bool bst2dTraverseBallVisit(BNode2d *node, double qx, double qy,
+                                   double r, int depth,
+                                   bool visit(void *value, void *ctx),
+                                   void *ctx) {
+   while (node != NULL) {
+      double dx = ptGetx(node->key) - qx;
+      double dy = ptGety(node->key) - qy;
+      if (dx * dx + dy * dy <= r * r && !bn2dVisit(node, visit, ctx))
+         return false;
 
-   double r2 = r * r;
-   if (ptSqrDistance(q, node->key) <= r2) {
-      error = error || !listInsertLast(result, node->value);
+      // Points equal to the splitting coordinate are on the right. Same
+      // arithmetic as the test of the points (c + r and c - r would round
+      // and prune points at distance exactly r)
+      double d = depth % 2 ? dy : dx;
+      depth++;
+      if (d > 0 && d * d > r * r) { // the ball is on the left
+         node = node->left;
+      } else if (d <= 0 && d * d > r * r) { // the ball is on the right
+         node = node->right;
+      } else { // both sides, recurse on one and iterate on the other
+         if (!bst2dTraverseBallVisit(node->left, qx, qy, r, depth, visit,
+                                     ctx))
+            return false;
+         node = node->right;
+      }
    }
+   return true;
+}
 
-   if(error) {
-      printf("bst2dTraverseBallSearch: allocation error while adding to the list. \n Stopping... \n");
-      return false;
-   }
+bool bst2dBallVisit(BST2d *bst2d, Point *q, double r,
+                    bool visit(void *value, void *ctx), void *ctx) {
+   assert(bst2d != NULL && q != NULL && r >= 0 && visit != NULL);
+   return bst2dTraverseBallVisit(bst2d->root, ptGetx(q), ptGety(q), r, 0,
+                                 visit, ctx);
+}
 
-   if (!(depth % 2)) { // compare x
-      if (ptGetx(q) + r <= ptGetx(node->key)) {
-         bst2dTraverseBallSearch(node->left, result, q, r, depth + 1);
-      } else if (ptGetx(q) - r >= ptGetx(node->key)) {
-         bst2dTraverseBallSearch(node->right, result, q, r, depth + 1);
-      } else {
-         bst2dTraverseBallSearch(node->left, result, q, r, depth + 1);
-         bst2dTraverseBallSearch(node->right, result, q, r, depth + 1);
-      }
-   } else { // compare y
-      if (ptGety(q) + r <= ptGety(node->key)) {
-         bst2dTraverseBallSearch(node->left, result, q, r, depth + 1);
-      } else if (ptGety(q) - r >= ptGety(node->key)) {
-         bst2dTraverseBallSearch(node->right, result, q, r, depth + 1);
-      } else {
-         bst2dTraverseBallSearch(node->left, result, q, r, depth + 1);
-         bst2dTraverseBallSearch(node->right, result, q, r, depth + 1);
+static bool bst2dTraverseBoxVisit(BNode2d *node, const double *lo,
+                                  const double *hi,
+                                  bool visit(void *value, void *ctx),
+                                  void *ctx) {
+   while (node != NULL) {
+      double c[2] = {ptGetx(node->key), ptGety(node->key)};
+      if (c[0] >= lo[0] && c[0] <= hi[0] && c[1] >= lo[1] && c[1] <= hi[1] &&
+          !bn2dVisit(node, visit, ctx))
+         return false;
+
+      // The left subtree is below the splitting coordinate, the right one
+      // at or above it
+      int axis = node->depth % 2;
+      if (hi[axis] < c[axis]) { // the box is on the left
+         node = node->left;
+      } else if (lo[axis] >= c[axis]) { // the box is on the right
+         node = node->right;
+      } else { // both sides, recurse on one and iterate on the other
+         if (!bst2dTraverseBoxVisit(node->left, lo, hi, visit, ctx))
+            return false;
+         node = node->right;
       }
    }
    return true;
 }
 
+bool bst2dBoxVisit(BST2d *bst2d, double xmin, double ymin, double xmax,
+                   double ymax, bool visit(void *value, void *ctx),
+                   void *ctx) {
+   assert(bst2d != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+   double lo[2] = {xmin, ymin};
+   double hi[2] = {xmax, ymax};
+   return bst2dTraverseBoxVisit(bst2d->root, lo, hi, visit, ctx);
+}
+
+static bool bst2dAppendValue(void *value, void *ctx) {
+   return listInsertLast((List *)ctx, value);
+}
+
 List *bst2dBallSearch(BST2d *bst2d, Point *q, double r) {
    assert(bst2d != NULL && q != NULL && r >= 0);
    List *result = listNew();
-   if (bst2d->root == NULL) {
-      return result;
+   if (result == NULL) {
+      return NULL;
    }
-   bool error = !bst2dTraverseBallSearch(bst2d->root, result, q, r, 0);
-   if(error) {
-      printf("bst2dBallSearch: error detected. \n Freeing and stopping... \n");
+   if (!bst2dBallVisit(bst2d, q, r, bst2dAppendValue, result)) {
+      printf("bst2dBallSearch: allocation error while adding to the list. \n Freeing and stopping... \n");
       listFree(result, false);
       return NULL;
    }
    return result;
 }
 
+static size_t bst2dCountRec(BNode2d *node, double qx, double qy, double r2) {
+   size_t count = 0;
+   while (node != NULL) {
+      if (bn2dBoxSqrDistance(node, qx, qy) > r2) break; // outside the ball
+
+      // Farthest corner of the bounding box from q
+      double fx = qx - node->xmin > node->xmax - qx ? qx - node->xmin
+                                                    : node->xmax - qx;
+      double fy = qy - node->ymin > node->ymax - qy ? qy - node->ymin
+                                                    : node->ymax - qy;
+      if (fx * fx + fy * fy <= r2) { // inside the ball
+         count += node->count;
+         break;
+      }
+
+      double dx = ptGetx(node->key) - qx;
+      double dy = ptGety(node->key) - qy;
+      if (dx * dx + dy * dy <= r2 && !node->deleted)
+         count += 1 + node->ndups;
+
+      count += bst2dCountRec(node->left, qx, qy, r2);
+      node = node->right;
+   }
+   return count;
+}
+
+static double bn2dBoxSqrDistance(BNode2d *n, double qx, double qy) {
+   double dx = qx < n->xmin ? n->xmin - qx : (qx > n->xmax ? qx - n->xmax : 0);
+   double dy = qy < n->ymin ? n->ymin - qy : (qy > n->ymax ? qy - n->ymax : 0);
+   return dx * dx + dy * dy;
+}
+
+size_t bst2dBallCount(BST2d *bst2d, Point *q, double r) {
+   assert(bst2d != NULL && q != NULL && r >= 0);
+   return bst2dCountRec(bst2d->root, ptGetx(q), ptGety(q), r * r);
+}
+
+static void bst2dKnnRec(BNode2d *node, double qx, double qy, KnnHeap *heap) {
+   double dx = ptGetx(node->key) - qx;
+   double dy = ptGety(node->key) - qy;
+   if (!node->deleted) {
+      knnOffer(heap, dx * dx + dy * dy, node->value);
+      for (size_t i = 0; i < node->ndups; i++)
+         knnOffer(heap, dx * dx + dy * dy, node->dups[i].value);
+   }
+
+   // Visit first the child whose box is the closest; a box not closer
+   // than the current k-th neighbour cannot improve the result
+   BNode2d *near = node->left, *far = node->right;
+   double dnear = near ? bn2dBoxSqrDistance(near, qx, qy) : INFINITY;
+   double dfar = far ? bn2dBoxSqrDistance(far, qx, qy) : INFINITY;
+   if (dfar < dnear) {
+      BNode2d *tmp = near;
+      near = far;
+      far = tmp;
+      double dtmp = dnear;
+      dnear = dfar;
+      dfar = dtmp;
+   }
+   if (near != NULL && dnear < knnBound(heap))
+      bst2dKnnRec(near, qx, qy, heap);
+   if (far != NULL && dfar < knnBound(heap)) bst2dKnnRec(far, qx, qy, heap);
+}
+
+size_t bst2dKnn(BST2d *bst2d, Point *q, size_t k, void **values,
+                double *dists) {
+   assert(bst2d != NULL && q != NULL);
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+   if (bst2d->root != NULL && k > 0)
+      bst2dKnnRec(bst2d->root, ptGetx(q), ptGety(q), &heap);
+   return knnFinish(&heap);
+}
+
 static void bst2dTraverse(BNode2d *node, int depth, int *total_depth,
                    int *num_keys) {
    if (node == NULL) {
       return;
    }
 
-   *total_depth += depth;
-   (*num_keys)++;
+   if (!node->deleted) {
+      *total_depth += depth;
+      (*num_keys)++;
+   }
 
    bst2dTraverse(node->left, depth + 1, total_depth, num_keys);
    bst2dTraverse(node->right, depth + 1, total_depth, num_keys);
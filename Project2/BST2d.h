@@ -5,6 +5,7 @@
 #ifndef _BST2D_H_
 #define _BST2D_H_
 
+#include "Arena.h"
 #include "List.h"
 #include "Point.h"
 #include <stdbool.h>
@@ -25,6 +26,65 @@ typedef struct BST2d_t BST2d;
 
 BST2d *bst2dNew(void);
 
+/* ------------------------------------------------------------------------- *
+ * Creates a balanced BST2d containing the n given position-value pairs.
+ *
+ * The tree is built in O(n log n) by splitting each subtree at the median
+ * of its positions (x at even depths, y at odd depths), so that its height
+ * is about log2(n) whatever the order of the points. Positions equal to the
+ * median on the splitting coordinate go to the right subtree, as in
+ * bst2dInsert(), and further insertions remain possible. The shape of the
+ * tree only depends on the set of positions, not on their order.
+ *
+ * The nodes are allocated contiguously in an arena owned by the tree.
+ *
+ * The BST2d must later be deleted by calling freeBST2d().
+ *
+ * PARAMETERS
+ * points         An array of n positions (Point objects)
+ * values         An array of n values, values[i] being associated to
+ *                points[i]
+ * n              Number of position-value pairs
+ *
+ * RETURN
+ * bst2d          A pointer to the BST2d, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+BST2d *bst2dBuild(Point **points, void **values, size_t n);
+
+/* ------------------------------------------------------------------------- *
+ * Same as bst2dBuild(), but on nthreads threads: the medians of the large
+ * subtrees are selected by all the threads of the subtree, then its two
+ * subtrees are built concurrently, each with half of the threads. The
+ * resulting tree has the same shape and the same positions in each node as
+ * with bst2dBuild().
+ *
+ * PARAMETERS
+ * points         An array of n positions (Point objects)
+ * values         An array of n values, values[i] being associated to
+ *                points[i]
+ * n              Number of position-value pairs
+ * nthreads       The number of threads, or 0 for the number of processors
+ *
+ * RETURN
+ * bst2d          A pointer to the BST2d, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+BST2d *bst2dBuildParallel(Point **points, void **values, size_t n,
+                          size_t nthreads);
+
+/* ------------------------------------------------------------------------- *
+ * Makes the BST2d allocate its nodes in the given arena rather than with
+ * malloc. The nodes are then released all at once by arenaFree():
+ * bst2dFree() only walks the tree if keys or values must be freed.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to an empty BST2d object
+ * arena          A valid pointer to an Arena object, which must outlive bst2d
+ * ------------------------------------------------------------------------- */
+
+void bst2dSetArena(BST2d *bst2d, Arena *arena);
+
 /* ------------------------------------------------------------------------- *
  * Frees the allocated memory of the given BST2d.
  *
@@ -51,7 +111,13 @@ size_t bst2dSize(BST2d *bst2d);
 
 /* ------------------------------------------------------------------------- *
  * Inserts a new position-value pair in the provided BST2d. This
- * implementation of the BST allows duplicate keys.
+ * implementation of the BST allows duplicate keys: the pairs at the same
+ * position share a single node, so the height of the tree only depends on
+ * the number of distinct positions.
+ *
+ * When the new leaf is deeper than log(n) / log(1 / 0.7), the subtree of its
+ * deepest ancestor with a child holding more than 70% of its elements (the
+ * scapegoat) is rebuilt into a balanced one, as done by bst2dBuild().
  *
  * PARAMETERS
  * bst2d          A valid pointer to a BST object
@@ -65,6 +131,46 @@ size_t bst2dSize(BST2d *bst2d);
 
 bool bst2dInsert(BST2d *b2d, Point *point, void *value);
 
+/* ------------------------------------------------------------------------- *
+ * Removes a position-value pair from the provided BST2d. If the pair was
+ * inserted several times, only one of its copies is removed. The key and
+ * the value are not freed.
+ *
+ * Removed elements that are not leaves are only marked as deleted: the
+ * whole tree is rebuilt once too many of its nodes are, so that its height
+ * remains in O(log n). The bounding boxes of the subtrees are not shrunk.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * point          The position of the element
+ * value          The value of the element
+ *
+ * RETURN
+ * res            true if the element was removed, false if it is not in
+ *                bst2d
+ * ------------------------------------------------------------------------- */
+
+bool bst2dDelete(BST2d *b2d, Point *point, void *value);
+
+/* ------------------------------------------------------------------------- *
+ * Moves a position-value pair of the provided BST2d to a new position. This
+ * is the same as bst2dDelete() followed by bst2dInsert(), but the tree is
+ * left unchanged if the new position cannot be inserted.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * point          The current position of the element
+ * value          The value of the element
+ * newPoint       The new position of the element (a Point object, which
+ *                replaces point as its key)
+ *
+ * RETURN
+ * res            true if the element was moved, false if it is not in bst2d
+ *                or in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+bool bst2dUpdate(BST2d *b2d, Point *point, void *value, Point *newPoint);
+
 /* ------------------------------------------------------------------------- *
  * Returns the value associated to a position, if any. If several values are
  * associated to this position, any one of them is returned.
@@ -102,6 +208,91 @@ void *bst2dSearch(BST2d *b2d, Point *q);
 
 List *bst2dBallSearch(BST2d *bst2d, Point *q, double r);
 
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values of the positions of the provided BST2d that are
+ * included in a ball of radius r centered at q (in no particular order),
+ * without allocating any memory. The traversal stops as soon as visit
+ * returns false.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * q              The center of the ball
+ * r              The radius of the ball
+ * visit          Function called with each value and ctx. Returns true to
+ *                continue, false to stop.
+ * ctx            Pointer passed as is to visit
+ *
+ * RETURN
+ * res            true if all the values in the ball were visited, false if
+ *                the traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool bst2dBallVisit(BST2d *bst2d, Point *q, double r,
+                    bool visit(void *value, void *ctx), void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values of the positions of the provided BST2d that are
+ * included in the box [xmin, xmax] x [ymin, ymax] (in no particular order),
+ * without allocating any memory. A subtree is only traversed if the box
+ * reaches its side of the splitting line of its parent. The traversal stops
+ * as soon as visit returns false.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * xmin           Lower bound of the box along x
+ * ymin           Lower bound of the box along y
+ * xmax           Upper bound of the box along x (xmax >= xmin)
+ * ymax           Upper bound of the box along y (ymax >= ymin)
+ * visit          Function called with each value and ctx. Returns true to
+ *                continue, false to stop.
+ * ctx            Pointer passed as is to visit
+ *
+ * RETURN
+ * res            true if all the values in the box were visited, false if
+ *                the traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool bst2dBoxVisit(BST2d *bst2d, double xmin, double ymin, double xmax,
+                   double ymax, bool visit(void *value, void *ctx),
+                   void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Counts the positions of the provided BST2d that are included in a ball of
+ * radius r centered at q. The subtrees whose bounding box lies entirely
+ * inside the ball are counted at once, without being traversed.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * q              The center of the ball
+ * r              The radius of the ball
+ *
+ * RETURN
+ * count          The number of positions in the ball
+ * ------------------------------------------------------------------------- */
+
+size_t bst2dBallCount(BST2d *bst2d, Point *q, double r);
+
+/* ------------------------------------------------------------------------- *
+ * Finds the k positions of the provided BST2d that are the closest to q.
+ * The subtrees are explored by increasing distance of their bounding box to
+ * q, and skipped as soon as they cannot contain a closer position than the
+ * k found so far.
+ *
+ * PARAMETERS
+ * bst2d          A valid pointer to a BST2d object
+ * q              The query position
+ * k              The number of neighbours searched
+ * values         An array of at least k pointers, set to the values of the
+ *                neighbours by increasing distance
+ * dists          An array of at least k doubles, set to their distances
+ *
+ * RETURN
+ * n              The number of neighbours found (at most k)
+ * ------------------------------------------------------------------------- */
+
+size_t bst2dKnn(BST2d *bst2d, Point *q, size_t k, void **values,
+                double *dists);
+
 /* ------------------------------------------------------------------------- *
  * Returns the average depth of the BST2d nodes. The depth of a node is the
  * number of edges that connect it to the root (the root's depth is thus 0).
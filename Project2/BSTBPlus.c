@@ -0,0 +1,549 @@
+/* ========================================================================= *
+ * BST definition (with a B+tree)
+ *
+ * Alternative implementation of BST.h, linked instead of BST.c. The
+ * elements are kept in the leaves of a B+tree whose nodes hold sorted arrays
+ * of up to BP_LEAF_MAX elements (leaves) or BP_INNER_MAX + 1 children
+ * (inner nodes) and span about 4 cache lines: the tree is 4 times shallower
+ * than a binary one and a level costs one node fetch and a binary search in
+ * contiguous memory. The leaves are doubly linked, so that range searches
+ * and cursors scan them sequentially.
+ *
+ * The separator keys[i] of an inner node is the smallest key of its child
+ * i + 1: keys equal to it may also be at the end of child i (duplicates).
+ * All the leaves are at the same depth, hence bstNew() and bstNewBalanced()
+ * create the same tree.
+ *
+ * The nodes that an insertion may create (a leaf, and an inner node per
+ * level and for a new root) are allocated before the tree is modified and
+ * kept as spares until splits use them: an allocation error leaves the tree
+ * unchanged.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arena.h"
+#include "BST.h"
+#include "List.h"
+
+// Capacities of the nodes (256 bytes each on a 64-bit platform)
+#define BP_LEAF_MAX 14
+#define BP_INNER_MAX 15
+
+// Opaque Structure
+
+typedef struct BPLeaf_t BPLeaf;
+
+struct BPLeaf_t {
+   int nkeys;
+   BPLeaf *prev;
+   BPLeaf *next;
+   void *keys[BP_LEAF_MAX];
+   void *values[BP_LEAF_MAX];
+};
+
+typedef struct BPInner_t BPInner;
+
+struct BPInner_t {
+   int nkeys; // Number of separators (the node has nkeys + 1 children)
+   void *keys[BP_INNER_MAX];
+   void *children[BP_INNER_MAX + 1]; // BPInner, or BPLeaf on the last level
+};
+
+struct BST_t {
+   void *root;  // BPInner, or BPLeaf if height == 0, or NULL if empty
+   int height;  // Number of levels of inner nodes
+   size_t size;
+   int (*compfn)(void *, void *);
+   Arena *arena; // Arena of the nodes, or NULL if they are malloc'ed
+   BPLeaf *spareLeaf;   // Leaf allocated ahead for a split, or NULL
+   BPInner *spareInner; // Inner nodes allocated ahead for splits, linked
+                        // by children[0]
+   int nspareInner;     // Number of spare inner nodes
+};
+
+struct BSTCursor_t {
+   BST *bst;
+   BPLeaf *leaf; // Leaf of the next element, or NULL once the range is done
+   int pos;      // Position of the next element in leaf
+   void *bound;  // Key at which the traversal stops, or NULL
+   bool reverse; // Whether the keys are traversed by decreasing order
+};
+
+// Prototypes of static functions
+
+static void *bpAlloc(BST *bst, size_t size);
+
+/**
+ * \brief Allocate the spare nodes needed by the splits of an insertion: a
+ * leaf and height + 1 inner nodes
+ *
+ * \param bst The BST
+ * \return false in case of allocation error (the spares already allocated
+ * are kept)
+ */
+static bool bpReserve(BST *bst);
+
+/**
+ * \brief Take an inner node from the spares (see bpReserve())
+ *
+ * \param bst The BST
+ * \return The inner node
+ */
+static BPInner *bpTakeInner(BST *bst);
+
+/**
+ * \brief Position of the first key >= key in a sorted array of keys
+ *
+ * \param bst The BST (for its comparison function)
+ * \param keys The sorted keys
+ * \param n Number of keys
+ * \param key The key
+ * \return The position, n if all the keys are smaller
+ */
+static int bpLowerIndex(BST *bst, void **keys, int n, void *key);
+
+/**
+ * \brief Position of the first key > key in a sorted array of keys
+ *
+ * \param bst The BST (for its comparison function)
+ * \param keys The sorted keys
+ * \param n Number of keys
+ * \param key The key
+ * \return The position, n if no key is larger
+ */
+static int bpUpperIndex(BST *bst, void **keys, int n, void *key);
+
+/**
+ * \brief First element (in the increasing order) whose key is >= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the first element of the BST
+ * \param pos Set to the position of the element in the returned leaf
+ * \return The leaf of the element, or NULL if all the keys are smaller
+ */
+static BPLeaf *bstLowerBound(BST *bst, void *key, int *pos);
+
+/**
+ * \brief Last element (in the increasing order) whose key is <= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the last element of the BST
+ * \param pos Set to the position of the element in the returned leaf
+ * \return The leaf of the element, or NULL if all the keys are larger
+ */
+static BPLeaf *bstUpperBound(BST *bst, void *key, int *pos);
+
+/**
+ * \brief Insert an element in the subtree rooted at node, splitting the
+ * nodes that overflow
+ *
+ * \param bst The BST
+ * \param node Root of the subtree
+ * \param level Number of levels of inner nodes of the subtree
+ * \param key Key of the element
+ * \param value Value of the element
+ * \param sep Set to the separator of the new sibling, if node was split
+ * \param sibling Set to the new right sibling of node if node was split,
+ * NULL otherwise. The new nodes are taken from the spares.
+ */
+static void bpInsertRec(BST *bst, void *node, int level, void *key,
+                        void *value, void **sep, void **sibling);
+
+/**
+ * \brief Free the inner nodes of a subtree (not its leaves)
+ *
+ * \param node Root of the subtree
+ * \param level Number of levels of inner nodes of the subtree
+ */
+static void bpFreeInner(void *node, int level);
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param key Key of the element (unused)
+ * \param value Value of the element
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool bstAppendValue(void *key, void *value, void *ctx);
+
+// Function definitions
+
+static void *bpAlloc(BST *bst, size_t size) {
+   void *node = bst->arena ? arenaAlloc(bst->arena, size) : malloc(size);
+   if (node == NULL) printf("bpAlloc: allocation error\n");
+   return node;
+}
+
+static bool bpReserve(BST *bst) {
+   if (bst->spareLeaf == NULL) {
+      bst->spareLeaf = bpAlloc(bst, sizeof(BPLeaf));
+      if (bst->spareLeaf == NULL) return false;
+   }
+   while (bst->nspareInner < bst->height + 1) {
+      BPInner *inner = bpAlloc(bst, sizeof(BPInner));
+      if (inner == NULL) return false;
+      inner->children[0] = bst->spareInner;
+      bst->spareInner = inner;
+      bst->nspareInner++;
+   }
+   return true;
+}
+
+static BPInner *bpTakeInner(BST *bst) {
+   assert(bst->spareInner != NULL);
+   BPInner *inner = bst->spareInner;
+   bst->spareInner = inner->children[0];
+   bst->nspareInner--;
+   return inner;
+}
+
+BST *bstNew(int comparison_fn_t(void *, void *)) {
+   assert(comparison_fn_t != NULL);
+   BST *bst = malloc(sizeof(BST));
+   if (bst == NULL) {
+      printf("bstNew: allocation error\n");
+      return NULL;
+   }
+   bst->root = NULL;
+   bst->height = 0;
+   bst->size = 0;
+   bst->compfn = comparison_fn_t;
+   bst->arena = NULL;
+   bst->spareLeaf = NULL;
+   bst->spareInner = NULL;
+   bst->nspareInner = 0;
+   return bst;
+}
+
+BST *bstNewBalanced(int comparison_fn_t(void *, void *)) {
+   // A B+tree is always balanced
+   return bstNew(comparison_fn_t);
+}
+
+void bstSetArena(BST *bst, Arena *arena) {
+   assert(bst != NULL && bst->root == NULL);
+   bst->arena = arena;
+}
+
+static void bpFreeInner(void *node, int level) {
+   if (level == 0) return;
+   BPInner *inner = (BPInner *)node;
+   for (int i = 0; i <= inner->nkeys; i++)
+      bpFreeInner(inner->children[i], level - 1);
+   free(inner);
+}
+
+void bstFree(BST *bst, bool freeKey, bool freeValue) {
+   // Arena nodes are released with the arena
+   if (bst->root != NULL && (bst->arena == NULL || freeKey || freeValue)) {
+      int pos;
+      BPLeaf *leaf = bstLowerBound(bst, NULL, &pos);
+      while (leaf != NULL) {
+         BPLeaf *next = leaf->next;
+         for (int i = 0; i < leaf->nkeys; i++) {
+            if (freeKey) free(leaf->keys[i]);
+            if (freeValue) free(leaf->values[i]);
+         }
+         if (bst->arena == NULL) free(leaf);
+         leaf = next;
+      }
+      if (bst->arena == NULL) bpFreeInner(bst->root, bst->height);
+   }
+   if (bst->arena == NULL) {
+      free(bst->spareLeaf);
+      while (bst->spareInner != NULL)
+         free(bpTakeInner(bst));
+   }
+   free(bst);
+}
+
+size_t bstSize(BST *bst) { return bst->size; }
+
+static int bpLowerIndex(BST *bst, void **keys, int n, void *key) {
+   int lo = 0, hi = n;
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (bst->compfn(keys[mid], key) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+static int bpUpperIndex(BST *bst, void **keys, int n, void *key) {
+   int lo = 0, hi = n;
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (bst->compfn(keys[mid], key) <= 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+static BPLeaf *bstLowerBound(BST *bst, void *key, int *pos) {
+   void *node = bst->root;
+   if (node == NULL) return NULL;
+   // Children left of the separators >= key may still end with copies of
+   // key: go down left of them, then on to the next leaf if needed
+   for (int level = bst->height; level > 0; level--) {
+      BPInner *inner = (BPInner *)node;
+      int i = key == NULL ? 0 : bpLowerIndex(bst, inner->keys, inner->nkeys,
+                                               key);
+      node = inner->children[i];
+   }
+   BPLeaf *leaf = (BPLeaf *)node;
+   *pos = key == NULL ? 0 : bpLowerIndex(bst, leaf->keys, leaf->nkeys, key);
+   if (*pos == leaf->nkeys) {
+      leaf = leaf->next;
+      *pos = 0;
+   }
+   return leaf;
+}
+
+static BPLeaf *bstUpperBound(BST *bst, void *key, int *pos) {
+   void *node = bst->root;
+   if (node == NULL) return NULL;
+   for (int level = bst->height; level > 0; level--) {
+      BPInner *inner = (BPInner *)node;
+      int i = key == NULL ? inner->nkeys
+                          : bpUpperIndex(bst, inner->keys, inner->nkeys, key);
+      node = inner->children[i];
+   }
+   BPLeaf *leaf = (BPLeaf *)node;
+   *pos = (key == NULL ? leaf->nkeys
+                       : bpUpperIndex(bst, leaf->keys, leaf->nkeys, key)) -
+          1;
+   if (*pos < 0) {
+      leaf = leaf->prev;
+      if (leaf != NULL) *pos = leaf->nkeys - 1;
+   }
+   return leaf;
+}
+
+static void bpInsertRec(BST *bst, void *node, int level, void *key,
+                        void *value, void **sep, void **sibling) {
+   *sibling = NULL;
+
+   if (level == 0) {
+      // Duplicates go after the equal keys, in the order of insertion
+      BPLeaf *leaf = (BPLeaf *)node;
+      int pos = bpUpperIndex(bst, leaf->keys, leaf->nkeys, key);
+
+      BPLeaf *dst = leaf;
+      if (leaf->nkeys == BP_LEAF_MAX) {
+         // Split: the upper half moves to a new leaf on the right
+         BPLeaf *right = bst->spareLeaf;
+         assert(right != NULL);
+         bst->spareLeaf = NULL;
+         int half = (BP_LEAF_MAX + 1) / 2;
+         right->nkeys = BP_LEAF_MAX - half;
+         memcpy(right->keys, leaf->keys + half, right->nkeys * sizeof(void *));
+         memcpy(right->values, leaf->values + half,
+                right->nkeys * sizeof(void *));
+         leaf->nkeys = half;
+         right->prev = leaf;
+         right->next = leaf->next;
+         if (leaf->next != NULL) leaf->next->prev = right;
+         leaf->next = right;
+         if (pos > half) {
+            dst = right;
+            pos -= half;
+         }
+         *sibling = right;
+      }
+
+      memmove(dst->keys + pos + 1, dst->keys + pos,
+              (dst->nkeys - pos) * sizeof(void *));
+      memmove(dst->values + pos + 1, dst->values + pos,
+              (dst->nkeys - pos) * sizeof(void *));
+      dst->keys[pos] = key;
+      dst->values[pos] = value;
+      dst->nkeys++;
+      if (*sibling != NULL) *sep = ((BPLeaf *)*sibling)->keys[0];
+      return;
+   }
+
+   BPInner *inner = (BPInner *)node;
+   int i = bpUpperIndex(bst, inner->keys, inner->nkeys, key);
+   void *childSep, *childSibling;
+   bpInsertRec(bst, inner->children[i], level - 1, key, value, &childSep,
+               &childSibling);
+   if (childSibling == NULL) return;
+
+   // The new child goes right of child i, its separator at position i
+   if (inner->nkeys == BP_INNER_MAX) {
+      // Split: the middle separator moves up, the separators after it and
+      // their children move to a new node on the right
+      BPInner *right = bpTakeInner(bst);
+      int half = BP_INNER_MAX / 2;
+      void *keys[BP_INNER_MAX + 1];
+      void *children[BP_INNER_MAX + 2];
+      memcpy(keys, inner->keys, i * sizeof(void *));
+      keys[i] = childSep;
+      memcpy(keys + i + 1, inner->keys + i,
+             (BP_INNER_MAX - i) * sizeof(void *));
+      memcpy(children, inner->children, (i + 1) * sizeof(void *));
+      children[i + 1] = childSibling;
+      memcpy(children + i + 2, inner->children + i + 1,
+             (BP_INNER_MAX - i) * sizeof(void *));
+
+      inner->nkeys = half;
+      memcpy(inner->keys, keys, half * sizeof(void *));
+      memcpy(inner->children, children, (half + 1) * sizeof(void *));
+      right->nkeys = BP_INNER_MAX - half;
+      memcpy(right->keys, keys + half + 1, right->nkeys * sizeof(void *));
+      memcpy(right->children, children + half + 1,
+             (right->nkeys + 1) * sizeof(void *));
+      *sep = keys[half];
+      *sibling = right;
+      return;
+   }
+
+   memmove(inner->keys + i + 1, inner->keys + i,
+           (inner->nkeys - i) * sizeof(void *));
+   memmove(inner->children + i + 2, inner->children + i + 1,
+           (inner->nkeys - i) * sizeof(void *));
+   inner->keys[i] = childSep;
+   inner->children[i + 1] = childSibling;
+   inner->nkeys++;
+}
+
+bool bstInsert(BST *bst, void *key, void *value) {
+   assert(bst != NULL);
+   if (bst->root == NULL) {
+      BPLeaf *leaf = bpAlloc(bst, sizeof(BPLeaf));
+      if (leaf == NULL) return false;
+      leaf->nkeys = 0;
+      leaf->prev = NULL;
+      leaf->next = NULL;
+      bst->root = leaf;
+   }
+
+   // Nothing fails once the tree starts being modified
+   if (!bpReserve(bst)) return false;
+
+   void *sep, *sibling;
+   bpInsertRec(bst, bst->root, bst->height, key, value, &sep, &sibling);
+   if (sibling != NULL) {
+      // The root was split: the tree grows by one level
+      BPInner *root = bpTakeInner(bst);
+      root->nkeys = 1;
+      root->keys[0] = sep;
+      root->children[0] = bst->root;
+      root->children[1] = sibling;
+      bst->root = root;
+      bst->height++;
+   }
+   bst->size++;
+   return true;
+}
+
+void *bstSearch(BST *bst, void *key) {
+   assert(bst != NULL);
+   int pos;
+   BPLeaf *leaf = bstLowerBound(bst, key, &pos);
+   if (leaf == NULL || bst->compfn(leaf->keys[pos], key) != 0) return NULL;
+   return leaf->values[pos];
+}
+
+double bstAverageNodeDepth(BST *bst) {
+   assert(bst != NULL);
+   // All the elements are in the leaves, at the same depth
+   return (double)bst->height;
+}
+
+bool bstRangeVisit(BST *bst, void *keymin, void *keymax,
+                   bool visit(void *key, void *value, void *ctx), void *ctx) {
+   assert(bst != NULL && keymin != NULL && keymax != NULL && visit != NULL);
+
+   // Find the first element whose key >= keymin, then scan the leaves
+   // until keymax is exceeded
+   int pos;
+   for (BPLeaf *leaf = bstLowerBound(bst, keymin, &pos); leaf != NULL;
+        leaf = leaf->next, pos = 0) {
+      for (; pos < leaf->nkeys; pos++) {
+         if (bst->compfn(leaf->keys[pos], keymax) > 0) return true;
+         if (!visit(leaf->keys[pos], leaf->values[pos], ctx)) return false;
+      }
+   }
+   return true;
+}
+
+static bool bstAppendValue(void *key, void *value, void *ctx) {
+   (void)key;
+   return listInsertLast((List *)ctx, value);
+}
+
+List *bstRangeSearch(BST *bst, void *keymin, void *keymax) {
+   assert(bst != NULL && keymin != NULL && keymax != NULL);
+
+   if (bst->compfn(keymin, keymax) > 0) return NULL;
+
+   List *result = listNew();
+   if (result == NULL) return NULL;
+
+   if (!bstRangeVisit(bst, keymin, keymax, bstAppendValue, result)) {
+      printf("bstRangeSearch: allocation error\n");
+      listFree(result, false);
+      return NULL;
+   }
+   return result;
+}
+
+BSTCursor *bstRangeCursorOpen(BST *bst, void *keyMin, void *keyMax,
+                              bool reverse) {
+   assert(bst != NULL);
+   BSTCursor *cursor = malloc(sizeof(BSTCursor));
+   if (cursor == NULL) {
+      printf("bstRangeCursorOpen: allocation error\n");
+      return NULL;
+   }
+   // The cursor starts at one end of the range; the other end is only
+   // checked when it is reached
+   cursor->bst = bst;
+   cursor->reverse = reverse;
+   cursor->pos = 0;
+   cursor->leaf = reverse ? bstUpperBound(bst, keyMax, &cursor->pos)
+                          : bstLowerBound(bst, keyMin, &cursor->pos);
+   cursor->bound = reverse ? keyMin : keyMax;
+   return cursor;
+}
+
+bool bstRangeCursorNext(BSTCursor *cursor, void **key, void **value) {
+   assert(cursor != NULL);
+   BPLeaf *leaf = cursor->leaf;
+   if (leaf == NULL) return false;
+   int pos = cursor->pos;
+   if (cursor->bound != NULL) {
+      int cmp = cursor->bst->compfn(leaf->keys[pos], cursor->bound);
+      if (cursor->reverse ? cmp < 0 : cmp > 0) {
+         cursor->leaf = NULL;
+         return false;
+      }
+   }
+   if (key != NULL) *key = leaf->keys[pos];
+   if (value != NULL) *value = leaf->values[pos];
+
+   if (cursor->reverse) {
+      if (--cursor->pos < 0) {
+         cursor->leaf = leaf->prev;
+         if (leaf->prev != NULL) cursor->pos = leaf->prev->nkeys - 1;
+      }
+   } else if (++cursor->pos == leaf->nkeys) {
+      cursor->leaf = leaf->next;
+      cursor->pos = 0;
+   }
+   return true;
+}
+
+void bstRangeCursorClose(BSTCursor *cursor) { free(cursor); }
@@ -0,0 +1,220 @@
+/* ========================================================================= *
+ * FrozenBST definition
+ *
+ * The elements are stored in two parallel arrays indexed from 1, in
+ * Eytzinger order: the children of position k are at positions 2k and
+ * 2k + 1. A search descends without branching on the result of the
+ * comparisons (k = 2k + (key[k] < key)) and prefetches the keys of the
+ * grandchildren and the part of the array 4 levels below, so that the
+ * memory accesses of the next levels overlap with the comparisons.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "BST.h"
+#include "BSTFrozen.h"
+#include "List.h"
+
+#if defined(__GNUC__)
+#define FBST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define FBST_PREFETCH(p) ((void)(p))
+#endif
+
+// Structures
+
+struct FrozenBST_t {
+   size_t size;
+   void **keys;   // keys[1..size], in Eytzinger order
+   void **values; // values[1..size], in the same order
+   int (*compfn)(void *, void *);
+};
+
+// Prototypes of static functions
+
+/**
+ * \brief Place the sorted elements in the subtree rooted at position k
+ *
+ * \param fbst The FrozenBST being built
+ * \param k Root of the subtree (in [1, size])
+ * \param sortedKeys Keys in the increasing order
+ * \param sortedValues Values in the same order
+ * \param i Position of the next sorted element to place
+ * \return The position of the element following the subtree
+ */
+static size_t fbstFill(FrozenBST *fbst, size_t k, void **sortedKeys,
+                       void **sortedValues, size_t i);
+
+/**
+ * \brief Position of the first element (in the increasing order) whose key
+ * is >= key
+ *
+ * \param fbst The FrozenBST
+ * \param key The key
+ * \return The position, or 0 if all the keys are smaller
+ */
+static size_t fbstLowerBound(FrozenBST *fbst, void *key);
+
+/**
+ * \brief Position of the next element in the increasing order
+ *
+ * \param fbst The FrozenBST
+ * \param k Position of an element
+ * \return The position of the next element, or 0 if k is the last one
+ */
+static size_t fbstNext(FrozenBST *fbst, size_t k);
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param key Key of the element (unused)
+ * \param value Value of the element
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool fbstAppendValue(void *key, void *value, void *ctx);
+
+// Function definitions
+
+static size_t fbstFill(FrozenBST *fbst, size_t k, void **sortedKeys,
+                       void **sortedValues, size_t i) {
+   // In-order walk of the implicit tree (its height is in O(log n))
+   if (k > fbst->size) return i;
+   i = fbstFill(fbst, 2 * k, sortedKeys, sortedValues, i);
+   fbst->keys[k] = sortedKeys[i];
+   fbst->values[k] = sortedValues[i];
+   return fbstFill(fbst, 2 * k + 1, sortedKeys, sortedValues, i + 1);
+}
+
+FrozenBST *bstFreeze(BST *bst, int comparison_fn_t(void *, void *)) {
+   assert(bst != NULL && comparison_fn_t != NULL);
+
+   size_t n = bstSize(bst);
+   FrozenBST *fbst = malloc(sizeof(FrozenBST));
+   void **sortedKeys = malloc((2 * n + 1) * sizeof(void *));
+   BSTCursor *cursor = bstRangeCursorOpen(bst, NULL, NULL, false);
+   if (fbst != NULL) {
+      fbst->keys = malloc((n + 1) * sizeof(void *));
+      fbst->values = malloc((n + 1) * sizeof(void *));
+   }
+   if (fbst == NULL || sortedKeys == NULL || cursor == NULL ||
+       fbst->keys == NULL || fbst->values == NULL) {
+      printf("bstFreeze: allocation error\n");
+      if (fbst != NULL) {
+         free(fbst->keys);
+         free(fbst->values);
+      }
+      free(fbst);
+      free(sortedKeys);
+      if (cursor != NULL) bstRangeCursorClose(cursor);
+      return NULL;
+   }
+   fbst->size = n;
+   fbst->keys[0] = NULL;
+   fbst->values[0] = NULL;
+   fbst->compfn = comparison_fn_t;
+
+   // The elements in the increasing order, then in Eytzinger order
+   void **sortedValues = sortedKeys + n;
+   for (size_t i = 0; i < n; i++)
+      bstRangeCursorNext(cursor, &sortedKeys[i], &sortedValues[i]);
+   bstRangeCursorClose(cursor);
+   fbstFill(fbst, 1, sortedKeys, sortedValues, 0);
+   free(sortedKeys);
+   return fbst;
+}
+
+void fbstFree(FrozenBST *fbst, bool freeKey, bool freeValue) {
+   assert(fbst != NULL);
+   for (size_t k = 1; k <= fbst->size; k++) {
+      if (freeKey) free(fbst->keys[k]);
+      if (freeValue) free(fbst->values[k]);
+   }
+   free(fbst->keys);
+   free(fbst->values);
+   free(fbst);
+}
+
+size_t fbstSize(FrozenBST *fbst) { return fbst->size; }
+
+static size_t fbstLowerBound(FrozenBST *fbst, void *key) {
+   void **keys = fbst->keys;
+   size_t n = fbst->size;
+   size_t k = 1;
+   while (k <= n) {
+      // The 16 descendants 4 levels below are in 2 cache lines, and the 4
+      // grandchildren were prefetched there 2 levels ago
+      if (16 * k <= n) FBST_PREFETCH(keys + 16 * k);
+      if (4 * k + 3 <= n) {
+         FBST_PREFETCH(keys[4 * k]);
+         FBST_PREFETCH(keys[4 * k + 1]);
+         FBST_PREFETCH(keys[4 * k + 2]);
+         FBST_PREFETCH(keys[4 * k + 3]);
+      }
+      k = 2 * k + (fbst->compfn(keys[k], key) < 0);
+   }
+   // k encodes the path from the root: the result is the last node where
+   // the descent went left (drop the right moves, then this left move)
+   while (k & 1)
+      k >>= 1;
+   return k >> 1;
+}
+
+static size_t fbstNext(FrozenBST *fbst, size_t k) {
+   size_t n = fbst->size;
+   if (2 * k + 1 <= n) {
+      // Leftmost node of the right subtree
+      k = 2 * k + 1;
+      while (2 * k <= n)
+         k = 2 * k;
+      return k;
+   }
+   // First ancestor of which k is in the left subtree
+   while (k & 1)
+      k >>= 1;
+   return k >> 1;
+}
+
+void *fbstSearch(FrozenBST *fbst, void *key) {
+   assert(fbst != NULL);
+   size_t k = fbstLowerBound(fbst, key);
+   if (k == 0 || fbst->compfn(fbst->keys[k], key) != 0) return NULL;
+   return fbst->values[k];
+}
+
+bool fbstRangeVisit(FrozenBST *fbst, void *keyMin, void *keyMax,
+                    bool visit(void *key, void *value, void *ctx),
+                    void *ctx) {
+   assert(fbst != NULL && keyMin != NULL && keyMax != NULL && visit != NULL);
+   for (size_t k = fbstLowerBound(fbst, keyMin);
+        k != 0 && fbst->compfn(fbst->keys[k], keyMax) <= 0;
+        k = fbstNext(fbst, k)) {
+      if (!visit(fbst->keys[k], fbst->values[k], ctx)) return false;
+   }
+   return true;
+}
+
+static bool fbstAppendValue(void *key, void *value, void *ctx) {
+   (void)key;
+   return listInsertLast((List *)ctx, value);
+}
+
+List *fbstRangeSearch(FrozenBST *fbst, void *keyMin, void *keyMax) {
+   assert(fbst != NULL && keyMin != NULL && keyMax != NULL);
+
+   if (fbst->compfn(keyMin, keyMax) > 0) return NULL;
+
+   List *result = listNew();
+   if (result == NULL) return NULL;
+
+   if (!fbstRangeVisit(fbst, keyMin, keyMax, fbstAppendValue, result)) {
+      printf("fbstRangeSearch: allocation error\n");
+      listFree(result, false);
+      return NULL;
+   }
+   return result;
+}
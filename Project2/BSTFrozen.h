@@ -0,0 +1,118 @@
+/* ========================================================================= *
+ * FrozenBST interface
+ * Read-only copy of a BST for dictionaries that are built once and then
+ * only queried. The elements are stored in a sorted array laid out in
+ * Eytzinger order (the breadth-first order of a complete binary tree): the
+ * nodes visited by a search are packed at the start of the array and the
+ * descent needs no pointers.
+ * ========================================================================= */
+
+#ifndef _BSTFROZEN_H_
+#define _BSTFROZEN_H_
+
+#include "BST.h"
+#include "List.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Opaque Structure */
+typedef struct FrozenBST_t FrozenBST;
+
+/* ------------------------------------------------------------------------- *
+ * Creates a FrozenBST holding the elements of a BST (the keys and values
+ * are shared, not copied). The BST is not modified and may be freed
+ * afterwards (without freeing its keys and values).
+ *
+ * The FrozenBST must later be deleted by calling fbstFree().
+ *
+ * PARAMETERS
+ * bst              A valid pointer to a BST object
+ * comparison_fn_t  The comparison function of bst (see bstNew())
+ *
+ * RETURN
+ * fbst             A pointer to the FrozenBST, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+FrozenBST *bstFreeze(BST *bst, int comparison_fn_t(void *, void *));
+
+/* ------------------------------------------------------------------------- *
+ * Frees the allocated memory of the given FrozenBST.
+ *
+ * PARAMETERS
+ * fbst         A valid pointer to a FrozenBST object
+ * freeKey      Whether to free the keys.
+ * freeValue    Whether to free the values.
+ * ------------------------------------------------------------------------- */
+
+void fbstFree(FrozenBST *fbst, bool freeKey, bool freeValue);
+
+/* ------------------------------------------------------------------------- *
+ * Counts the number of elements stored in the given FrozenBST.
+ *
+ * PARAMETERS
+ * fbst         A valid pointer to a FrozenBST object
+ *
+ * RETURN
+ * nb           The amount of elements stored in fbst
+ * ------------------------------------------------------------------------- */
+
+size_t fbstSize(FrozenBST *fbst);
+
+/* ------------------------------------------------------------------------- *
+ * Returns the value associated to that key, as bstSearch(). If duplicate
+ * copies of that key belong to the FrozenBST, the value of the first one
+ * in the order of the BST is returned.
+ *
+ * PARAMETERS
+ * fbst         A valid pointer to a FrozenBST object
+ * key          The key to look for
+ *
+ * RETURN
+ * res          The value corresponding to that key, or NULL if the key is
+ *              not present in the FrozenBST
+ * ------------------------------------------------------------------------- */
+
+void *fbstSearch(FrozenBST *fbst, void *key);
+
+/* ------------------------------------------------------------------------- *
+ * Returns the values of the elements whose keys are included in a range
+ * [keyMin, keyMax], sorted in the increasing order of the keys, as
+ * bstRangeSearch().
+ *
+ * PARAMETERS
+ * fbst         A valid pointer to a FrozenBST object
+ * keyMin       Lower bound of the range (inclusive)
+ * keyMax       Upper bound of the range (inclusive)
+ *
+ * RETURN
+ * l            A List containing the element in the given range, or
+ *              NULL in case of allocation error.
+ *
+ * NOTES
+ * The List must be freed but not its content.
+ * ------------------------------------------------------------------------- */
+
+List *fbstRangeSearch(FrozenBST *fbst, void *keyMin, void *keyMax);
+
+/* ------------------------------------------------------------------------- *
+ * Calls visit on every element whose key is included in a range
+ * [keyMin, keyMax], in the increasing order of the keys, until visit
+ * returns false, as bstRangeVisit().
+ *
+ * PARAMETERS
+ * fbst         A valid pointer to a FrozenBST object
+ * keyMin       Lower bound of the range (inclusive)
+ * keyMax       Upper bound of the range (inclusive)
+ * visit        Function called with the key and the value of each element
+ *              and with ctx. Returns true to continue, false to stop.
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the elements of the range were visited, false if
+ *              the traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool fbstRangeVisit(FrozenBST *fbst, void *keyMin, void *keyMax,
+                    bool visit(void *key, void *value, void *ctx), void *ctx);
+
+#endif // !_BSTFROZEN_H_
@@ -0,0 +1,387 @@
+/* ========================================================================= *
+ * BST definition (with a concurrent skip list)
+ *
+ * Alternative implementation of BST.h, linked instead of BST.c, whose
+ * bstInsert(), bstSearch(), bstSize(), bstRangeSearch(), bstRangeVisit()
+ * and cursors may be called concurrently by several threads, without any
+ * lock:
+ * - an element is linked at level 0 and then at its upper levels, each
+ *   time by a compare-and-swap on the next pointer of its predecessor; a
+ *   failed compare-and-swap means that another element was linked there
+ *   meanwhile, and the search of the predecessor resumes from there;
+ * - the elements are never removed nor moved, hence the readers follow the
+ *   next pointers without retrying nor waiting: they see the elements whose
+ *   insertion completed before they started, and possibly some of those
+ *   inserted during their traversal.
+ *
+ * The arena set by bstSetArena() is not thread-safe: a BST using one must
+ * be filled by a single thread (the readers may still be concurrent).
+ *
+ * The atomic operations are the __atomic builtins of GCC and Clang (C99 has
+ * no atomics).
+ * ========================================================================= */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Arena.h"
+#include "BST.h"
+#include "List.h"
+
+// Maximal number of levels, and the probability that an element reaching
+// a level also reaches the next one is 1/4: enough for 4^16 elements
+#define SL_MAX_LEVEL 16
+
+#define SL_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SL_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define SL_CAS(p, expected, v)                                                \
+   __atomic_compare_exchange_n(p, expected, v, false, __ATOMIC_RELEASE,       \
+                               __ATOMIC_RELAXED)
+
+// Opaque Structure
+
+typedef struct SNode_t SNode;
+
+struct SNode_t {
+   void *key;
+   void *value;
+   int height;     // Number of levels the node is linked in
+   SNode *next[];  // Next node at each level (NULL at the end)
+};
+
+struct BST_t {
+   SNode *head;   // Sentinel (without key) linked in all the levels
+   size_t size;   // Number of elements (atomic)
+   uint64_t seed; // State of the generator of the heights (atomic)
+   int (*compfn)(void *, void *);
+   Arena *arena;  // Arena of the nodes, or NULL if they are malloc'ed
+};
+
+struct BSTCursor_t {
+   BST *bst;
+   SNode *next;  // Next node to return, or NULL once the range is done
+   void *bound;  // Key at which the traversal stops, or NULL
+   bool reverse; // Whether the keys are traversed by decreasing order
+};
+
+// Prototypes of static functions
+
+static SNode *snNew(BST *bst, int height);
+
+/**
+ * \brief Random height of a new node (1 with probability 3/4, 2 with
+ * probability 3/16, ...)
+ *
+ * \param bst The BST
+ * \return The height, in [1, SL_MAX_LEVEL]
+ */
+static int slRandomHeight(BST *bst);
+
+/**
+ * \brief Find the last node of each level whose key is < key (or <= key)
+ *
+ * \param bst The BST
+ * \param key The key
+ * \param orEqual Whether the nodes whose key is equal to key are included
+ * \param preds Set to the node found at each level (the head if there is
+ * none), unless NULL
+ * \return The node found at level 0 (the head if there is none)
+ */
+static SNode *slFindPreds(BST *bst, void *key, bool orEqual, SNode **preds);
+
+/**
+ * \brief First node (in the increasing order) whose key is >= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the first node of the BST
+ * \return The node, or NULL if all the keys are smaller
+ */
+static SNode *bstLowerBound(BST *bst, void *key);
+
+/**
+ * \brief Last node (in the increasing order) whose key is <= key
+ *
+ * \param bst The BST
+ * \param key The key, or NULL for the last node of the BST
+ * \return The node, or NULL if all the keys are larger
+ */
+static SNode *bstUpperBound(BST *bst, void *key);
+
+/**
+ * \brief Previous node in the increasing order (the list is singly linked:
+ * it is searched from the head, in O(log n))
+ *
+ * \param bst The BST
+ * \param n A node of the BST
+ * \return The previous node, or NULL if n is the first one
+ */
+static SNode *slPredecessor(BST *bst, SNode *n);
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param key Key of the element (unused)
+ * \param value Value of the element
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool bstAppendValue(void *key, void *value, void *ctx);
+
+// Function definitions
+
+static SNode *snNew(BST *bst, int height) {
+   size_t size = sizeof(SNode) + height * sizeof(SNode *);
+   SNode *n = bst->arena ? arenaAlloc(bst->arena, size) : malloc(size);
+   if (n == NULL) {
+      printf("snNew: allocation error\n");
+      return NULL;
+   }
+   n->key = NULL;
+   n->value = NULL;
+   n->height = height;
+   for (int l = 0; l < height; l++)
+      n->next[l] = NULL;
+   return n;
+}
+
+BST *bstNew(int comparison_fn_t(void *, void *)) {
+   assert(comparison_fn_t != NULL);
+   BST *bst = malloc(sizeof(BST));
+   if (bst == NULL) {
+      printf("bstNew: allocation error\n");
+      return NULL;
+   }
+   bst->arena = NULL;
+   bst->head = snNew(bst, SL_MAX_LEVEL);
+   if (bst->head == NULL) {
+      free(bst);
+      return NULL;
+   }
+   bst->size = 0;
+   bst->seed = 0;
+   bst->compfn = comparison_fn_t;
+   return bst;
+}
+
+BST *bstNewBalanced(int comparison_fn_t(void *, void *)) {
+   // The heights are random: O(log n) expected, whatever the order
+   return bstNew(comparison_fn_t);
+}
+
+void bstSetArena(BST *bst, Arena *arena) {
+   assert(bst != NULL && bst->size == 0);
+   bst->arena = arena;
+}
+
+void bstFree(BST *bst, bool freeKey, bool freeValue) {
+   // The head is always malloc'ed, arena nodes are released with the arena
+   SNode *n = bst->head->next[0];
+   while (n != NULL) {
+      SNode *next = n->next[0];
+      if (freeKey) free(n->key);
+      if (freeValue) free(n->value);
+      if (bst->arena == NULL) free(n);
+      n = next;
+   }
+   free(bst->head);
+   free(bst);
+}
+
+size_t bstSize(BST *bst) { return SL_LOAD(&bst->size); }
+
+static int slRandomHeight(BST *bst) {
+   // splitmix64 on a shared counter: a thread-safe generator
+   uint64_t r = __atomic_add_fetch(&bst->seed, 0x9E3779B97F4A7C15ULL,
+                                   __ATOMIC_RELAXED);
+   r = (r ^ (r >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   r = (r ^ (r >> 27)) * 0x94D049BB133111EBULL;
+   r ^= r >> 31;
+
+   int height = 1;
+   while (height < SL_MAX_LEVEL && (r & 3) == 0) {
+      height++;
+      r >>= 2;
+   }
+   return height;
+}
+
+static SNode *slFindPreds(BST *bst, void *key, bool orEqual, SNode **preds) {
+   SNode *x = bst->head;
+   for (int l = SL_MAX_LEVEL - 1; l >= 0; l--) {
+      SNode *next = SL_LOAD(&x->next[l]);
+      while (next != NULL) {
+         int cmp = key == NULL ? -1 : bst->compfn(next->key, key);
+         if (orEqual ? cmp > 0 : cmp >= 0) break;
+         x = next;
+         next = SL_LOAD(&x->next[l]);
+      }
+      if (preds != NULL) preds[l] = x;
+   }
+   return x;
+}
+
+bool bstInsert(BST *bst, void *key, void *value) {
+   assert(bst != NULL);
+   SNode *new = snNew(bst, slRandomHeight(bst));
+   if (new == NULL) return false;
+   new->key = key;
+   new->value = value;
+
+   // Duplicates go after the equal keys. The node is in the BST once it is
+   // linked at level 0, the upper levels only speed the searches up
+   SNode *preds[SL_MAX_LEVEL];
+   slFindPreds(bst, key, true, preds);
+   for (int l = 0; l < new->height; l++) {
+      while (true) {
+         SNode *succ = SL_LOAD(&preds[l]->next[l]);
+         // Another node may have been linked after the predecessor since
+         // the search: move past it if it is not greater than key
+         if (succ != NULL && bst->compfn(succ->key, key) <= 0) {
+            preds[l] = succ;
+            continue;
+         }
+         SL_STORE(&new->next[l], succ);
+         if (SL_CAS(&preds[l]->next[l], &succ, new)) break;
+      }
+   }
+   __atomic_add_fetch(&bst->size, 1, __ATOMIC_RELEASE);
+   return true;
+}
+
+static SNode *bstLowerBound(BST *bst, void *key) {
+   if (key == NULL) return SL_LOAD(&bst->head->next[0]);
+   return SL_LOAD(&slFindPreds(bst, key, false, NULL)->next[0]);
+}
+
+static SNode *bstUpperBound(BST *bst, void *key) {
+   SNode *n = slFindPreds(bst, key, true, NULL);
+   return n == bst->head ? NULL : n;
+}
+
+static SNode *slPredecessor(BST *bst, SNode *n) {
+   // The last node whose key is < the key of n, then the duplicates of n
+   // that precede it
+   SNode *x = slFindPreds(bst, n->key, false, NULL);
+   SNode *next;
+   while ((next = SL_LOAD(&x->next[0])) != n)
+      x = next;
+   return x == bst->head ? NULL : x;
+}
+
+void *bstSearch(BST *bst, void *key) {
+   assert(bst != NULL);
+   SNode *n = bstLowerBound(bst, key);
+   if (n == NULL || bst->compfn(n->key, key) != 0) return NULL;
+   return n->value;
+}
+
+double bstAverageNodeDepth(BST *bst) {
+   assert(bst != NULL);
+
+   // The depth of a node is the number of links followed by a search for
+   // it from the head, minus one (as the root of a BST, the nodes reached
+   // by a single link have depth 0)
+   double totalDepth = 0.0;
+   size_t nkeys = 0;
+   for (SNode *n = SL_LOAD(&bst->head->next[0]); n != NULL;
+        n = SL_LOAD(&n->next[0])) {
+      size_t links = 0;
+      SNode *x = bst->head;
+      for (int l = SL_MAX_LEVEL - 1; l >= 0; l--) {
+         SNode *next = SL_LOAD(&x->next[l]);
+         while (next != NULL && next != n &&
+                bst->compfn(next->key, n->key) < 0) {
+            x = next;
+            next = SL_LOAD(&x->next[l]);
+            links++;
+         }
+         if (next == n) break;
+      }
+      // Then past the duplicates of n that precede it
+      while (SL_LOAD(&x->next[0]) != n) {
+         x = SL_LOAD(&x->next[0]);
+         links++;
+      }
+      totalDepth += (double)links;
+      nkeys++;
+   }
+
+   return totalDepth / (double)nkeys;
+}
+
+bool bstRangeVisit(BST *bst, void *keymin, void *keymax,
+                   bool visit(void *key, void *value, void *ctx), void *ctx) {
+   assert(bst != NULL && keymin != NULL && keymax != NULL && visit != NULL);
+
+   // Find the first node whose key >= keymin, then follow level 0 until
+   // keymax is exceeded
+   for (SNode *n = bstLowerBound(bst, keymin);
+        n != NULL && bst->compfn(n->key, keymax) <= 0;
+        n = SL_LOAD(&n->next[0])) {
+      if (!visit(n->key, n->value, ctx)) return false;
+   }
+   return true;
+}
+
+static bool bstAppendValue(void *key, void *value, void *ctx) {
+   (void)key;
+   return listInsertLast((List *)ctx, value);
+}
+
+List *bstRangeSearch(BST *bst, void *keymin, void *keymax) {
+   assert(bst != NULL && keymin != NULL && keymax != NULL);
+
+   if (bst->compfn(keymin, keymax) > 0) return NULL;
+
+   List *result = listNew();
+   if (result == NULL) return NULL;
+
+   if (!bstRangeVisit(bst, keymin, keymax, bstAppendValue, result)) {
+      printf("bstRangeSearch: allocation error\n");
+      listFree(result, false);
+      return NULL;
+   }
+   return result;
+}
+
+BSTCursor *bstRangeCursorOpen(BST *bst, void *keyMin, void *keyMax,
+                              bool reverse) {
+   assert(bst != NULL);
+   BSTCursor *cursor = malloc(sizeof(BSTCursor));
+   if (cursor == NULL) {
+      printf("bstRangeCursorOpen: allocation error\n");
+      return NULL;
+   }
+   // The cursor starts at one end of the range; the other end is only
+   // checked when it is reached
+   cursor->bst = bst;
+   cursor->reverse = reverse;
+   cursor->next = reverse ? bstUpperBound(bst, keyMax)
+                          : bstLowerBound(bst, keyMin);
+   cursor->bound = reverse ? keyMin : keyMax;
+   return cursor;
+}
+
+bool bstRangeCursorNext(BSTCursor *cursor, void **key, void **value) {
+   assert(cursor != NULL);
+   SNode *n = cursor->next;
+   if (n == NULL) return false;
+   if (cursor->bound != NULL) {
+      int cmp = cursor->bst->compfn(n->key, cursor->bound);
+      if (cursor->reverse ? cmp < 0 : cmp > 0) {
+         cursor->next = NULL;
+         return false;
+      }
+   }
+   if (key != NULL) *key = n->key;
+   if (value != NULL) *value = n->value;
+   cursor->next = cursor->reverse ? slPredecessor(cursor->bst, n)
+                                  : SL_LOAD(&n->next[0]);
+   return true;
+}
+
+void bstRangeCursorClose(BSTCursor *cursor) { free(cursor); }
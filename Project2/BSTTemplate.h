@@ -0,0 +1,261 @@
+/* ========================================================================= *
+ * BST template
+ *
+ * BST_DEFINE(name, KeyT, ValT, CMP) defines a self-balancing BST (AVL tree)
+ * specialised for keys of type KeyT and values of type ValT. Contrary to
+ * BST.h, keys and values are stored by value in the nodes and the keys are
+ * compared by CMP, which the compiler can inline: a search costs one node
+ * access and no indirect call per level.
+ * ========================================================================= */
+
+#ifndef _BSTTEMPLATE_H_
+#define _BSTTEMPLATE_H_
+
+#include "Arena.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ------------------------------------------------------------------------- *
+ * Defines the type name (an AVL tree) and the following functions, all
+ * static inline, so that BST_DEFINE may be used in several files:
+ *
+ * name *name##New(Arena *arena)
+ *    Creates an empty tree, whose nodes are allocated in arena (which must
+ *    outlive the tree), or with malloc if arena is NULL. Returns NULL in
+ *    case of error.
+ *
+ * void name##Free(name *bst)
+ *    Frees the tree (the keys and values are stored in the nodes).
+ *
+ * size_t name##Size(name *bst)
+ *    Returns the number of elements of the tree.
+ *
+ * bool name##Insert(name *bst, KeyT key, ValT value)
+ *    Inserts a key-value pair (duplicate keys are allowed). Returns false
+ *    in case of allocation error.
+ *
+ * ValT *name##Search(name *bst, KeyT key)
+ *    Returns a pointer to one of the values of the key (stored in the tree),
+ *    or NULL if the key is not in the tree.
+ *
+ * bool name##RangeVisit(name *bst, KeyT keyMin, KeyT keyMax,
+ *                       bool visit(KeyT *key, ValT *value, void *ctx),
+ *                       void *ctx)
+ *    Calls visit on the elements whose key is in [keyMin, keyMax], in the
+ *    increasing order of the keys, until visit returns false. Returns true
+ *    if the whole range was visited.
+ *
+ * PARAMETERS
+ * name         Name of the tree type, used as prefix of the functions
+ * KeyT         Type of the keys
+ * ValT         Type of the values
+ * CMP          Comparison of two keys a and b (of type KeyT): a function or
+ *              a macro CMP(a, b) < 0, = 0 or > 0 if a < b, a == b or a > b
+ *
+ * USAGE
+ * #define DOUBLE_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+ * BST_DEFINE(DoubleTree, double, void *, DOUBLE_CMP)
+ * ...
+ * DoubleTree *t = DoubleTreeNew(NULL);
+ * DoubleTreeInsert(t, 3.5, value);
+ * ------------------------------------------------------------------------- */
+
+#define BST_DEFINE(name, KeyT, ValT, CMP)                                      \
+                                                                               \
+   typedef struct name##Node_t name##Node;                                     \
+                                                                               \
+   struct name##Node_t {                                                       \
+      name##Node *parent;                                                      \
+      name##Node *left;                                                        \
+      name##Node *right;                                                       \
+      int height; /* Height of the subtree (leaf: 1) */                        \
+      KeyT key;                                                                \
+      ValT value;                                                              \
+   };                                                                          \
+                                                                               \
+   typedef struct name##_t {                                                   \
+      name##Node *root;                                                        \
+      size_t size;                                                             \
+      Arena *arena; /* Arena of the nodes, or NULL if they are malloc'ed */    \
+   } name;                                                                     \
+                                                                               \
+   static inline name *name##New(Arena *arena) {                               \
+      name *bst = malloc(sizeof(name));                                        \
+      if (bst == NULL) {                                                       \
+         printf(#name "New: allocation error\n");                              \
+         return NULL;                                                          \
+      }                                                                        \
+      bst->root = NULL;                                                        \
+      bst->size = 0;                                                           \
+      bst->arena = arena;                                                      \
+      return bst;                                                              \
+   }                                                                           \
+                                                                               \
+   static inline void name##Free(name *bst) {                                  \
+      assert(bst != NULL);                                                     \
+      /* Post-order walk along the parent pointers (arena nodes are */        \
+      /* released with the arena) */                                          \
+      name##Node *n = bst->arena == NULL ? bst->root : NULL;                   \
+      while (n != NULL) {                                                      \
+         if (n->left != NULL) {                                                \
+            n = n->left;                                                       \
+         } else if (n->right != NULL) {                                        \
+            n = n->right;                                                      \
+         } else {                                                              \
+            name##Node *parent = n->parent;                                    \
+            if (parent != NULL) {                                              \
+               if (parent->left == n)                                          \
+                  parent->left = NULL;                                         \
+               else                                                            \
+                  parent->right = NULL;                                        \
+            }                                                                  \
+            free(n);                                                           \
+            n = parent;                                                        \
+         }                                                                     \
+      }                                                                        \
+      free(bst);                                                               \
+   }                                                                           \
+                                                                               \
+   static inline size_t name##Size(name *bst) { return bst->size; }            \
+                                                                               \
+   static inline int name##Height(name##Node *n) {                             \
+      return n == NULL ? 0 : n->height;                                        \
+   }                                                                           \
+                                                                               \
+   static inline void name##UpdateHeight(name##Node *n) {                      \
+      int hl = name##Height(n->left);                                          \
+      int hr = name##Height(n->right);                                         \
+      n->height = 1 + (hl > hr ? hl : hr);                                     \
+   }                                                                           \
+                                                                               \
+   static inline void name##Replace(name *bst, name##Node *x,                  \
+                                    name##Node *y) {                           \
+      /* y takes the place of x below the parent of x */                       \
+      y->parent = x->parent;                                                   \
+      if (x->parent == NULL)                                                   \
+         bst->root = y;                                                        \
+      else if (x->parent->left == x)                                           \
+         x->parent->left = y;                                                  \
+      else                                                                     \
+         x->parent->right = y;                                                 \
+   }                                                                           \
+                                                                               \
+   static inline name##Node *name##RotateLeft(name *bst, name##Node *x) {      \
+      name##Node *y = x->right;                                                \
+      x->right = y->left;                                                      \
+      if (y->left != NULL) y->left->parent = x;                                \
+      name##Replace(bst, x, y);                                                \
+      y->left = x;                                                             \
+      x->parent = y;                                                           \
+      name##UpdateHeight(x);                                                   \
+      name##UpdateHeight(y);                                                   \
+      return y;                                                                \
+   }                                                                           \
+                                                                               \
+   static inline name##Node *name##RotateRight(name *bst, name##Node *x) {     \
+      name##Node *y = x->left;                                                 \
+      x->left = y->right;                                                      \
+      if (y->right != NULL) y->right->parent = x;                              \
+      name##Replace(bst, x, y);                                                \
+      y->right = x;                                                            \
+      x->parent = y;                                                           \
+      name##UpdateHeight(x);                                                   \
+      name##UpdateHeight(y);                                                   \
+      return y;                                                                \
+   }                                                                           \
+                                                                               \
+   static inline void name##Rebalance(name *bst, name##Node *n) {              \
+      while (n != NULL) {                                                      \
+         name##UpdateHeight(n);                                                \
+         int balance = name##Height(n->left) - name##Height(n->right);         \
+         if (balance > 1) { /* left-heavy */                                   \
+            if (name##Height(n->left->left) < name##Height(n->left->right))    \
+               name##RotateLeft(bst, n->left);                                 \
+            n = name##RotateRight(bst, n);                                     \
+         } else if (balance < -1) { /* right-heavy */                          \
+            if (name##Height(n->right->right) < name##Height(n->right->left))  \
+               name##RotateRight(bst, n->right);                               \
+            n = name##RotateLeft(bst, n);                                      \
+         }                                                                     \
+         n = n->parent;                                                        \
+      }                                                                        \
+   }                                                                           \
+                                                                               \
+   static inline bool name##Insert(name *bst, KeyT key, ValT value) {          \
+      assert(bst != NULL);                                                     \
+      name##Node *new = bst->arena                                             \
+                            ? arenaAlloc(bst->arena, sizeof(name##Node))       \
+                            : malloc(sizeof(name##Node));                      \
+      if (new == NULL) {                                                       \
+         printf(#name "Insert: allocation error\n");                           \
+         return false;                                                         \
+      }                                                                        \
+      new->left = NULL;                                                        \
+      new->right = NULL;                                                       \
+      new->height = 1;                                                         \
+      new->key = key;                                                          \
+      new->value = value;                                                      \
+                                                                               \
+      /* Duplicates go left, as in BST.c */                                    \
+      name##Node *prev = NULL;                                                 \
+      name##Node **link = &bst->root;                                          \
+      while (*link != NULL) {                                                  \
+         prev = *link;                                                         \
+         link = CMP(key, prev->key) <= 0 ? &prev->left : &prev->right;         \
+      }                                                                        \
+      new->parent = prev;                                                      \
+      *link = new;                                                             \
+      bst->size++;                                                             \
+      name##Rebalance(bst, prev);                                              \
+      return true;                                                             \
+   }                                                                           \
+                                                                               \
+   static inline ValT *name##Search(name *bst, KeyT key) {                     \
+      assert(bst != NULL);                                                     \
+      name##Node *n = bst->root;                                               \
+      while (n != NULL) {                                                      \
+         int cmp = CMP(key, n->key);                                           \
+         if (cmp == 0) return &n->value;                                       \
+         n = cmp < 0 ? n->left : n->right;                                     \
+      }                                                                        \
+      return NULL;                                                             \
+   }                                                                           \
+                                                                               \
+   static inline name##Node *name##Successor(name##Node *n) {                  \
+      if (n->right != NULL) {                                                  \
+         n = n->right;                                                         \
+         while (n->left != NULL)                                               \
+            n = n->left;                                                       \
+         return n;                                                             \
+      }                                                                        \
+      while (n->parent != NULL && n->parent->right == n)                       \
+         n = n->parent;                                                        \
+      return n->parent;                                                        \
+   }                                                                           \
+                                                                               \
+   static inline bool name##RangeVisit(                                        \
+       name *bst, KeyT keyMin, KeyT keyMax,                                    \
+       bool visit(KeyT *key, ValT *value, void *ctx), void *ctx) {             \
+      assert(bst != NULL && visit != NULL);                                    \
+      /* First node whose key >= keyMin, then its successors */               \
+      name##Node *first = NULL;                                                \
+      name##Node *n = bst->root;                                               \
+      while (n != NULL) {                                                      \
+         if (CMP(n->key, keyMin) >= 0) {                                       \
+            first = n;                                                         \
+            n = n->left;                                                       \
+         } else {                                                              \
+            n = n->right;                                                      \
+         }                                                                     \
+      }                                                                        \
+      for (n = first; n != NULL && CMP(n->key, keyMax) <= 0;                   \
+           n = name##Successor(n)) {                                           \
+         if (!visit(&n->key, &n->value, ctx)) return false;                    \
+      }                                                                        \
+      return true;                                                             \
+   }
+
+#endif // !_BSTTEMPLATE_H_
@@ -0,0 +1,84 @@
+/* ========================================================================= *
+ * KnnHeap definition
+ * ========================================================================= */
+
+#include "KnnHeap.h"
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+
+// Prototypes of static functions
+
+static void knnSwap(KnnHeap *heap, size_t i, size_t j);
+
+/**
+ * \brief Move the element i down until the heap property holds again
+ *
+ * \param heap The heap
+ * \param i Index of the element
+ * \param size Number of elements in the heap
+ */
+static void knnSiftDown(KnnHeap *heap, size_t i, size_t size);
+
+// Function definitions
+
+static void knnSwap(KnnHeap *heap, size_t i, size_t j) {
+   void *v = heap->values[i];
+   heap->values[i] = heap->values[j];
+   heap->values[j] = v;
+   double d = heap->dists[i];
+   heap->dists[i] = heap->dists[j];
+   heap->dists[j] = d;
+}
+
+static void knnSiftDown(KnnHeap *heap, size_t i, size_t size) {
+   while (2 * i + 1 < size) {
+      size_t child = 2 * i + 1;
+      if (child + 1 < size && heap->dists[child + 1] > heap->dists[child])
+         child++;
+      if (heap->dists[child] <= heap->dists[i]) return;
+      knnSwap(heap, i, child);
+      i = child;
+   }
+}
+
+void knnInit(KnnHeap *heap, void **values, double *dists, size_t k) {
+   assert(heap != NULL && (k == 0 || (values != NULL && dists != NULL)));
+   heap->values = values;
+   heap->dists = dists;
+   heap->size = 0;
+   heap->k = k;
+}
+
+double knnBound(KnnHeap *heap) {
+   if (heap->size < heap->k) return INFINITY;
+   return heap->k == 0 ? -INFINITY : heap->dists[0];
+}
+
+void knnOffer(KnnHeap *heap, double d2, void *value) {
+   if (heap->size < heap->k) {
+      // Sift up the new element
+      size_t i = heap->size++;
+      heap->values[i] = value;
+      heap->dists[i] = d2;
+      while (i > 0 && heap->dists[(i - 1) / 2] < heap->dists[i]) {
+         knnSwap(heap, i, (i - 1) / 2);
+         i = (i - 1) / 2;
+      }
+   } else if (heap->k > 0 && d2 < heap->dists[0]) {
+      heap->values[0] = value;
+      heap->dists[0] = d2;
+      knnSiftDown(heap, 0, heap->size);
+   }
+}
+
+size_t knnFinish(KnnHeap *heap) {
+   // Heapsort: the farthest value goes to the end at each step
+   for (size_t n = heap->size; n > 1; n--) {
+      knnSwap(heap, 0, n - 1);
+      knnSiftDown(heap, 0, n - 1);
+   }
+   for (size_t i = 0; i < heap->size; i++)
+      heap->dists[i] = sqrt(heap->dists[i]);
+   return heap->size;
+}
@@ -0,0 +1,75 @@
+/* ========================================================================= *
+ * KnnHeap interface
+ * Bounded max-heap keeping the k closest values seen so far during a
+ * k-nearest-neighbour search. The heap lives in the arrays provided by the
+ * caller (no allocation): once the search is over, knnFinish() sorts them
+ * by increasing distance.
+ * ========================================================================= */
+
+#ifndef _KNNHEAP_H_
+#define _KNNHEAP_H_
+
+#include <stddef.h>
+
+/* Structure (not opaque, so that it can live on the stack) */
+typedef struct KnnHeap_t KnnHeap;
+
+struct KnnHeap_t {
+   void **values;  // values[0..size) form a max-heap on dists
+   double *dists;  // Squared distances until knnFinish()
+   size_t size;
+   size_t k;
+};
+
+/* ------------------------------------------------------------------------- *
+ * Initialises an empty heap of capacity k stored in values and dists.
+ *
+ * PARAMETERS
+ * heap         The heap to initialise
+ * values       An array of at least k pointers
+ * dists        An array of at least k doubles
+ * k            The number of neighbours searched
+ * ------------------------------------------------------------------------- */
+
+void knnInit(KnnHeap *heap, void **values, double *dists, size_t k);
+
+/* ------------------------------------------------------------------------- *
+ * Returns the squared distance a candidate must beat to enter the heap.
+ *
+ * PARAMETERS
+ * heap         A valid pointer to an initialised KnnHeap
+ *
+ * RETURN
+ * bound        The largest squared distance in the heap if it is full,
+ *              INFINITY otherwise
+ * ------------------------------------------------------------------------- */
+
+double knnBound(KnnHeap *heap);
+
+/* ------------------------------------------------------------------------- *
+ * Offers a candidate to the heap. It is kept if the heap is not full or if
+ * it is strictly closer than the farthest value of the heap, which is then
+ * dropped.
+ *
+ * PARAMETERS
+ * heap         A valid pointer to an initialised KnnHeap
+ * d2           Squared distance of the candidate to the query
+ * value        The candidate value
+ * ------------------------------------------------------------------------- */
+
+void knnOffer(KnnHeap *heap, double d2, void *value);
+
+/* ------------------------------------------------------------------------- *
+ * Sorts the values of the heap by increasing distance and replaces the
+ * squared distances by the distances. The heap must not be used afterwards.
+ *
+ * PARAMETERS
+ * heap         A valid pointer to an initialised KnnHeap
+ *
+ * RETURN
+ * n            The number of values found (at most k)
+ * ------------------------------------------------------------------------- */
+
+size_t knnFinish(KnnHeap *heap);
+
+#endif // !_KNNHEAP_H_
@@ -3,19 +3,47 @@
  * ========================================================================= */
 
 #include "List.h"
+#include "Arena.h"
 #include <stddef.h>
 #include <stdlib.h>
 
+static LNode *lnNew(List *l, void *value) {
+   LNode *node = l->arena ? arenaAlloc(l->arena, sizeof(LNode))
+                          : malloc(sizeof(LNode));
+   if (!node) return NULL;
+   node->next = NULL;
+   node->value = value;
+   return node;
+}
+
 List *listNew(void) {
    List *l = malloc(sizeof(List));
    if (!l) return NULL;
    l->head = NULL;
    l->last = NULL;
    l->size = 0;
+   l->arena = NULL;
+   return l;
+}
+
+List *listNewInArena(Arena *arena) {
+   List *l = arenaAlloc(arena, sizeof(List));
+   if (!l) return NULL;
+   l->head = NULL;
+   l->last = NULL;
+   l->size = 0;
+   l->arena = arena;
    return l;
 }
 
 void listFree(List *l, bool freeContent) {
+   // Nodes and sentinel of an arena List are released with the arena
+   if (l->arena) {
+      if (freeContent)
+         for (LNode *node = l->head; node != NULL; node = node->next)
+            free(node->value);
+      return;
+   }
    // Free LNodes
    LNode *node = l->head;
    LNode *prev = NULL;
@@ -32,11 +60,8 @@ void listFree(List *l, bool freeContent) {
 size_t listSize(List *l) { return l->size; }
 
 bool listInsertLast(List *l, void *value) {
-   LNode *node = malloc(sizeof(LNode));
+   LNode *node = lnNew(l, value);
    if (!node) return false;
-   // Initialisation
-   node->next = NULL;
-   node->value = value;
    // Adding the node to the list
    if (!l->last) {
       // First element in the list
@@ -53,11 +78,8 @@ bool listInsertLast(List *l, void *value) {
 }
 
 bool listInsertFirst(List *l, void *value) {
-   LNode *node = malloc(sizeof(LNode));
+   LNode *node = lnNew(l, value);
    if (!node) return false;
-   // Initialisation
-   node->next = NULL;
-   node->value = value;
    // Adding the node to the list
    if (!l->head) {
       // First element in the list
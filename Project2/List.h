@@ -7,6 +7,7 @@
 #ifndef _LIST_H_
 #define _LIST_H_
 
+#include "Arena.h"
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -19,6 +20,7 @@ typedef struct list_t {
    size_t size;
    LNode *head;
    LNode *last;
+   Arena *arena; // Arena of the nodes, or NULL if they are malloc'ed
 } List;
 
 /* ------------------------------------------------------------------------- *
@@ -33,6 +35,21 @@ typedef struct list_t {
 
 List *listNew(void);
 
+/* ------------------------------------------------------------------------- *
+ * Creates an empty List whose sentinel and nodes are allocated in the given
+ * arena. They are released by arenaFree(), listFree() only frees the
+ * content (if asked to).
+ *
+ * PARAMETERS
+ * arena   A valid pointer to an Arena object, which must outlive the List
+ *
+ * RETURN
+ * List    A pointer to the List, or NULL in case of error
+ *
+ * ------------------------------------------------------------------------- */
+
+List *listNewInArena(Arena *arena);
+
 /* ------------------------------------------------------------------------- *
  * Frees the allocated memory of the given List.
  *
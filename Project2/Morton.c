@@ -0,0 +1,128 @@
+/* ========================================================================= *
+ * Morton definition
+ * ========================================================================= */
+
+#include "Morton.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Prototypes of static functions
+
+/**
+ * \brief Spread the bits of v so that bit i moves to bit 2i
+ *
+ * \param v The value to spread
+ * \return The spread value
+ */
+static uint64_t mortonSpread(uint32_t v);
+
+/**
+ * \brief Quantise a coordinate of [min, min + extent] on 16 bits
+ *
+ * \param v The coordinate
+ * \param min Lower bound of the coordinates
+ * \param extent Extent of the coordinates (may be 0)
+ * \return The quantised coordinate
+ */
+static uint32_t mortonQuantise(double v, double min, double extent);
+
+// Function definitions
+
+static uint64_t mortonSpread(uint32_t v) {
+   uint64_t x = v;
+   x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+   x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+   x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+   x = (x | (x << 2)) & 0x3333333333333333ULL;
+   x = (x | (x << 1)) & 0x5555555555555555ULL;
+   return x;
+}
+
+uint64_t mortonEncode(uint32_t x, uint32_t y) {
+   return mortonSpread(x) | (mortonSpread(y) << 1);
+}
+
+static uint32_t mortonQuantise(double v, double min, double extent) {
+   if (!(extent > 0)) return 0;
+   double t = (v - min) / extent * 65535.0;
+   return t <= 0 ? 0 : (t >= 65535.0 ? 65535 : (uint32_t)t);
+}
+
+bool mortonSort(uint64_t *codes, size_t *order, size_t n) {
+   assert(n == 0 || (codes != NULL && order != NULL));
+   uint64_t *tmpCodes = malloc(n * sizeof(uint64_t));
+   size_t *tmpOrder = malloc(n * sizeof(size_t));
+   if (n > 0 && (tmpCodes == NULL || tmpOrder == NULL)) {
+      printf("mortonSort: allocation error\n");
+      free(tmpCodes);
+      free(tmpOrder);
+      return false;
+   }
+
+   // LSD radix sort, one byte per pass. The passes on a byte shared by all
+   // the codes (e.g. the high bytes of small codes) are skipped
+   uint64_t *srcCodes = codes, *dstCodes = tmpCodes;
+   size_t *srcOrder = order, *dstOrder = tmpOrder;
+   for (int shift = 0; shift < 64; shift += 8) {
+      size_t count[257] = {0};
+      for (size_t i = 0; i < n; i++)
+         count[((srcCodes[i] >> shift) & 0xFF) + 1]++;
+      if (n == 0 || count[((srcCodes[0] >> shift) & 0xFF) + 1] == n)
+         continue;
+      for (int d = 0; d < 256; d++)
+         count[d + 1] += count[d];
+      for (size_t i = 0; i < n; i++) {
+         size_t pos = count[(srcCodes[i] >> shift) & 0xFF]++;
+         dstCodes[pos] = srcCodes[i];
+         dstOrder[pos] = srcOrder[i];
+      }
+      uint64_t *c = srcCodes;
+      srcCodes = dstCodes;
+      dstCodes = c;
+      size_t *o = srcOrder;
+      srcOrder = dstOrder;
+      dstOrder = o;
+   }
+   if (srcCodes != codes) { // Odd number of passes
+      for (size_t i = 0; i < n; i++) {
+         codes[i] = srcCodes[i];
+         order[i] = srcOrder[i];
+      }
+   }
+
+   free(tmpCodes);
+   free(tmpOrder);
+   return true;
+}
+
+bool mortonOrder(Point **points, size_t n, size_t *order) {
+   assert(points != NULL && (order != NULL || n == 0));
+   if (n == 0) return true;
+
+   double xmin = ptGetx(points[0]), xmax = xmin;
+   double ymin = ptGety(points[0]), ymax = ymin;
+   for (size_t i = 1; i < n; i++) {
+      double x = ptGetx(points[i]), y = ptGety(points[i]);
+      if (x < xmin) xmin = x;
+      if (x > xmax) xmax = x;
+      if (y < ymin) ymin = y;
+      if (y > ymax) ymax = y;
+   }
+
+   uint64_t *codes = malloc(n * sizeof(uint64_t));
+   if (codes == NULL) {
+      printf("mortonOrder: allocation error\n");
+      return false;
+   }
+   for (size_t i = 0; i < n; i++) {
+      uint32_t x = mortonQuantise(ptGetx(points[i]), xmin, xmax - xmin);
+      uint32_t y = mortonQuantise(ptGety(points[i]), ymin, ymax - ymin);
+      codes[i] = mortonEncode(x, y);
+      order[i] = i;
+   }
+   bool ok = mortonSort(codes, order, n);
+   free(codes);
+   return ok;
+}
@@ -0,0 +1,62 @@
+/* ========================================================================= *
+ * Morton interface
+ * Z-order (Morton) curve: the bits of the two quantised coordinates of a
+ * position are interleaved into a single key, so that positions close in
+ * the plane tend to get close keys.
+ * ========================================================================= */
+
+#ifndef _MORTON_H_
+#define _MORTON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Point.h"
+
+/* ------------------------------------------------------------------------- *
+ * Interleaves the bits of x (even bits) and y (odd bits).
+ *
+ * PARAMETERS
+ * x            The quantised x coordinate
+ * y            The quantised y coordinate
+ *
+ * RETURN
+ * code         The Morton code of (x,y)
+ * ------------------------------------------------------------------------- */
+
+uint64_t mortonEncode(uint32_t x, uint32_t y);
+
+/* ------------------------------------------------------------------------- *
+ * Sorts an array of codes in increasing order (radix sort) and applies the
+ * same permutation to a companion array of indices.
+ *
+ * PARAMETERS
+ * codes        An array of n codes
+ * order        An array of n indices (e.g. 0, 1, ..., n-1), moved along
+ *              with the codes
+ * n            The number of codes
+ *
+ * RETURN
+ * res          true on success, false in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+bool mortonSort(uint64_t *codes, size_t *order, size_t n);
+
+/* ------------------------------------------------------------------------- *
+ * Computes the permutation that sorts an array of points along the Morton
+ * curve of their bounding box (16 bits per axis, radix sort).
+ *
+ * PARAMETERS
+ * points       An array of n valid points
+ * n            The number of points
+ * order        An array of n indices, set so that points[order[0]],
+ *              points[order[1]], ... follow the curve
+ *
+ * RETURN
+ * res          true on success, false in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+bool mortonOrder(Point **points, size_t n, size_t *order);
+
+#endif // !_MORTON_H_
@@ -3,6 +3,7 @@
  * ========================================================================= */
 
 #include "Point.h"
+#include "Arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -22,6 +23,17 @@ Point *ptNew(double x, double y) {
    return p;
 }
 
+Point *ptNewInArena(Arena *arena, double x, double y) {
+   Point *p = arenaAlloc(arena, sizeof(Point));
+   if (!p) {
+      printf("ptNewInArena: Allocation of point failed\n");
+      return NULL;
+   }
+   p->x = x;
+   p->y = y;
+   return p;
+}
+
 void ptFree(Point *p) { free(p); }
 
 double ptGetx(Point *p) { return p->x; }
@@ -5,6 +5,8 @@
 #ifndef _POINT_H_
 #define _POINT_H_
 
+#include "Arena.h"
+
 typedef struct Point_t Point;
 
 /* ------------------------------------------------------------------------- *
@@ -21,6 +23,21 @@ typedef struct Point_t Point;
 
 Point *ptNew(double x, double y);
 
+/* ------------------------------------------------------------------------- *
+ * Creates a new point with (x,y) coordinates in the given arena. The Point
+ * is released by arenaFree() and must not be passed to ptFree.
+ *
+ * PARAMETERS
+ * arena       A valid pointer to an Arena object
+ * x           The x coordinate of the point
+ * y           The y coordinate of the point.
+ *
+ * RETURN
+ * p           A pointer to a Point.
+ * ------------------------------------------------------------------------- */
+
+Point *ptNewInArena(Arena *arena, double x, double y);
+
 /* ------------------------------------------------------------------------- *
  * Frees the allocated memory of the given Point.
  *
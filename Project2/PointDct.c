@@ -0,0 +1,322 @@
+/* ========================================================================= *
+ * PointDct operations common to all the implementations, written on top of
+ * pdctBallVisit, pdctBoxVisit and pdctExactSearch
+ * ========================================================================= */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "List.h"
+#include "Morton.h"
+#include "Point.h"
+#include "PointDct.h"
+
+// Number of consecutive queries (along the curve) taken at once by a thread
+#define BATCH_CHUNK 64
+
+// Structures
+
+typedef struct Buffer_t Buffer;
+
+struct Buffer_t {
+   void **values;
+   size_t capacity;
+   size_t size;
+   bool full; // Whether a value did not fit (or could not be stored)
+};
+
+// Batch of queries shared by the threads. Each thread writes its results
+// in its own slots of the result array, so only next is shared
+
+typedef struct Batch_t Batch;
+
+struct Batch_t {
+   PointDct *pd;
+   Point **queries;
+   double *radii;        // NULL for exact searches
+   size_t nq;
+   size_t *order;        // Queries in the order of the Morton curve
+   void **exactResults;  // Results of exact searches
+   List **ballResults;   // Results of ball searches
+   size_t next;          // Next position in order to process
+   bool error;
+   pthread_mutex_t lock; // Protects next and error
+};
+
+// Functions prototypes
+
+/**
+ * \brief Visitor appending the values to a List
+ *
+ * \param value Value in the ball
+ * \param ctx The List
+ * \return false in case of allocation error
+ */
+static bool appendToList(void *value, void *ctx);
+
+/**
+ * \brief Visitor storing the values in a Buffer
+ *
+ * \param value Value in the ball
+ * \param ctx The Buffer
+ * \return false if the buffer is full
+ */
+static bool appendToBuffer(void *value, void *ctx);
+
+/**
+ * \brief Visitor storing the values in a Buffer, enlarged when it is full
+ *
+ * \param value Value in the ball
+ * \param ctx The Buffer (whose values are malloc'ed)
+ * \return false in case of allocation error
+ */
+static bool appendToGrowingBuffer(void *value, void *ctx);
+
+/**
+ * \brief Ball search of a batch: the values are first gathered in the buffer
+ * of the thread, reused from one query to the next, then copied into the
+ * List
+ *
+ * \param pd The PointDct
+ * \param q Center of the ball
+ * \param r Radius of the ball
+ * \param b The buffer of the thread
+ * \return The List of the values, or NULL in case of allocation error
+ */
+static List *batchBallSearch(PointDct *pd, Point *q, double r, Buffer *b);
+
+/**
+ * \brief Thread processing chunks of queries until the batch is done
+ *
+ * \param arg The Batch
+ * \return NULL
+ */
+static void *batchWorker(void *arg);
+
+/**
+ * \brief Order the queries of a batch and process them on nthreads threads
+ * (the calling one included)
+ *
+ * \param batch The Batch, with its order, next, error and lock fields unset
+ * \param nthreads The number of threads, or 0 for the number of processors
+ * \return false in case of error
+ */
+static bool batchRun(Batch *batch, size_t nthreads);
+
+// Functions definitions
+
+static bool appendToList(void *value, void *ctx) {
+   return listInsertLast((List *)ctx, value);
+}
+
+List *pdctBallSearch(PointDct *pd, Point *p, double r) {
+   assert(pd != NULL && p != NULL && r >= 0);
+   List *l = listNew();
+   if (l == NULL) return NULL;
+
+   if (!pdctBallVisit(pd, p, r, appendToList, l)) {
+      printf("pdctBallSearch: allocation error\n");
+      listFree(l, false);
+      return NULL;
+   }
+   return l;
+}
+
+List *pdctBoxSearch(PointDct *pd, double xmin, double ymin, double xmax,
+                    double ymax) {
+   assert(pd != NULL && xmin <= xmax && ymin <= ymax);
+   List *l = listNew();
+   if (l == NULL) return NULL;
+
+   if (!pdctBoxVisit(pd, xmin, ymin, xmax, ymax, appendToList, l)) {
+      printf("pdctBoxSearch: allocation error\n");
+      listFree(l, false);
+      return NULL;
+   }
+   return l;
+}
+
+List *pdctExactSearchAll(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   List *l = listNew();
+   if (l == NULL) return NULL;
+
+   // The box reduced to p: the backends find the duplicates in one descent
+   double x = ptGetx(p), y = ptGety(p);
+   if (!pdctBoxVisit(pd, x, y, x, y, appendToList, l)) {
+      printf("pdctExactSearchAll: allocation error\n");
+      listFree(l, false);
+      return NULL;
+   }
+   return l;
+}
+
+static bool appendToBuffer(void *value, void *ctx) {
+   Buffer *b = ctx;
+   if (b->size == b->capacity) {
+      b->full = true;
+      return false;
+   }
+   b->values[b->size++] = value;
+   return true;
+}
+
+bool pdctBallSearchInto(PointDct *pd, Point *q, double r, void **buf,
+                        size_t cap, size_t *n) {
+   assert(pd != NULL && q != NULL && r >= 0 && n != NULL);
+   assert(buf != NULL || cap == 0);
+   Buffer b = {buf, cap, 0, false};
+   pdctBallVisit(pd, q, r, appendToBuffer, &b);
+   *n = b.size;
+   return !b.full;
+}
+
+static bool appendToGrowingBuffer(void *value, void *ctx) {
+   Buffer *b = ctx;
+   if (b->size == b->capacity) {
+      size_t capacity = b->capacity > 0 ? 2 * b->capacity : 64;
+      void **values = realloc(b->values, capacity * sizeof(void *));
+      if (values == NULL) {
+         b->full = true;
+         return false;
+      }
+      b->values = values;
+      b->capacity = capacity;
+   }
+   b->values[b->size++] = value;
+   return true;
+}
+
+static List *batchBallSearch(PointDct *pd, Point *q, double r, Buffer *b) {
+   // The traversal does not allocate (once the buffer is large enough).
+   // The nodes of the List are still allocated one by one, as listFree()
+   // frees them so, but in a loop of their own.
+   b->size = 0;
+   b->full = false;
+   pdctBallVisit(pd, q, r, appendToGrowingBuffer, b);
+   List *l = b->full ? NULL : listNew();
+   for (size_t i = 0; l != NULL && i < b->size; i++) {
+      if (!listInsertLast(l, b->values[i])) {
+         listFree(l, false);
+         l = NULL;
+      }
+   }
+   if (l == NULL) printf("pdctBallSearchBatch: allocation error\n");
+   return l;
+}
+
+static void *batchWorker(void *arg) {
+   Batch *batch = arg;
+   Buffer buffer = {NULL, 0, 0, false}; // Values of the ball searches
+   for (;;) {
+      pthread_mutex_lock(&batch->lock);
+      size_t start = batch->next;
+      batch->next += BATCH_CHUNK;
+      pthread_mutex_unlock(&batch->lock);
+      if (start >= batch->nq) {
+         free(buffer.values);
+         return NULL;
+      }
+
+      size_t end = start + BATCH_CHUNK < batch->nq ? start + BATCH_CHUNK
+                                                   : batch->nq;
+      for (size_t j = start; j < end; j++) {
+         size_t i = batch->order[j];
+         if (batch->radii == NULL) {
+            batch->exactResults[i] =
+                pdctExactSearch(batch->pd, batch->queries[i]);
+            continue;
+         }
+         batch->ballResults[i] = batchBallSearch(
+             batch->pd, batch->queries[i], batch->radii[i], &buffer);
+         if (batch->ballResults[i] == NULL) {
+            pthread_mutex_lock(&batch->lock);
+            batch->error = true;
+            pthread_mutex_unlock(&batch->lock);
+         }
+      }
+   }
+}
+
+static bool batchRun(Batch *batch, size_t nthreads) {
+   // An empty batch may come without queries (mortonOrder needs them)
+   if (batch->nq == 0) return true;
+   if (nthreads == 0) {
+      long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+      nthreads = nproc > 0 ? (size_t)nproc : 1;
+   }
+   // No use for threads without a chunk to process
+   size_t nchunks = (batch->nq + BATCH_CHUNK - 1) / BATCH_CHUNK;
+   if (nthreads > nchunks) nthreads = nchunks;
+
+   batch->order = malloc(batch->nq * sizeof(size_t));
+   pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+   if (batch->order == NULL || threads == NULL ||
+       !mortonOrder(batch->queries, batch->nq, batch->order)) {
+      printf("batchRun: allocation error\n");
+      free(batch->order);
+      free(threads);
+      return false;
+   }
+   batch->next = 0;
+   batch->error = false;
+   pthread_mutex_init(&batch->lock, NULL);
+
+   // If a thread cannot be created, the others process its share
+   size_t nstarted = 0;
+   while (nstarted + 1 < nthreads &&
+          pthread_create(&threads[nstarted], NULL, batchWorker, batch) == 0)
+      nstarted++;
+   batchWorker(batch);
+   for (size_t t = 0; t < nstarted; t++)
+      pthread_join(threads[t], NULL);
+
+   pthread_mutex_destroy(&batch->lock);
+   free(batch->order);
+   free(threads);
+   return !batch->error;
+}
+
+bool pdctExactSearchBatch(PointDct *pd, Point **queries, size_t nq,
+                          void **results, size_t nthreads) {
+   assert(pd != NULL && (nq == 0 || (queries != NULL && results != NULL)));
+   Batch batch;
+   batch.pd = pd;
+   batch.queries = queries;
+   batch.radii = NULL;
+   batch.nq = nq;
+   batch.exactResults = results;
+   batch.ballResults = NULL;
+   return batchRun(&batch, nthreads);
+}
+
+bool pdctBallSearchBatch(PointDct *pd, Point **queries, double *radii,
+                         size_t nq, List **results, size_t nthreads) {
+   assert(pd != NULL);
+   assert(nq == 0 || (queries != NULL && radii != NULL && results != NULL));
+   for (size_t i = 0; i < nq; i++)
+      results[i] = NULL;
+
+   Batch batch;
+   batch.pd = pd;
+   batch.queries = queries;
+   batch.radii = radii;
+   batch.nq = nq;
+   batch.exactResults = NULL;
+   batch.ballResults = results;
+   if (!batchRun(&batch, nthreads)) {
+      for (size_t i = 0; i < nq; i++) {
+         if (results[i] != NULL) listFree(results[i], false);
+         results[i] = NULL;
+      }
+      return false;
+   }
+   return true;
+}
@@ -7,6 +7,8 @@
 
 #include "List.h"
 #include "Point.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 typedef struct PointDct_t PointDct;
 
@@ -63,6 +65,111 @@ size_t pdctSize(PointDct *pd);
 
 void *pdctExactSearch(PointDct *pd, Point *p);
 
+/* ------------------------------------------------------------------------- *
+ * Returns the values of all the pairs stored at a given position (in no
+ * particular order).
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * p            The position to look for
+ *
+ * RETURN
+ * l            A List containing the values (empty if p is not in pd), or
+ *              NULL in case of allocation error
+ *
+ * NOTES
+ * The List must be freed but not its content.
+ * ------------------------------------------------------------------------- */
+
+List *pdctExactSearchAll(PointDct *pd, Point *p);
+
+/* ------------------------------------------------------------------------- *
+ * Removes a position-value pair from the PointDct. If the pair was stored
+ * several times, only one of its copies is removed. Only the dynamic
+ * implementations (BST2d) support it: the others return false.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * p            The position of the pair
+ * value        The value of the pair
+ *
+ * RETURN
+ * res          true if the pair was removed, false if it is not in pd or if
+ *              the implementation cannot remove pairs
+ * ------------------------------------------------------------------------- */
+
+bool pdctRemove(PointDct *pd, Point *p, void *value);
+
+/* ------------------------------------------------------------------------- *
+ * Moves a position-value pair of the PointDct to a new position. Only the
+ * dynamic implementations (BST2d) support it: the others return false.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * p            The current position of the pair
+ * value        The value of the pair
+ * newp         The new position, which is stored by pointer (like the
+ *              points given to pdctCreate) and is not freed by pdctFree
+ *
+ * RETURN
+ * res          true if the pair was moved, false if it is not in pd, in case
+ *              of allocation error or if the implementation cannot move
+ *              pairs (pd is then unchanged)
+ * ------------------------------------------------------------------------- */
+
+bool pdctMove(PointDct *pd, Point *p, void *value, Point *newp);
+
+/* ------------------------------------------------------------------------- *
+ * Saves the PointDct into a binary snapshot file, which pdctLoadMapped can
+ * map into memory and query at once. The values must point into a block of
+ * memory (e.g. an array of records without pointers), which is copied into
+ * the file: the values are saved as offsets into it. Only the implicit
+ * kd-tree supports it: the others return false.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * path         The name of the file, overwritten if it exists
+ * block        The block holding all the values of pd
+ * blockSize    The size of the block in bytes
+ *
+ * RETURN
+ * res          true if the snapshot was written, false if a value is not in
+ *              the block, in case of I/O error or if the implementation has
+ *              no snapshot
+ *
+ * NOTES
+ * The file is in the byte order of the machine.
+ * ------------------------------------------------------------------------- */
+
+bool pdctSave(PointDct *pd, const char *path, const void *block,
+              size_t blockSize);
+
+/* ------------------------------------------------------------------------- *
+ * Maps a snapshot written by pdctSave into memory. Nothing is parsed nor
+ * copied: the PointDct and its values are read from the file on demand.
+ * Only the implicit kd-tree supports it: the others return NULL.
+ *
+ * The PointDct must later be deleted by calling pdctFree(), which unmaps
+ * the file.
+ *
+ * PARAMETERS
+ * path         The name of the file
+ * block        If not NULL, set to the mapped copy of the block given to
+ *              pdctSave, which the values of the PointDct point into
+ * blockSize    If not NULL, set to the size of the block in bytes
+ *
+ * RETURN
+ * pd           A pointer to the PointDct, or NULL if the file cannot be
+ *              mapped or is not a snapshot of this implementation
+ *
+ * NOTES
+ * The PointDct is read-only (pdctRemove and pdctMove fail) and so is the
+ * block, which is valid until pdctFree.
+ * ------------------------------------------------------------------------- */
+
+PointDct *pdctLoadMapped(const char *path, const void **block,
+                         size_t *blockSize);
+
 /* ------------------------------------------------------------------------- *
  * Finds the set of positions (x,y) in the Point dictionary that are included
  * in a ball of radius r and centered at the position q given as argument.
@@ -85,4 +192,180 @@ void *pdctExactSearch(PointDct *pd, Point *p);
 
 List *pdctBallSearch(PointDct *pd, Point *p, double r);
 
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values associated to the positions (x,y) of the Point
+ * dictionary that are included in a ball of radius r and centered at q (in
+ * no particular order). No memory is allocated. The traversal stops as soon
+ * as visit returns false.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * q            The center of the ball
+ * r            The radius of the ball
+ * visit        Function called with each value and ctx. Returns true to
+ *              continue the traversal, false to stop it.
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the values in the ball were visited, false if
+ *              the traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Same as pdctBallSearch, but stores the values in a buffer provided by the
+ * caller instead of a new list. No memory is allocated.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * q            The center of the ball
+ * r            The radius of the ball
+ * buf          An array of at least cap pointers
+ * cap          The capacity of buf
+ * n            Set to the number of values stored in buf
+ *
+ * RETURN
+ * res          true if all the values in the ball were stored, false if
+ *              buf was too small (its cap first values are then stored)
+ * ------------------------------------------------------------------------- */
+
+bool pdctBallSearchInto(PointDct *pd, Point *q, double r, void **buf,
+                        size_t cap, size_t *n);
+
+/* ------------------------------------------------------------------------- *
+ * Counts the positions (x,y) of the Point dictionary that are included in a
+ * ball of radius r and centered at q. No memory is allocated.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * q            The center of the ball
+ * r            The radius of the ball
+ *
+ * RETURN
+ * count        The number of positions in the ball (i.e. the size of the
+ *              list returned by pdctBallSearch)
+ * ------------------------------------------------------------------------- */
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r);
+
+/* ------------------------------------------------------------------------- *
+ * Finds the positions (x,y) of the Point dictionary that are included in the
+ * axis-aligned box [xmin, xmax] x [ymin, ymax] (bounds included) and
+ * returns a list of their values (in no particular order).
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * xmin         Lower bound of the box along x
+ * ymin         Lower bound of the box along y
+ * xmax         Upper bound of the box along x (xmax >= xmin)
+ * ymax         Upper bound of the box along y (ymax >= ymin)
+ *
+ * RETURN
+ * l            A list containing the values in the given box, or NULL
+ *              in case of allocation error.
+ *
+ * NOTES
+ * The List must be freed but not its content. If no elements are in the
+ * box, the function returns an empty list.
+ * ------------------------------------------------------------------------- */
+
+List *pdctBoxSearch(PointDct *pd, double xmin, double ymin, double xmax,
+                    double ymax);
+
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values of the positions of the Point dictionary that
+ * are included in the box [xmin, xmax] x [ymin, ymax] (in no particular
+ * order), without allocating any memory. The traversal stops as soon as
+ * visit returns false.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * xmin         Lower bound of the box along x
+ * ymin         Lower bound of the box along y
+ * xmax         Upper bound of the box along x (xmax >= xmin)
+ * ymax         Upper bound of the box along y (ymax >= ymin)
+ * visit        Function called with each value and ctx. Returns true to
+ *              continue, false to stop.
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the values in the box were visited, false if the
+ *              traversal was stopped by visit
+ * ------------------------------------------------------------------------- */
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Finds the k positions of the Point dictionary that are the closest to q.
+ * The values associated to these positions are stored in values, and their
+ * distances to q in dists, by increasing distance. No memory is allocated.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object
+ * q            The query position
+ * k            The number of neighbours searched
+ * values       An array of at least k pointers
+ * dists        An array of at least k doubles
+ *
+ * RETURN
+ * n            The number of neighbours found: k, or the size of the
+ *              dictionary if it is smaller
+ *
+ * NOTES
+ * Among positions at the same distance, which ones are kept is unspecified.
+ * ------------------------------------------------------------------------- */
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists);
+
+/* ------------------------------------------------------------------------- *
+ * Performs the exact searches of nq positions at once, on several threads.
+ * The queries are processed along a space-filling (Morton) curve, so that
+ * consecutive queries of a thread touch the same parts of the dictionary.
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object, not modified during
+ *              the call
+ * queries      An array of nq positions
+ * nq           The number of queries
+ * results      An array of nq pointers, results[i] is set to the value of
+ *              queries[i] (as returned by pdctExactSearch)
+ * nthreads     The number of threads, or 0 for the number of processors
+ *
+ * RETURN
+ * res          true on success, false in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+bool pdctExactSearchBatch(PointDct *pd, Point **queries, size_t nq,
+                          void **results, size_t nthreads);
+
+/* ------------------------------------------------------------------------- *
+ * Performs the ball searches of nq balls at once, on several threads (see
+ * pdctExactSearchBatch).
+ *
+ * PARAMETERS
+ * pd           A valid pointer to a PointDct object, not modified during
+ *              the call
+ * queries      An array of nq centers
+ * radii        An array of nq radii
+ * nq           The number of queries
+ * results      An array of nq pointers, results[i] is set to the list of
+ *              the values in the ball of center queries[i] and of radius
+ *              radii[i] (as returned by pdctBallSearch)
+ * nthreads     The number of threads, or 0 for the number of processors
+ *
+ * RETURN
+ * res          true on success, false in case of allocation error (then
+ *              no list is left allocated)
+ *
+ * NOTES
+ * The lists must be freed but not their content.
+ * ------------------------------------------------------------------------- */
+
+bool pdctBallSearchBatch(PointDct *pd, Point **queries, double *radii,
+                         size_t nq, List **results, size_t nthreads);
+
 #endif // __POINTDCT___
@@ -10,56 +10,70 @@
  * ========================================================================= */
 
 #include <assert.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "Arena.h"
 #include "BST.h"
 #include "List.h"
 #include "Point.h"
 #include "PointDct.h"
+#include "PointHash.h"
+#include "PointKey.h"
 
-// Strucures
-
-typedef struct Tuple_t Tuple;
-
-struct Tuple_t {
-   void *key;
-   void *value;
-};
+// Structures
 
+// Keys of the BST are PointKey (see PointKey.h): a copy of the coordinates
+// of the points, so that the comparisons do not go through the Point
+// objects and so that the bounds of a range search can live on the stack
 struct PointDct_t {
    BST *t;
+   Arena *arena;    // Nodes and keys of t
+   PointHash *hash; // Positions to values, for the exact searches
 };
 
 // Functions prototypes
 
-static int pointCompare(void *p1, void *p2);
+/**
+ * \brief Range visit of the BST of a PointDct, for PointKey.h
+ *
+ * \param set The BST
+ * \param keyMin Lower bound of the range (a PointKey)
+ * \param keyMax Upper bound of the range (a PointKey)
+ * \param visit Visitor of the keys and values in the range
+ * \param ctx Context of the visitor
+ * \return true if the whole range was visited
+ */
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx);
 
 // Functions definitions
 
-static int pointCompare(void *p1, void *p2) {
-   Point *point1 = (Point *)p1;
-   Point *point2 = (Point *)p2;
-   return ptCompare(point1, point2);
-}
-
 PointDct *pdctCreate(List *lpoints, List *Lvalues) {
    assert(lpoints != NULL && Lvalues != NULL);
    assert(listSize(lpoints) == listSize(Lvalues));
 
    // Creating BST and PointDct
-   BST *t = bstNew(&pointCompare);
+   BST *t = bstNewBalanced(&pkCompare);
    if (t == NULL) {
       return NULL;
    }
 
    PointDct *pd = malloc(sizeof(PointDct));
-   if (pd == NULL) {
+   Arena *arena = arenaNew(0);
+   PointHash *hash = phNew(listSize(lpoints));
+   if (pd == NULL || arena == NULL || hash == NULL) {
       bstFree(t, false, false);
+      free(pd);
+      if (arena != NULL) arenaFree(arena);
+      if (hash != NULL) phFree(hash);
       return NULL;
    }
+   bstSetArena(t, arena);
    pd->t = t;
+   pd->arena = arena;
+   pd->hash = hash;
 
    // Inserting points and values in BST
 
@@ -67,17 +81,17 @@ PointDct *pdctCreate(List *lpoints, List *Lvalues) {
    LNode *pv = Lvalues->head;
 
    while (pp != NULL) {
-      Tuple *tuple = malloc(sizeof(Tuple));
-      if (tuple == NULL) {
-         bstFree(t, false, true);
+      PointKey *key = arenaAlloc(arena, sizeof(PointKey));
+      if (key == NULL) {
          pdctFree(pd);
          return NULL;
       }
 
-      tuple->key = pp->value;
-      tuple->value = pv->value;
-      if (!bstInsert(t, pp->value, tuple)) {
-         bstFree(t, false, true);
+      key->x = ptGetx(pp->value);
+      key->y = ptGety(pp->value);
+      if (!bstInsert(t, key, pv->value) ||
+          !phInsert(hash, key->x, key->y, pv->value)) {
+         pdctFree(pd);
          return NULL;
       }
 
@@ -90,7 +104,10 @@ PointDct *pdctCreate(List *lpoints, List *Lvalues) {
 
 void pdctFree(PointDct *pd) {
    assert(pd != NULL);
-   bstFree(pd->t, false, true);
+   // Nodes and keys are released at once with the arena
+   bstFree(pd->t, false, false);
+   arenaFree(pd->arena);
+   phFree(pd->hash);
    free(pd);
 }
 
@@ -101,70 +118,34 @@ size_t pdctSize(PointDct *pd) {
 
 void *pdctExactSearch(PointDct *pd, Point *p) {
    assert(pd != NULL && p != NULL);
-
-   Tuple *tuple = bstSearch(pd->t, p);
-
-   if (tuple == NULL) {
-      return NULL;
-   }
-
-   return tuple->value;
+   return phSearch(pd->hash, ptGetx(p), ptGety(p));
 }
 
-List *pdctBallSearch(PointDct *pd, Point *p, double r) {
-   assert(pd != NULL && p != NULL && r >= 0);
-   if (pd->t == NULL) {
-      return NULL;
-   }
-
-   List *pre_result;
-
-   Point *minPoint = ptNew(ptGetx(p) - r, ptGety(p) - r);
-   if (minPoint == NULL) {
-      return NULL;
-   }
-
-   Point *maxPoint = ptNew(ptGetx(p) + r, ptGety(p) + r);
-   if (minPoint == NULL) {
-      ptFree(minPoint);
-      return NULL;
-   }
-
-   // First we get the list of points between p-r and p+r (using ptCompare)
-   pre_result = bstRangeSearch(pd->t, minPoint, maxPoint);
-
-   // Then we remove the points that are not in the circle
-   List *result = listNew();
-   if (result == NULL) {
-      listFree(pre_result, false);
-      ptFree(minPoint);
-      ptFree(maxPoint);
-      return NULL;
-   }
-
-   double r2 = r * r;
-   LNode *current = pre_result->head;
-
-   bool error = false;
-   while (current != NULL) {
-      Tuple *t = (Tuple *)current->value;
-      Point *currentPoint = (Point *)t->key;
-
-      if (ptSqrDistance(p, currentPoint) <= r2) {
-         error = error || !listInsertLast(result, t->value);
-      }
-      current = current->next;
-   }
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx) {
+   return bstRangeVisit((BST *)set, keyMin, keyMax, visit, ctx);
+}
 
-   listFree(pre_result, false);
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBallVisit(rangeVisit, pd->t, q, r, visit, ctx);
+}
 
-   ptFree(minPoint);
-   ptFree(maxPoint);
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL);
+   return pkBallCount(rangeVisit, pd->t, q, r);
+}
 
-   if (error) {
-      listFree(result, false);
-      return NULL;
-   }
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBoxVisit(rangeVisit, pd->t, xmin, ymin, xmax, ymax, visit, ctx);
+}
 
-   return result;
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL);
+   return pkKnn(rangeVisit, pd->t, q, k, values, dists);
 }
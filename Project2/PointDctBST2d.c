@@ -17,11 +17,13 @@
 #include "List.h"
 #include "Point.h"
 #include "PointDct.h"
+#include "PointHash.h"
 
 // Structures
 
 struct PointDct_t {
    BST2d *t;
+   PointHash *hash; // Positions to values, for the exact searches
 };
 
 // Functions definitions
@@ -30,27 +32,52 @@ PointDct *pdctCreate(List *lpoints, List *Lvalues) {
    assert(lpoints != NULL && Lvalues != NULL);
    assert(listSize(lpoints) == listSize(Lvalues));
 
-   BST2d *t = bst2dNew();
-   if (t == NULL) {
+   PointDct *pd = malloc(sizeof(PointDct));
+   if (pd == NULL) {
       return NULL;
    }
 
-   PointDct *pd = malloc(sizeof(PointDct));
-   if (pd == NULL) {
-      bst2dFree(t, false, false);
+   // All the points are known: bulk-build a balanced tree from arrays
+   size_t n = listSize(lpoints);
+   Point **points = malloc(n * sizeof(Point *));
+   void **values = malloc(n * sizeof(void *));
+   if (points == NULL || values == NULL) {
+      free(points);
+      free(values);
+      free(pd);
+      return NULL;
+   }
+
+   pd->hash = phNew(n);
+   if (pd->hash == NULL) {
+      free(points);
+      free(values);
+      free(pd);
       return NULL;
    }
-   pd->t = t;
 
-   LNode *pp = lpoints->head;
-   LNode *pv = Lvalues->head;
-   while (pp != NULL) {
-      if (!bst2dInsert(t, pp->value, pv->value)) {
-         bst2dFree(t, false, false);
+   size_t i = 0;
+   for (LNode *pp = lpoints->head, *pv = Lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next, i++) {
+      points[i] = pp->value;
+      values[i] = pv->value;
+      if (!phInsert(pd->hash, ptGetx(pp->value), ptGety(pp->value),
+                    pv->value)) {
+         free(points);
+         free(values);
+         phFree(pd->hash);
+         free(pd);
          return NULL;
       }
-      pp = pp->next;
-      pv = pv->next;
+   }
+
+   pd->t = bst2dBuildParallel(points, values, n, 0);
+   free(points);
+   free(values);
+   if (pd->t == NULL) {
+      phFree(pd->hash);
+      free(pd);
+      return NULL;
    }
 
    return pd;
@@ -58,6 +85,7 @@ PointDct *pdctCreate(List *lpoints, List *Lvalues) {
 
 void pdctFree(PointDct *pd) {
    bst2dFree(pd->t, false, false);
+   phFree(pd->hash);
    free(pd);
 }
 
@@ -67,11 +95,51 @@ size_t pdctSize(PointDct *pd) {
 }
 
 void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   return phSearch(pd->hash, ptGetx(p), ptGety(p));
+}
+
+bool pdctRemove(PointDct *pd, Point *p, void *value) {
+   assert(pd != NULL && p != NULL);
+   if (!bst2dDelete(pd->t, p, value)) return false;
+   // The hash keeps one value per position: the first one left in the tree
+   phRemove(pd->hash, ptGetx(p), ptGety(p), bst2dSearch(pd->t, p));
+   return true;
+}
+
+bool pdctMove(PointDct *pd, Point *p, void *value, Point *newp) {
+   assert(pd != NULL && p != NULL && newp != NULL);
+   // The new position is hashed first, as it is the only step that may
+   // fail once the pair is known to be in the tree
+   if (!phInsert(pd->hash, ptGetx(newp), ptGety(newp), value)) return false;
+   if (!bst2dUpdate(pd->t, p, value, newp)) {
+      phRemove(pd->hash, ptGetx(newp), ptGety(newp),
+               bst2dSearch(pd->t, newp));
+      return false;
+   }
+   phRemove(pd->hash, ptGetx(p), ptGety(p), bst2dSearch(pd->t, p));
+   return true;
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return bst2dBallVisit(pd->t, q, r, visit, ctx);
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL);
+   return bst2dBallCount(pd->t, q, r);
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
    assert(pd != NULL);
-   return bst2dSearch(pd->t, p);
+   return bst2dBoxVisit(pd->t, xmin, ymin, xmax, ymax, visit, ctx);
 }
 
-List *pdctBallSearch(PointDct *pd, Point *p, double r) {
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
    assert(pd != NULL);
-   return bst2dBallSearch(pd->t, p, r);
+   return bst2dKnn(pd->t, q, k, values, dists);
 }
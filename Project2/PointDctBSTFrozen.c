@@ -0,0 +1,144 @@
+/* ========================================================================= *
+ * PointDct definition (with a frozen BST)
+ *
+ * Same order as the BST implementation, but the BST is only used to sort
+ * the points: it is then frozen into an array in Eytzinger order (see
+ * BSTFrozen.h) and freed, and all the searches go through the array.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Arena.h"
+#include "BST.h"
+#include "BSTFrozen.h"
+#include "List.h"
+#include "Point.h"
+#include "PointDct.h"
+#include "PointKey.h"
+
+// Structures
+
+// Keys of the BST are PointKey (see PointKey.h)
+struct PointDct_t {
+   FrozenBST *f;
+   Arena *arena; // Keys of f
+};
+
+// Functions prototypes
+
+/**
+ * \brief Range visit of the FrozenBST of a PointDct, for PointKey.h
+ *
+ * \param set The FrozenBST
+ * \param keyMin Lower bound of the range (a PointKey)
+ * \param keyMax Upper bound of the range (a PointKey)
+ * \param visit Visitor of the keys and values in the range
+ * \param ctx Context of the visitor
+ * \return true if the whole range was visited
+ */
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx);
+
+// Functions definitions
+
+PointDct *pdctCreate(List *lpoints, List *Lvalues) {
+   assert(lpoints != NULL && Lvalues != NULL);
+   assert(listSize(lpoints) == listSize(Lvalues));
+
+   // The nodes of the BST only live until it is frozen
+   BST *t = bstNewBalanced(&pkCompare);
+   Arena *nodes = arenaNew(0);
+   PointDct *pd = malloc(sizeof(PointDct));
+   Arena *arena = arenaNew(0);
+   if (t == NULL || nodes == NULL || pd == NULL || arena == NULL) {
+      if (t != NULL) bstFree(t, false, false);
+      if (nodes != NULL) arenaFree(nodes);
+      free(pd);
+      if (arena != NULL) arenaFree(arena);
+      return NULL;
+   }
+   bstSetArena(t, nodes);
+   pd->arena = arena;
+
+   // Inserting points and values in BST
+
+   LNode *pp = lpoints->head;
+   LNode *pv = Lvalues->head;
+   bool error = false;
+
+   while (pp != NULL && !error) {
+      PointKey *key = arenaAlloc(arena, sizeof(PointKey));
+      if (key == NULL) {
+         error = true;
+         break;
+      }
+
+      key->x = ptGetx(pp->value);
+      key->y = ptGety(pp->value);
+      error = !bstInsert(t, key, pv->value);
+
+      pp = pp->next;
+      pv = pv->next;
+   }
+
+   pd->f = error ? NULL : bstFreeze(t, &pkCompare);
+   bstFree(t, false, false);
+   arenaFree(nodes);
+   if (pd->f == NULL) {
+      arenaFree(arena);
+      free(pd);
+      return NULL;
+   }
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   // Keys are released at once with the arena
+   fbstFree(pd->f, false, false);
+   arenaFree(pd->arena);
+   free(pd);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return fbstSize(pd->f);
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   PointKey key = {ptGetx(p), ptGety(p)};
+   return fbstSearch(pd->f, &key);
+}
+
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx) {
+   return fbstRangeVisit((FrozenBST *)set, keyMin, keyMax, visit, ctx);
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBallVisit(rangeVisit, pd->f, q, r, visit, ctx);
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL);
+   return pkBallCount(rangeVisit, pd->f, q, r);
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBoxVisit(rangeVisit, pd->f, xmin, ymin, xmax, ymax, visit, ctx);
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL);
+   return pkKnn(rangeVisit, pd->f, q, k, values, dists);
+}
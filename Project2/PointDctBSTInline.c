@@ -0,0 +1,153 @@
+/* ========================================================================= *
+ * PointDct definition (with a BST specialised by BSTTemplate.h)
+ *
+ * Same algorithms as PointDctBST.c (see PointKey.h), but the keys (the
+ * coordinates) and the values are stored in the nodes and compared without
+ * indirect calls.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Arena.h"
+#include "BSTTemplate.h"
+#include "List.h"
+#include "Point.h"
+#include "PointDct.h"
+#include "PointKey.h"
+
+// Structures
+
+// Same order as ptCompare (see pkCompare())
+#define KEY_COMPARE(k1, k2)                                                    \
+   ((k1).x != (k2).x ? ((k1).x < (k2).x ? -1 : +1)                             \
+                     : ((k1).y != (k2).y ? ((k1).y < (k2).y ? -1 : +1) : 0))
+
+BST_DEFINE(PointTree, PointKey, void *, KEY_COMPARE)
+
+struct PointDct_t {
+   PointTree *t;
+   Arena *arena; // Nodes of t
+};
+
+// Visitor of PointKey.h called from the typed visits of PointTree
+
+typedef struct Forward_t Forward;
+
+struct Forward_t {
+   bool (*visit)(void *key, void *value, void *ctx);
+   void *ctx;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Visitor of the PointTree range search forwarding the elements to
+ * the untyped visitor of PointKey.h
+ *
+ * \param key Key of the element
+ * \param value Value of the element (stored in the node)
+ * \param ctx The Forward
+ * \return false if the forwarded visitor stopped
+ */
+static bool forwardKey(PointKey *key, void **value, void *ctx);
+
+/**
+ * \brief Range visit of the PointTree of a PointDct, for PointKey.h
+ *
+ * \param set The PointTree
+ * \param keyMin Lower bound of the range (a PointKey)
+ * \param keyMax Upper bound of the range (a PointKey)
+ * \param visit Visitor of the keys and values in the range
+ * \param ctx Context of the visitor
+ * \return true if the whole range was visited
+ */
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx);
+
+// Functions definitions
+
+PointDct *pdctCreate(List *lpoints, List *Lvalues) {
+   assert(lpoints != NULL && Lvalues != NULL);
+   assert(listSize(lpoints) == listSize(Lvalues));
+
+   PointDct *pd = malloc(sizeof(PointDct));
+   Arena *arena = arenaNew(0);
+   PointTree *t = arena ? PointTreeNew(arena) : NULL;
+   if (pd == NULL || t == NULL) {
+      printf("pdctCreate: allocation error\n");
+      free(pd);
+      if (arena != NULL) arenaFree(arena);
+      return NULL;
+   }
+   pd->t = t;
+   pd->arena = arena;
+
+   for (LNode *pp = lpoints->head, *pv = Lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next) {
+      PointKey key = {ptGetx(pp->value), ptGety(pp->value)};
+      if (!PointTreeInsert(t, key, pv->value)) {
+         pdctFree(pd);
+         return NULL;
+      }
+   }
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   // Nodes are released at once with the arena
+   PointTreeFree(pd->t);
+   arenaFree(pd->arena);
+   free(pd);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return PointTreeSize(pd->t);
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   PointKey key = {ptGetx(p), ptGety(p)};
+   void **value = PointTreeSearch(pd->t, key);
+   return value ? *value : NULL;
+}
+
+static bool forwardKey(PointKey *key, void **value, void *ctx) {
+   Forward *forward = (Forward *)ctx;
+   return forward->visit(key, *value, forward->ctx);
+}
+
+static bool rangeVisit(void *set, void *keyMin, void *keyMax,
+                       bool visit(void *key, void *value, void *ctx),
+                       void *ctx) {
+   Forward forward = {visit, ctx};
+   return PointTreeRangeVisit((PointTree *)set, *(PointKey *)keyMin,
+                              *(PointKey *)keyMax, forwardKey, &forward);
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBallVisit(rangeVisit, pd->t, q, r, visit, ctx);
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL);
+   return pkBallCount(rangeVisit, pd->t, q, r);
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL);
+   return pkBoxVisit(rangeVisit, pd->t, xmin, ymin, xmax, ymax, visit, ctx);
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL);
+   return pkKnn(rangeVisit, pd->t, q, k, values, dists);
+}
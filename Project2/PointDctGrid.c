@@ -0,0 +1,312 @@
+/* ========================================================================= *
+ * PointDct definition (with a uniform grid)
+ *
+ * Static dictionary. The bounding box of the positions is cut into square
+ * cells, sized so that a cell holds about GRID_DENSITY positions. The cells
+ * are stored in CSR layout: the positions of cell c (in row-major order)
+ * are x[offsets[c]..offsets[c+1]), y[...] and values[...], so that the
+ * cells of a row are contiguous and a ball search scans one range of the
+ * arrays per row.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "KnnHeap.h"
+#include "List.h"
+#include "Point.h"
+#include "PointDct.h"
+
+// Average number of positions per cell
+#define GRID_DENSITY 2.0
+
+// Structures
+
+struct PointDct_t {
+   size_t size;
+   double xmin;     // Lower left corner of the grid
+   double ymin;
+   double cellSize; // Side of a cell
+   size_t nx;       // Number of columns
+   size_t ny;       // Number of rows
+   size_t *offsets; // nx * ny + 1 offsets in the arrays below
+   double *x;
+   double *y;
+   void **values;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Column (or row) of the cell containing a coordinate, clamped to
+ * the grid
+ *
+ * \param v The coordinate
+ * \param min Lower bound of the grid along the axis
+ * \param cellSize Side of a cell
+ * \param n Number of columns (or rows)
+ * \return The column (or row), in [0, n)
+ */
+static size_t gridCell(double v, double min, double cellSize, size_t n);
+
+/**
+ * \brief Offer the positions of the cells [cx0..cx1] of row cy to the heap
+ * of the k nearest neighbours
+ *
+ * \param pd The dictionary
+ * \param cy The row
+ * \param cx0 First column
+ * \param cx1 Last column
+ * \param qx x coordinate of the query
+ * \param qy y coordinate of the query
+ * \param heap The current k nearest neighbours
+ */
+static void gridOfferRow(PointDct *pd, size_t cy, size_t cx0, size_t cx1,
+                         double qx, double qy, KnnHeap *heap);
+
+// Functions definitions
+
+static size_t gridCell(double v, double min, double cellSize, size_t n) {
+   double c = floor((v - min) / cellSize);
+   if (!(c > 0)) return 0; // (also if NaN)
+   if (c >= (double)n) return n - 1;
+   return (size_t)c;
+}
+
+PointDct *pdctCreate(List *lpoints, List *lvalues) {
+   assert(lpoints != NULL && lvalues != NULL);
+   assert(listSize(lpoints) == listSize(lvalues));
+
+   size_t n = listSize(lpoints);
+   PointDct *pd = calloc(1, sizeof(PointDct));
+   if (pd == NULL) {
+      printf("pdctCreate: allocation error\n");
+      return NULL;
+   }
+   pd->size = n;
+
+   // Bounding box of the positions
+   double xmin = INFINITY, xmax = -INFINITY;
+   double ymin = INFINITY, ymax = -INFINITY;
+   for (LNode *pp = lpoints->head; pp != NULL; pp = pp->next) {
+      double x = ptGetx(pp->value), y = ptGety(pp->value);
+      if (x < xmin) xmin = x;
+      if (x > xmax) xmax = x;
+      if (y < ymin) ymin = y;
+      if (y > ymax) ymax = y;
+   }
+   if (n == 0) xmin = xmax = ymin = ymax = 0;
+
+   // Square cells holding GRID_DENSITY positions on average. A box
+   // flatter than a cell gets a single row (or column) of cells instead
+   double width = xmax - xmin, height = ymax - ymin;
+   double ncells = (double)n / GRID_DENSITY;
+   double cellSize = sqrt(width * height / ncells);
+   if (!(cellSize > 0) || cellSize > width || cellSize > height)
+      cellSize = (width > height ? width : height) / ncells;
+   if (!(cellSize > 0)) cellSize = 1.0; // (single position)
+   double nx = floor(width / cellSize) + 1;
+   double ny = floor(height / cellSize) + 1;
+
+   pd->xmin = xmin;
+   pd->ymin = ymin;
+   pd->cellSize = cellSize;
+   pd->nx = (size_t)nx;
+   pd->ny = (size_t)ny;
+   // (both are at least 1)
+
+   size_t nc = pd->nx * pd->ny;
+   pd->offsets = calloc(nc + 1, sizeof(size_t));
+   pd->x = malloc(n * sizeof(double));
+   pd->y = malloc(n * sizeof(double));
+   pd->values = malloc(n * sizeof(void *));
+   size_t *cells = malloc(n * sizeof(size_t));
+   if (pd->offsets == NULL ||
+       (n > 0 && (!pd->x || !pd->y || !pd->values || !cells))) {
+      printf("pdctCreate: allocation error\n");
+      free(cells);
+      pdctFree(pd);
+      return NULL;
+   }
+
+   // Counting sort of the positions by cell
+   size_t i = 0;
+   for (LNode *pp = lpoints->head; pp != NULL; pp = pp->next, i++) {
+      size_t cx = gridCell(ptGetx(pp->value), xmin, cellSize, pd->nx);
+      size_t cy = gridCell(ptGety(pp->value), ymin, cellSize, pd->ny);
+      cells[i] = cy * pd->nx + cx;
+      pd->offsets[cells[i] + 1]++;
+   }
+   for (size_t c = 0; c < nc; c++)
+      pd->offsets[c + 1] += pd->offsets[c];
+
+   i = 0;
+   for (LNode *pp = lpoints->head, *pv = lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next, i++) {
+      size_t pos = pd->offsets[cells[i]]++;
+      pd->x[pos] = ptGetx(pp->value);
+      pd->y[pos] = ptGety(pp->value);
+      pd->values[pos] = pv->value;
+   }
+   // The offsets were moved to the end of their cell: shift them back
+   for (size_t c = nc; c > 0; c--)
+      pd->offsets[c] = pd->offsets[c - 1];
+   pd->offsets[0] = 0;
+   free(cells);
+
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   free(pd->offsets);
+   free(pd->x);
+   free(pd->y);
+   free(pd->values);
+   free(pd);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return pd->size;
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   double x = ptGetx(p), y = ptGety(p);
+
+   size_t c = gridCell(y, pd->ymin, pd->cellSize, pd->ny) * pd->nx +
+              gridCell(x, pd->xmin, pd->cellSize, pd->nx);
+   for (size_t i = pd->offsets[c]; i < pd->offsets[c + 1]; i++) {
+      if (pd->x[i] == x && pd->y[i] == y) return pd->values[i];
+   }
+   return NULL;
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && q != NULL && r >= 0 && visit != NULL);
+   double qx = ptGetx(q), qy = ptGety(q);
+   double r2 = r * r;
+
+   size_t cx0 = gridCell(qx - r, pd->xmin, pd->cellSize, pd->nx);
+   size_t cx1 = gridCell(qx + r, pd->xmin, pd->cellSize, pd->nx);
+   size_t cy0 = gridCell(qy - r, pd->ymin, pd->cellSize, pd->ny);
+   size_t cy1 = gridCell(qy + r, pd->ymin, pd->cellSize, pd->ny);
+
+   // The cells [cx0..cx1] of a row are contiguous in the arrays
+   for (size_t cy = cy0; cy <= cy1; cy++) {
+      size_t end = pd->offsets[cy * pd->nx + cx1 + 1];
+      for (size_t i = pd->offsets[cy * pd->nx + cx0]; i < end; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         if (dx * dx + dy * dy <= r2 && !visit(pd->values[i], ctx))
+            return false;
+      }
+   }
+   return true;
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL && q != NULL && r >= 0);
+   double qx = ptGetx(q), qy = ptGety(q);
+   double r2 = r * r;
+
+   size_t cx0 = gridCell(qx - r, pd->xmin, pd->cellSize, pd->nx);
+   size_t cx1 = gridCell(qx + r, pd->xmin, pd->cellSize, pd->nx);
+   size_t cy0 = gridCell(qy - r, pd->ymin, pd->cellSize, pd->ny);
+   size_t cy1 = gridCell(qy + r, pd->ymin, pd->cellSize, pd->ny);
+
+   size_t count = 0;
+   for (size_t cy = cy0; cy <= cy1; cy++) {
+      size_t end = pd->offsets[cy * pd->nx + cx1 + 1];
+      for (size_t i = pd->offsets[cy * pd->nx + cx0]; i < end; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         count += dx * dx + dy * dy <= r2;
+      }
+   }
+   return count;
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+   size_t cx0 = gridCell(xmin, pd->xmin, pd->cellSize, pd->nx);
+   size_t cx1 = gridCell(xmax, pd->xmin, pd->cellSize, pd->nx);
+   size_t cy0 = gridCell(ymin, pd->ymin, pd->cellSize, pd->ny);
+   size_t cy1 = gridCell(ymax, pd->ymin, pd->cellSize, pd->ny);
+
+   for (size_t cy = cy0; cy <= cy1; cy++) {
+      size_t end = pd->offsets[cy * pd->nx + cx1 + 1];
+      for (size_t i = pd->offsets[cy * pd->nx + cx0]; i < end; i++) {
+         if (pd->x[i] >= xmin && pd->x[i] <= xmax && pd->y[i] >= ymin &&
+             pd->y[i] <= ymax && !visit(pd->values[i], ctx))
+            return false;
+      }
+   }
+   return true;
+}
+
+static void gridOfferRow(PointDct *pd, size_t cy, size_t cx0, size_t cx1,
+                         double qx, double qy, KnnHeap *heap) {
+   size_t end = pd->offsets[cy * pd->nx + cx1 + 1];
+   for (size_t i = pd->offsets[cy * pd->nx + cx0]; i < end; i++) {
+      double dx = pd->x[i] - qx;
+      double dy = pd->y[i] - qy;
+      knnOffer(heap, dx * dx + dy * dy, pd->values[i]);
+   }
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL && q != NULL);
+   double qx = ptGetx(q), qy = ptGety(q);
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+   if (pd->size == 0 || k == 0) return knnFinish(&heap);
+
+   // Rings of cells around the cell of q, until the cells not visited yet
+   // are all farther than the current k-th neighbour
+   long cx = (long)gridCell(qx, pd->xmin, pd->cellSize, pd->nx);
+   long cy = (long)gridCell(qy, pd->ymin, pd->cellSize, pd->ny);
+   long nx = (long)pd->nx, ny = (long)pd->ny;
+   for (long ring = 0;; ring++) {
+      if (ring > 0) {
+         // Distance from q to the cells not visited yet: those beyond
+         // the sides of the rings visited so far that are inside the grid
+         double cs = pd->cellSize;
+         double d = INFINITY;
+         if (cx - ring + 1 > 0)
+            d = fmin(d, qx - (pd->xmin + (double)(cx - ring + 1) * cs));
+         if (cx + ring < nx)
+            d = fmin(d, pd->xmin + (double)(cx + ring) * cs - qx);
+         if (cy - ring + 1 > 0)
+            d = fmin(d, qy - (pd->ymin + (double)(cy - ring + 1) * cs));
+         if (cy + ring < ny)
+            d = fmin(d, pd->ymin + (double)(cy + ring) * cs - qy);
+         if (d == INFINITY || d * d >= knnBound(&heap)) break;
+      }
+
+      long x0 = cx - ring < 0 ? 0 : cx - ring;
+      long x1 = cx + ring >= nx ? nx - 1 : cx + ring;
+      for (long y = cy - ring; y <= cy + ring; y++) {
+         if (y < 0 || y >= ny) continue;
+         if (y == cy - ring || y == cy + ring) { // Whole row of the ring
+            gridOfferRow(pd, (size_t)y, (size_t)x0, (size_t)x1, qx, qy,
+                         &heap);
+         } else { // Left and right cells of the ring
+            if (cx - ring >= 0)
+               gridOfferRow(pd, (size_t)y, (size_t)(cx - ring),
+                            (size_t)(cx - ring), qx, qy, &heap);
+            if (cx + ring < nx)
+               gridOfferRow(pd, (size_t)y, (size_t)(cx + ring),
+                            (size_t)(cx + ring), qx, qy, &heap);
+         }
+      }
+   }
+   return knnFinish(&heap);
+}
@@ -0,0 +1,598 @@
+/* ========================================================================= *
+ * PointDct definition (with an implicit kd-tree)
+ *
+ * Static, read-optimised dictionary. The kd-tree is a complete binary tree
+ * stored in breadth-first order: the children of node i are the nodes
+ * 2i+1 and 2i+2, so that no pointer is stored. The coordinates are kept in
+ * two contiguous arrays of doubles (structure of arrays) and the values in
+ * a third, parallel, array. Nodes at even depths split along x, nodes at
+ * odd depths along y.
+ *
+ * As nothing in the tree is a pointer, its arrays are saved as is in a
+ * snapshot file (pdctSave) and used in place once the file is mapped
+ * (pdctLoadMapped). The values are then offsets into a block of the file:
+ * the value of node i is base + values[i], base being 0 for a dictionary
+ * built by pdctCreate and the address of the mapped block otherwise.
+ * ========================================================================= */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "KnnHeap.h"
+#include "List.h"
+#include "Point.h"
+#include "PointDct.h"
+
+// Maximal depth of the tree (a complete tree of 2^64 - 1 nodes)
+#define MAX_DEPTH 64
+
+// Structures
+
+struct PointDct_t {
+   size_t size;
+   double *x;         // x[i]: x coordinate of node i
+   double *y;         // y[i]: y coordinate of node i
+   uint64_t *values;  // base + values[i]: address of the value of node i
+   uint64_t base;     // 0, or the address of the block of a snapshot
+   void *map;         // The mapped snapshot, or NULL
+   size_t mapSize;
+};
+
+// Header of a snapshot file, followed by the arrays x, y and values (of
+// size elements each) and by the block, at the given offsets in the file
+
+#define SNAPSHOT_MAGIC "PDCTIMP1"
+
+// Alignment of the arrays and of the block in the file (a cache line)
+#define SNAPSHOT_ALIGN 64
+
+typedef struct SnapshotHeader_t SnapshotHeader;
+
+struct SnapshotHeader_t {
+   char magic[8];
+   uint64_t size;
+   uint64_t xOffset;
+   uint64_t yOffset;
+   uint64_t valuesOffset;
+   uint64_t blockOffset;
+   uint64_t blockSize;
+};
+
+// Position-value pair used while building the tree
+
+typedef struct Entry_t Entry;
+
+struct Entry_t {
+   double coord[2];
+   void *value;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Number of nodes in the left subtree of a complete binary tree
+ *
+ * \param n Number of nodes of the tree (n > 0)
+ * \return The size of the left subtree of the root
+ */
+static size_t leftSubtreeSize(size_t n);
+
+/**
+ * \brief Reorder entries[lo..hi) so that entries[k] holds the k-th smallest
+ * coordinate along axis (quickselect)
+ *
+ * \param entries Array of entries
+ * \param lo First index of the range
+ * \param hi One past the last index of the range
+ * \param k Index of the entry to select (lo <= k < hi)
+ * \param axis 0 to select along x, 1 along y
+ */
+static void entrySelect(Entry *entries, size_t lo, size_t hi, size_t k,
+                        int axis);
+
+/**
+ * \brief Store the entries[lo..hi) in the subtree rooted at node
+ *
+ * \param pd The dictionary being built
+ * \param entries Array of entries (reordered)
+ * \param lo First index of the range
+ * \param hi One past the last index of the range
+ * \param node Index of the root of the subtree
+ * \param depth Depth of node
+ */
+static void pdctBuildRec(PointDct *pd, Entry *entries, size_t lo, size_t hi,
+                         size_t node, int depth);
+
+/**
+ * \brief Value of a node
+ *
+ * \param pd The dictionary
+ * \param i Index of the node (i < size)
+ * \return The value
+ */
+static void *nodeValue(PointDct *pd, size_t i);
+
+/**
+ * \brief Write an array at an offset of a snapshot file, after zero
+ * padding from the current position
+ *
+ * \param f The file
+ * \param pos Current position in the file, updated
+ * \param offset Offset of the array (offset >= *pos)
+ * \param data The array
+ * \param size Size of the array in bytes
+ * \return false in case of I/O error
+ */
+static bool snapshotWrite(FILE *f, uint64_t *pos, uint64_t offset,
+                          const void *data, size_t size);
+
+/**
+ * \brief Whether a section of a snapshot lies within the file
+ *
+ * \param offset Offset of the section
+ * \param size Size of the section in bytes
+ * \param fileSize Size of the file
+ * \return true if [offset, offset + size) is in the file and offset is
+ * aligned
+ */
+static bool snapshotSectionValid(uint64_t offset, uint64_t size,
+                                 uint64_t fileSize);
+
+/**
+ * \brief Visitor counting the values
+ *
+ * \param value Value in the ball (unused)
+ * \param ctx Counter (size_t) to increment
+ * \return true
+ */
+static bool countValue(void *value, void *ctx);
+
+// Functions definitions
+
+static size_t leftSubtreeSize(size_t n) {
+   // Height h of the tree: 2^h <= n < 2^(h+1)
+   size_t h = 0;
+   while (((size_t)2 << h) <= n)
+      h++;
+   if (h == 0) return 0;
+
+   size_t half = (size_t)1 << (h - 1); // Leaves of a full left subtree
+   size_t lastLevel = n - (((size_t)1 << h) - 1);
+   return (half - 1) + (lastLevel < half ? lastLevel : half);
+}
+
+static void entrySwap(Entry *entries, size_t i, size_t j) {
+   Entry tmp = entries[i];
+   entries[i] = entries[j];
+   entries[j] = tmp;
+}
+
+static void entrySelect(Entry *entries, size_t lo, size_t hi, size_t k,
+                        int axis) {
+   while (hi - lo > 1) {
+      // Median of three pivot
+      double a = entries[lo].coord[axis];
+      double b = entries[lo + (hi - lo) / 2].coord[axis];
+      double c = entries[hi - 1].coord[axis];
+      double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                           : (a < c ? a : (b < c ? c : b));
+
+      // Three-way partition: [lo, lt) < pivot, [lt, gt) == pivot,
+      // [gt, hi) > pivot
+      size_t lt = lo, i = lo, gt = hi;
+      while (i < gt) {
+         double v = entries[i].coord[axis];
+         if (v < pivot)
+            entrySwap(entries, lt++, i++);
+         else if (v > pivot)
+            entrySwap(entries, i, --gt);
+         else
+            i++;
+      }
+
+      if (k < lt)
+         hi = lt;
+      else if (k >= gt)
+         lo = gt;
+      else
+         return;
+   }
+}
+
+static void pdctBuildRec(PointDct *pd, Entry *entries, size_t lo, size_t hi,
+                         size_t node, int depth) {
+   if (lo >= hi) return;
+
+   // The shape is fixed (complete tree): the root of the subtree is the
+   // entry whose rank is the size of the left subtree
+   size_t k = lo + leftSubtreeSize(hi - lo);
+   entrySelect(entries, lo, hi, k, depth % 2);
+
+   pd->x[node] = entries[k].coord[0];
+   pd->y[node] = entries[k].coord[1];
+   pd->values[node] = (uint64_t)(uintptr_t)entries[k].value;
+
+   pdctBuildRec(pd, entries, lo, k, 2 * node + 1, depth + 1);
+   pdctBuildRec(pd, entries, k + 1, hi, 2 * node + 2, depth + 1);
+}
+
+PointDct *pdctCreate(List *lpoints, List *lvalues) {
+   assert(lpoints != NULL && lvalues != NULL);
+   assert(listSize(lpoints) == listSize(lvalues));
+
+   size_t n = listSize(lpoints);
+   PointDct *pd = malloc(sizeof(PointDct));
+   if (pd == NULL) {
+      printf("pdctCreate: allocation error\n");
+      return NULL;
+   }
+   pd->size = n;
+   pd->base = 0;
+   pd->map = NULL;
+   pd->mapSize = 0;
+   pd->x = malloc(n * sizeof(double));
+   pd->y = malloc(n * sizeof(double));
+   pd->values = malloc(n * sizeof(uint64_t));
+   Entry *entries = malloc(n * sizeof(Entry));
+   if (n > 0 && (!pd->x || !pd->y || !pd->values || !entries)) {
+      printf("pdctCreate: allocation error\n");
+      free(entries);
+      pdctFree(pd);
+      return NULL;
+   }
+
+   size_t i = 0;
+   for (LNode *pp = lpoints->head, *pv = lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next, i++) {
+      entries[i].coord[0] = ptGetx(pp->value);
+      entries[i].coord[1] = ptGety(pp->value);
+      entries[i].value = pv->value;
+   }
+
+   pdctBuildRec(pd, entries, 0, n, 0, 0);
+   free(entries);
+
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   if (pd->map != NULL) {
+      munmap(pd->map, pd->mapSize);
+   } else {
+      free(pd->x);
+      free(pd->y);
+      free(pd->values);
+   }
+   free(pd);
+}
+
+static void *nodeValue(PointDct *pd, size_t i) {
+   return (void *)(uintptr_t)(pd->base + pd->values[i]);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return pd->size;
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   double q[2] = {ptGetx(p), ptGety(p)};
+
+   // Points equal to a splitting coordinate may lie on both sides, hence
+   // the stack of subtrees still to explore
+   size_t stack[MAX_DEPTH + 1];
+   int depths[MAX_DEPTH + 1];
+   size_t top = 0;
+   stack[top] = 0;
+   depths[top++] = 0;
+
+   while (top > 0) {
+      size_t i = stack[--top];
+      int depth = depths[top];
+      while (i < pd->size) {
+         if (pd->x[i] == q[0] && pd->y[i] == q[1]) return nodeValue(pd, i);
+
+         double split = depth % 2 ? pd->y[i] : pd->x[i];
+         double c = q[depth % 2];
+         depth++;
+         if (c < split) {
+            i = 2 * i + 1;
+         } else if (c > split) {
+            i = 2 * i + 2;
+         } else { // explore the left subtree later
+            stack[top] = 2 * i + 1;
+            depths[top++] = depth;
+            i = 2 * i + 2;
+         }
+      }
+   }
+   return NULL;
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && q != NULL && r >= 0 && visit != NULL);
+   double c[2] = {ptGetx(q), ptGety(q)};
+   double r2 = r * r;
+
+   size_t stack[MAX_DEPTH + 1];
+   int depths[MAX_DEPTH + 1];
+   size_t top = 0;
+   if (pd->size > 0) {
+      stack[top] = 0;
+      depths[top++] = 0;
+   }
+
+   while (top > 0) {
+      size_t i = stack[--top];
+      int depth = depths[top];
+
+      // Descend along one path, pushing the other side when needed
+      while (i < pd->size) {
+         double dx = pd->x[i] - c[0];
+         double dy = pd->y[i] - c[1];
+         if (dx * dx + dy * dy <= r2 && !visit(nodeValue(pd, i), ctx))
+            return false;
+
+         double split = depth % 2 ? pd->y[i] : pd->x[i];
+         // Same arithmetic as the test of the points (c - r and c + r
+         // would round and prune points at distance exactly r)
+         double d = c[depth % 2] - split;
+         bool goLeft = d <= 0 || d * d <= r2;
+         bool goRight = d >= 0 || d * d <= r2;
+         depth++;
+         if (goLeft && goRight) {
+            stack[top] = 2 * i + 2;
+            depths[top++] = depth;
+            i = 2 * i + 1;
+         } else if (goLeft) {
+            i = 2 * i + 1;
+         } else {
+            i = 2 * i + 2;
+         }
+      }
+   }
+   return true;
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+   double lo[2] = {xmin, ymin};
+   double hi[2] = {xmax, ymax};
+
+   size_t stack[MAX_DEPTH + 1];
+   int depths[MAX_DEPTH + 1];
+   size_t top = 0;
+   if (pd->size > 0) {
+      stack[top] = 0;
+      depths[top++] = 0;
+   }
+
+   while (top > 0) {
+      size_t i = stack[--top];
+      int depth = depths[top];
+
+      // Same traversal as pdctBallVisit, the sides being chosen with the
+      // bounds of the box along the splitting axis
+      while (i < pd->size) {
+         if (pd->x[i] >= xmin && pd->x[i] <= xmax && pd->y[i] >= ymin &&
+             pd->y[i] <= ymax && !visit(nodeValue(pd, i), ctx))
+            return false;
+
+         double split = depth % 2 ? pd->y[i] : pd->x[i];
+         bool goLeft = lo[depth % 2] <= split;
+         bool goRight = hi[depth % 2] >= split;
+         depth++;
+         if (goLeft && goRight) {
+            stack[top] = 2 * i + 2;
+            depths[top++] = depth;
+            i = 2 * i + 1;
+         } else if (goLeft) {
+            i = 2 * i + 1;
+         } else {
+            i = 2 * i + 2;
+         }
+      }
+   }
+   return true;
+}
+
+static bool snapshotWrite(FILE *f, uint64_t *pos, uint64_t offset,
+                          const void *data, size_t size) {
+   for (; *pos < offset; (*pos)++) {
+      if (fputc(0, f) == EOF) return false;
+   }
+   if (size > 0 && fwrite(data, 1, size, f) != size) return false;
+   *pos += size;
+   return true;
+}
+
+bool pdctSave(PointDct *pd, const char *path, const void *block,
+              size_t blockSize) {
+   assert(pd != NULL && path != NULL && (block != NULL || blockSize == 0));
+   size_t n = pd->size;
+
+   // The values become offsets into the block
+   uint64_t *offsets = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+   if (offsets == NULL) {
+      printf("pdctSave: allocation error\n");
+      return false;
+   }
+   uintptr_t start = (uintptr_t)block;
+   for (size_t i = 0; i < n; i++) {
+      uintptr_t value = (uintptr_t)nodeValue(pd, i);
+      if (value < start || value - start >= blockSize) {
+         printf("pdctSave: value outside of the block\n");
+         free(offsets);
+         return false;
+      }
+      offsets[i] = value - start;
+   }
+
+   // Each array starts on its own cache line
+   SnapshotHeader header;
+   memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+   header.size = n;
+   uint64_t arraySize = (n * sizeof(double) + SNAPSHOT_ALIGN - 1) /
+                        SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+   header.xOffset = SNAPSHOT_ALIGN;
+   header.yOffset = header.xOffset + arraySize;
+   header.valuesOffset = header.yOffset + arraySize;
+   header.blockOffset = header.valuesOffset + arraySize;
+   header.blockSize = blockSize;
+
+   FILE *f = fopen(path, "wb");
+   if (f == NULL) {
+      printf("pdctSave: cannot open '%s'\n", path);
+      free(offsets);
+      return false;
+   }
+   uint64_t pos = 0;
+   bool ok = snapshotWrite(f, &pos, 0, &header, sizeof(header)) &&
+             snapshotWrite(f, &pos, header.xOffset, pd->x,
+                           n * sizeof(double)) &&
+             snapshotWrite(f, &pos, header.yOffset, pd->y,
+                           n * sizeof(double)) &&
+             snapshotWrite(f, &pos, header.valuesOffset, offsets,
+                           n * sizeof(uint64_t)) &&
+             snapshotWrite(f, &pos, header.blockOffset, block, blockSize);
+   free(offsets);
+   if (fclose(f) != 0) ok = false;
+   if (!ok) printf("pdctSave: cannot write '%s'\n", path);
+   return ok;
+}
+
+static bool snapshotSectionValid(uint64_t offset, uint64_t size,
+                                 uint64_t fileSize) {
+   return offset % SNAPSHOT_ALIGN == 0 && offset <= fileSize &&
+          size <= fileSize - offset;
+}
+
+PointDct *pdctLoadMapped(const char *path, const void **block,
+                         size_t *blockSize) {
+   assert(path != NULL);
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      printf("pdctLoadMapped: cannot open '%s'\n", path);
+      return NULL;
+   }
+   struct stat st;
+   void *map = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(SnapshotHeader))
+      map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd); // the mapping remains
+   if (map == MAP_FAILED) {
+      printf("pdctLoadMapped: cannot map '%s'\n", path);
+      return NULL;
+   }
+
+   // The header and the offsets of the values into the block are checked
+   // so that no access falls outside of the file
+   SnapshotHeader header;
+   memcpy(&header, map, sizeof(header));
+   char *bytes = map;
+   uint64_t fileSize = (uint64_t)st.st_size;
+   uint64_t n = header.size;
+   bool valid =
+      memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+      n <= fileSize / sizeof(double) &&
+      snapshotSectionValid(header.xOffset, n * sizeof(double), fileSize) &&
+      snapshotSectionValid(header.yOffset, n * sizeof(double), fileSize) &&
+      snapshotSectionValid(header.valuesOffset, n * sizeof(uint64_t),
+                           fileSize) &&
+      snapshotSectionValid(header.blockOffset, header.blockSize, fileSize);
+   const uint64_t *offsets =
+      valid ? (const uint64_t *)(bytes + header.valuesOffset) : NULL;
+   for (uint64_t i = 0; valid && i < n; i++)
+      valid = offsets[i] < header.blockSize;
+   if (!valid) {
+      printf("pdctLoadMapped: '%s' is not a snapshot\n", path);
+      munmap(map, (size_t)st.st_size);
+      return NULL;
+   }
+
+   PointDct *pd = malloc(sizeof(PointDct));
+   if (pd == NULL) {
+      printf("pdctLoadMapped: allocation error\n");
+      munmap(map, (size_t)st.st_size);
+      return NULL;
+   }
+   pd->size = (size_t)n;
+   pd->x = (double *)(bytes + header.xOffset);
+   pd->y = (double *)(bytes + header.yOffset);
+   pd->values = (uint64_t *)(bytes + header.valuesOffset);
+   pd->base = (uint64_t)(uintptr_t)(bytes + header.blockOffset);
+   pd->map = map;
+   pd->mapSize = (size_t)st.st_size;
+   if (block != NULL) *block = bytes + header.blockOffset;
+   if (blockSize != NULL) *blockSize = (size_t)header.blockSize;
+   return pd;
+}
+
+static bool countValue(void *value, void *ctx) {
+   (void)value;
+   (*(size_t *)ctx)++;
+   return true;
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   size_t count = 0;
+   pdctBallVisit(pd, q, r, countValue, &count);
+   return count;
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL && q != NULL);
+   double c[2] = {ptGetx(q), ptGety(q)};
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+
+   // Subtrees still to explore, with a lower bound on the squared distance
+   // of their points to q (the distance to the splitting line)
+   size_t stack[MAX_DEPTH + 1];
+   int depths[MAX_DEPTH + 1];
+   double bounds[MAX_DEPTH + 1];
+   size_t top = 0;
+   if (pd->size > 0 && k > 0) {
+      stack[top] = 0;
+      depths[top] = 0;
+      bounds[top++] = 0;
+   }
+
+   while (top > 0) {
+      top--;
+      if (bounds[top] >= knnBound(&heap)) continue;
+      size_t i = stack[top];
+      int depth = depths[top];
+
+      // Descend on the side of q, pushing the other side
+      while (i < pd->size) {
+         double dx = pd->x[i] - c[0];
+         double dy = pd->y[i] - c[1];
+         knnOffer(&heap, dx * dx + dy * dy, nodeValue(pd, i));
+
+         double split = depth % 2 ? pd->y[i] : pd->x[i];
+         double d = c[depth % 2] - split;
+         depth++;
+         stack[top] = d < 0 ? 2 * i + 2 : 2 * i + 1;
+         depths[top] = depth;
+         bounds[top++] = d * d;
+         i = d < 0 ? 2 * i + 1 : 2 * i + 2;
+      }
+   }
+   return knnFinish(&heap);
+}
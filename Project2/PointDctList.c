@@ -1,10 +1,14 @@
 /* ========================================================================= *
  * PointDct definition (with List)
+ *
+ * The exact searches go through a PointHash of the positions.
  * ========================================================================= */
 
+#include "KnnHeap.h"
 #include "List.h"
 #include "Point.h"
 #include "PointDct.h"
+#include "PointHash.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +17,7 @@
 struct PointDct_t {
    List *lpoints;
    List *lvalues;
+   PointHash *hash; // Positions to values, for the exact searches
 };
 
 PointDct *pdctCreate(List *lpoints, List *lvalues) {
@@ -23,38 +28,77 @@ PointDct *pdctCreate(List *lpoints, List *lvalues) {
    }
    pd->lpoints = lpoints;
    pd->lvalues = lvalues;
+
+   // Inserted in the order of the lists, so that the hash returns the
+   // first value of a position, as a scan of the lists would
+   pd->hash = phNew(listSize(lpoints));
+   if (pd->hash == NULL) {
+      free(pd);
+      return NULL;
+   }
+   for (LNode *pp = lpoints->head, *pv = lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next) {
+      if (!phInsert(pd->hash, ptGetx(pp->value), ptGety(pp->value),
+                    pv->value)) {
+         pdctFree(pd);
+         return NULL;
+      }
+   }
    return pd;
 }
 
-void pdctFree(PointDct *pd) { free(pd); }
+void pdctFree(PointDct *pd) {
+   phFree(pd->hash);
+   free(pd);
+}
 
 size_t pdctSize(PointDct *pd) { return listSize(pd->lpoints); }
 
 void *pdctExactSearch(PointDct *pd, Point *p) {
+   return phSearch(pd->hash, ptGetx(p), ptGety(p));
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   double r2 = r * r;
    for (LNode *pp = pd->lpoints->head, *pv = pd->lvalues->head; pp != NULL;
         pp = pp->next, pv = pv->next) {
-      if (ptCompare(pp->value, p) == 0) {
-         return pv->value;
+      if (ptSqrDistance(pp->value, q) <= r2 && !visit(pv->value, ctx)) {
+         return false;
       }
    }
-   return NULL;
+   return true;
 }
 
-List *pdctBallSearch(PointDct *pd, Point *p, double radius) {
-   List *l = listNew();
-   if (l == NULL) return NULL;
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   double r2 = r * r;
+   size_t count = 0;
+   for (LNode *pp = pd->lpoints->head; pp != NULL; pp = pp->next) {
+      if (ptSqrDistance(pp->value, q) <= r2) count++;
+   }
+   return count;
+}
 
-   radius = radius * radius;
-   bool error = false;
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
    for (LNode *pp = pd->lpoints->head, *pv = pd->lvalues->head; pp != NULL;
         pp = pp->next, pv = pv->next) {
-      if (ptSqrDistance(pp->value, p) <= radius) {
-         error = error || !listInsertLast(l, pv->value);
+      double x = ptGetx(pp->value), y = ptGety(pp->value);
+      if (x >= xmin && x <= xmax && y >= ymin && y <= ymax &&
+          !visit(pv->value, ctx)) {
+         return false;
       }
    }
-   if (error) {
-      listFree(l, false);
-      return NULL;
+   return true;
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+   for (LNode *pp = pd->lpoints->head, *pv = pd->lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next) {
+      knnOffer(&heap, ptSqrDistance(pp->value, q), pv->value);
    }
-   return l;
+   return knnFinish(&heap);
 }
@@ -0,0 +1,393 @@
+/* ========================================================================= *
+ * PointDct definition (with a Morton-ordered array)
+ *
+ * Static, pointer-free dictionary. The coordinates are quantised on 32 bits
+ * over the bounding box of the positions, and the positions are sorted by
+ * the Morton code (Z-order) of their quantised coordinates. The codes, the
+ * coordinates and the values are kept in contiguous parallel arrays.
+ *
+ * A ball search decomposes the bounding box of the ball into a few boxes
+ * whose codes form disjoint intervals of the curve (the LITMAX/BIGMIN
+ * splits); each interval is located by binary search and scanned.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "KnnHeap.h"
+#include "List.h"
+#include "Morton.h"
+#include "Point.h"
+#include "PointDct.h"
+
+// Maximal number of intervals of the curve scanned by a ball search
+#define MAX_RANGES 16
+
+// Structures
+
+struct PointDct_t {
+   size_t size;
+   double xmin; // Lower left corner of the quantisation grid
+   double ymin;
+   double xscale; // Quantisation: (x - xmin) * xscale
+   double yscale;
+   uint64_t *codes; // Sorted Morton codes
+   double *x;
+   double *y;
+   void **values;
+};
+
+// Quantised box [x0, x1] x [y0, y1]
+
+typedef struct ZBox_t ZBox;
+
+struct ZBox_t {
+   uint32_t x0;
+   uint32_t y0;
+   uint32_t x1;
+   uint32_t y1;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Quantise a coordinate on 32 bits, clamped to the grid
+ *
+ * \param v The coordinate
+ * \param min Lower bound of the grid
+ * \param scale Number of steps per unit
+ * \return The quantised coordinate
+ */
+static uint32_t quantise(double v, double min, double scale);
+
+/**
+ * \brief Index of the first code >= z in codes[lo..hi)
+ */
+static size_t lowerBound(uint64_t *codes, size_t lo, size_t hi, uint64_t z);
+
+/**
+ * \brief Index of the highest bit set
+ *
+ * \param v A value
+ * \return The index of its highest bit set, -1 if v is 0
+ */
+static int highestBit(uint32_t v);
+
+/**
+ * \brief Split a box into boxes whose Morton codes are disjoint intervals
+ * covering the codes of the box, in increasing order
+ *
+ * \param box The box to split
+ * \param boxes Array of at least MAX_RANGES boxes, filled with the pieces
+ * \return The number of pieces
+ */
+static size_t zboxSplit(ZBox box, ZBox *boxes);
+
+/**
+ * \brief Call visit on the values in the ball (or count them if visit is
+ * NULL)
+ *
+ * \param pd The dictionary
+ * \param q Center of the ball
+ * \param r Radius of the ball
+ * \param visit Function called on the values in the ball, or NULL
+ * \param ctx Context passed to visit
+ * \param count Incremented for each value in the ball
+ * \return false if the traversal was stopped by visit
+ */
+static bool mortonBall(PointDct *pd, Point *q, double r,
+                       bool visit(void *value, void *ctx), void *ctx,
+                       size_t *count);
+
+// Functions definitions
+
+static uint32_t quantise(double v, double min, double scale) {
+   double t = floor((v - min) * scale);
+   if (!(t > 0)) return 0;
+   if (t >= 4294967295.0) return UINT32_MAX;
+   return (uint32_t)t;
+}
+
+PointDct *pdctCreate(List *lpoints, List *lvalues) {
+   assert(lpoints != NULL && lvalues != NULL);
+   assert(listSize(lpoints) == listSize(lvalues));
+
+   size_t n = listSize(lpoints);
+   PointDct *pd = malloc(sizeof(PointDct));
+   if (pd == NULL) {
+      printf("pdctCreate: allocation error\n");
+      return NULL;
+   }
+   pd->size = n;
+   pd->codes = malloc(n * sizeof(uint64_t));
+   pd->x = malloc(n * sizeof(double));
+   pd->y = malloc(n * sizeof(double));
+   pd->values = malloc(n * sizeof(void *));
+   size_t *order = malloc(n * sizeof(size_t));
+   double *x = malloc(n * sizeof(double));
+   double *y = malloc(n * sizeof(double));
+   void **values = malloc(n * sizeof(void *));
+   if (n > 0 && (!pd->codes || !pd->x || !pd->y || !pd->values || !order ||
+                 !x || !y || !values)) {
+      printf("pdctCreate: allocation error\n");
+      free(order);
+      free(x);
+      free(y);
+      free(values);
+      pdctFree(pd);
+      return NULL;
+   }
+
+   size_t i = 0;
+   double xmax = -INFINITY, ymax = -INFINITY;
+   pd->xmin = pd->ymin = INFINITY;
+   for (LNode *pp = lpoints->head, *pv = lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next, i++) {
+      x[i] = ptGetx(pp->value);
+      y[i] = ptGety(pp->value);
+      values[i] = pv->value;
+      if (x[i] < pd->xmin) pd->xmin = x[i];
+      if (x[i] > xmax) xmax = x[i];
+      if (y[i] < pd->ymin) pd->ymin = y[i];
+      if (y[i] > ymax) ymax = y[i];
+   }
+   pd->xscale = xmax > pd->xmin ? 4294967295.0 / (xmax - pd->xmin) : 0;
+   pd->yscale = ymax > pd->ymin ? 4294967295.0 / (ymax - pd->ymin) : 0;
+
+   // The build is a single integer sort
+   for (i = 0; i < n; i++) {
+      pd->codes[i] = mortonEncode(quantise(x[i], pd->xmin, pd->xscale),
+                                  quantise(y[i], pd->ymin, pd->yscale));
+      order[i] = i;
+   }
+   bool ok = mortonSort(pd->codes, order, n);
+   for (i = 0; ok && i < n; i++) {
+      pd->x[i] = x[order[i]];
+      pd->y[i] = y[order[i]];
+      pd->values[i] = values[order[i]];
+   }
+   free(order);
+   free(x);
+   free(y);
+   free(values);
+   if (!ok) {
+      pdctFree(pd);
+      return NULL;
+   }
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   free(pd->codes);
+   free(pd->x);
+   free(pd->y);
+   free(pd->values);
+   free(pd);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return pd->size;
+}
+
+static size_t lowerBound(uint64_t *codes, size_t lo, size_t hi, uint64_t z) {
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (codes[mid] < z)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   double x = ptGetx(p), y = ptGety(p);
+
+   uint64_t z = mortonEncode(quantise(x, pd->xmin, pd->xscale),
+                             quantise(y, pd->ymin, pd->yscale));
+   for (size_t i = lowerBound(pd->codes, 0, pd->size, z);
+        i < pd->size && pd->codes[i] == z; i++) {
+      if (pd->x[i] == x && pd->y[i] == y) return pd->values[i];
+   }
+   return NULL;
+}
+
+static int highestBit(uint32_t v) {
+   int bit = -1;
+   while (v != 0) {
+      v >>= 1;
+      bit++;
+   }
+   return bit;
+}
+
+static size_t zboxSplit(ZBox box, ZBox *boxes) {
+   // Splitting a box at its highest differing bit on the curve gives a
+   // lower part, whose largest code is LITMAX, and an upper part, whose
+   // smallest code is BIGMIN: the codes between them are outside the box.
+   // The piece spanning the most codes is split first
+   size_t n = 1;
+   boxes[0] = box;
+   while (n < MAX_RANGES) {
+      size_t widest = n;
+      uint64_t widestSpan = 0;
+      for (size_t p = 0; p < n; p++) {
+         uint64_t span = mortonEncode(boxes[p].x1, boxes[p].y1) -
+                         mortonEncode(boxes[p].x0, boxes[p].y0);
+         if (span > widestSpan) {
+            widest = p;
+            widestSpan = span;
+         }
+      }
+      if (widest == n) break; // Only single cells left
+
+      // Bit i of y is just above bit i of x on the curve. The upper part
+      // starts where the highest differing bit goes from 0 to 1
+      ZBox lower = boxes[widest], upper = boxes[widest];
+      int hx = highestBit(lower.x0 ^ lower.x1);
+      int hy = highestBit(lower.y0 ^ lower.y1);
+      if (hy >= hx) {
+         uint32_t split = upper.y1 & ~((UINT32_C(1) << hy) - 1);
+         lower.y1 = split - 1;
+         upper.y0 = split;
+      } else {
+         uint32_t split = upper.x1 & ~((UINT32_C(1) << hx) - 1);
+         lower.x1 = split - 1;
+         upper.x0 = split;
+      }
+      for (size_t p = n; p > widest + 1; p--)
+         boxes[p] = boxes[p - 1];
+      boxes[widest] = lower;
+      boxes[widest + 1] = upper;
+      n++;
+   }
+   return n;
+}
+
+static bool mortonBall(PointDct *pd, Point *q, double r,
+                       bool visit(void *value, void *ctx), void *ctx,
+                       size_t *count) {
+   double qx = ptGetx(q), qy = ptGety(q);
+   double r2 = r * r;
+   if (pd->size == 0) return true;
+
+   ZBox box = {quantise(qx - r, pd->xmin, pd->xscale),
+               quantise(qy - r, pd->ymin, pd->yscale),
+               quantise(qx + r, pd->xmin, pd->xscale),
+               quantise(qy + r, pd->ymin, pd->yscale)};
+   ZBox boxes[MAX_RANGES];
+   size_t nboxes = zboxSplit(box, boxes);
+
+   // The intervals are increasing: each binary search starts after the
+   // previous interval
+   size_t i = 0;
+   for (size_t b = 0; b < nboxes; b++) {
+      uint64_t zmin = mortonEncode(boxes[b].x0, boxes[b].y0);
+      uint64_t zmax = mortonEncode(boxes[b].x1, boxes[b].y1);
+      for (i = lowerBound(pd->codes, i, pd->size, zmin);
+           i < pd->size && pd->codes[i] <= zmax; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         if (dx * dx + dy * dy > r2) continue;
+         (*count)++;
+         if (visit != NULL && !visit(pd->values[i], ctx)) return false;
+      }
+   }
+   return true;
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && q != NULL && r >= 0 && visit != NULL);
+   size_t count = 0;
+   return mortonBall(pd, q, r, visit, ctx, &count);
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL && q != NULL && r >= 0);
+   size_t count = 0;
+   mortonBall(pd, q, r, NULL, NULL, &count);
+   return count;
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+   if (pd->size == 0) return true;
+
+   // Same intervals of the curve as for a ball, with the box itself
+   ZBox box = {quantise(xmin, pd->xmin, pd->xscale),
+               quantise(ymin, pd->ymin, pd->yscale),
+               quantise(xmax, pd->xmin, pd->xscale),
+               quantise(ymax, pd->ymin, pd->yscale)};
+   ZBox boxes[MAX_RANGES];
+   size_t nboxes = zboxSplit(box, boxes);
+
+   size_t i = 0;
+   for (size_t b = 0; b < nboxes; b++) {
+      uint64_t zmin = mortonEncode(boxes[b].x0, boxes[b].y0);
+      uint64_t zmax = mortonEncode(boxes[b].x1, boxes[b].y1);
+      for (i = lowerBound(pd->codes, i, pd->size, zmin);
+           i < pd->size && pd->codes[i] <= zmax; i++) {
+         if (pd->x[i] >= xmin && pd->x[i] <= xmax && pd->y[i] >= ymin &&
+             pd->y[i] <= ymax && !visit(pd->values[i], ctx))
+            return false;
+      }
+   }
+   return true;
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL && q != NULL);
+   double qx = ptGetx(q), qy = ptGety(q);
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+   if (pd->size == 0 || k == 0) return knnFinish(&heap);
+
+   // The neighbours of q along the curve give a first bound on the
+   // distance of the k-th neighbour
+   uint64_t z = mortonEncode(quantise(qx, pd->xmin, pd->xscale),
+                             quantise(qy, pd->ymin, pd->yscale));
+   size_t pos = lowerBound(pd->codes, 0, pd->size, z);
+   size_t lo = pos > k ? pos - k : 0;
+   size_t hi = pd->size - pos > k ? pos + k : pd->size;
+   for (size_t i = lo; i < hi; i++) {
+      double dx = pd->x[i] - qx;
+      double dy = pd->y[i] - qy;
+      knnOffer(&heap, dx * dx + dy * dy, pd->values[i]);
+   }
+
+   // Then every position within that bound is offered (again)
+   double bound = knnBound(&heap);
+   if (bound == INFINITY) { // Fewer than k positions
+      return knnFinish(&heap);
+   }
+   double r = sqrt(bound);
+   ZBox box = {quantise(qx - r, pd->xmin, pd->xscale),
+               quantise(qy - r, pd->ymin, pd->yscale),
+               quantise(qx + r, pd->xmin, pd->xscale),
+               quantise(qy + r, pd->ymin, pd->yscale)};
+   ZBox boxes[MAX_RANGES];
+   size_t nboxes = zboxSplit(box, boxes);
+   size_t i = 0;
+   for (size_t b = 0; b < nboxes; b++) {
+      uint64_t zmin = mortonEncode(boxes[b].x0, boxes[b].y0);
+      uint64_t zmax = mortonEncode(boxes[b].x1, boxes[b].y1);
+      for (i = lowerBound(pd->codes, i, pd->size, zmin);
+           i < pd->size && pd->codes[i] <= zmax; i++) {
+         if (i >= lo && i < hi) continue; // Already offered
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         knnOffer(&heap, dx * dx + dy * dy, pd->values[i]);
+      }
+   }
+   return knnFinish(&heap);
+}
@@ -0,0 +1,30 @@
+/* ========================================================================= *
+ * PointDct definition (snapshots of the implementations without a format)
+ *
+ * The implementations that have no snapshot format (all but the implicit
+ * kd-tree) link this file: pdctSave and pdctLoadMapped always fail.
+ * ========================================================================= */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "PointDct.h"
+
+// Functions definitions
+
+bool pdctSave(PointDct *pd, const char *path, const void *block,
+              size_t blockSize) {
+   (void)pd;
+   (void)path;
+   (void)block;
+   (void)blockSize;
+   return false;
+}
+
+PointDct *pdctLoadMapped(const char *path, const void **block,
+                         size_t *blockSize) {
+   (void)path;
+   (void)block;
+   (void)blockSize;
+   return NULL;
+}
@@ -0,0 +1,447 @@
+/* ========================================================================= *
+ * PointDct definition (with a bucket point-region quadtree)
+ *
+ * Static dictionary. The square region containing the positions is split
+ * recursively into four quadrants of equal size, until a region holds at
+ * most QUAD_BUCKET positions: dense areas get deep subtrees and sparse ones
+ * shallow subtrees. The positions are reordered so that those of every
+ * subtree are contiguous in the x, y and values arrays; a node only stores
+ * the range of its positions and their bounding box.
+ * ========================================================================= */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "KnnHeap.h"
+#include "List.h"
+#include "Point.h"
+#include "PointDct.h"
+
+// Maximal number of positions in a leaf (unless it is at MAX_DEPTH)
+#define QUAD_BUCKET 16
+
+// Maximal depth of the tree (equal positions cannot be split)
+#define MAX_DEPTH 48
+
+// Structures
+
+typedef struct QNode_t QNode;
+
+struct QNode_t {
+   double xmin; // Bounding box of the positions of the subtree
+   double ymin;
+   double xmax;
+   double ymax;
+   size_t start; // The positions of the subtree are [start, end)
+   size_t end;
+   size_t child; // Index of the first of the 4 children, 0 for a leaf
+};
+
+struct PointDct_t {
+   size_t size;
+   double cx; // Center of the region of the root
+   double cy;
+   double half; // Half of the side of the region of the root
+   QNode *nodes; // nodes[0] is the root
+   size_t nnodes;
+   size_t capacity;
+   double *x;
+   double *y;
+   void **values;
+};
+
+// Position-value pair used while building the tree
+
+typedef struct Entry_t Entry;
+
+struct Entry_t {
+   double x;
+   double y;
+   void *value;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Reorder entries[lo..hi) so that those with coordinate < split along
+ * axis come first
+ *
+ * \param entries Array of entries
+ * \param lo First index of the range
+ * \param hi One past the last index of the range
+ * \param axis 0 for x, 1 for y
+ * \param split Splitting coordinate
+ * \return The index of the first entry >= split
+ */
+static size_t entryPartition(Entry *entries, size_t lo, size_t hi, int axis,
+                             double split);
+
+/**
+ * \brief Build the subtree of node, whose positions are entries[lo..hi)
+ *
+ * \param pd The dictionary being built
+ * \param entries Array of entries (reordered)
+ * \param node Index of the node (already allocated)
+ * \param cx x coordinate of the center of the region of node
+ * \param cy y coordinate of the center of the region of node
+ * \param half Half of the side of the region
+ * \param depth Depth of node
+ * \return false in case of allocation error
+ */
+static bool quadBuildRec(PointDct *pd, Entry *entries, size_t node,
+                         double cx, double cy, double half, int depth);
+
+/**
+ * \brief Squared distance from q to the bounding box of a node
+ *
+ * \param n A node
+ * \param qx x coordinate of q
+ * \param qy y coordinate of q
+ * \return The squared distance (INFINITY for an empty node)
+ */
+static double quadBoxSqrDistance(QNode *n, double qx, double qy);
+
+/**
+ * \brief Whether the bounding box of a node lies inside a ball
+ *
+ * \param n A node
+ * \param qx x coordinate of the center of the ball
+ * \param qy y coordinate of the center of the ball
+ * \param r2 Squared radius of the ball
+ * \return true if all the positions of the node are in the ball
+ */
+static bool quadBoxInBall(QNode *n, double qx, double qy, double r2);
+
+/**
+ * \brief Call visit on the values of the subtree of node in the ball
+ *
+ * \return false if the traversal was stopped by visit
+ */
+static bool quadBallVisitRec(PointDct *pd, size_t node, double qx, double qy,
+                             double r2, bool visit(void *value, void *ctx),
+                             void *ctx);
+
+/**
+ * \brief Call visit on the values of the subtree of node in the box
+ * [xmin, xmax] x [ymin, ymax]
+ *
+ * \return false if the traversal was stopped by visit
+ */
+static bool quadBoxVisitRec(PointDct *pd, size_t node, double xmin,
+                            double ymin, double xmax, double ymax,
+                            bool visit(void *value, void *ctx), void *ctx);
+
+/**
+ * \brief Count the positions of the subtree of node in the ball
+ */
+static size_t quadBallCountRec(PointDct *pd, size_t node, double qx,
+                               double qy, double r2);
+
+/**
+ * \brief Offer the positions of the subtree of node to the heap of the k
+ * nearest neighbours, closest child first
+ */
+static void quadKnnRec(PointDct *pd, size_t node, double qx, double qy,
+                       KnnHeap *heap);
+
+// Functions definitions
+
+static size_t entryPartition(Entry *entries, size_t lo, size_t hi, int axis,
+                             double split) {
+   size_t i = lo;
+   for (size_t j = lo; j < hi; j++) {
+      double v = axis ? entries[j].y : entries[j].x;
+      if (v < split) {
+         Entry tmp = entries[i];
+         entries[i++] = entries[j];
+         entries[j] = tmp;
+      }
+   }
+   return i;
+}
+
+static bool quadBuildRec(PointDct *pd, Entry *entries, size_t node,
+                         double cx, double cy, double half, int depth) {
+   size_t lo = pd->nodes[node].start, hi = pd->nodes[node].end;
+
+   QNode *n = &pd->nodes[node];
+   n->xmin = n->ymin = INFINITY;
+   n->xmax = n->ymax = -INFINITY;
+   for (size_t i = lo; i < hi; i++) {
+      if (entries[i].x < n->xmin) n->xmin = entries[i].x;
+      if (entries[i].x > n->xmax) n->xmax = entries[i].x;
+      if (entries[i].y < n->ymin) n->ymin = entries[i].y;
+      if (entries[i].y > n->ymax) n->ymax = entries[i].y;
+   }
+   n->child = 0;
+   if (hi - lo <= QUAD_BUCKET || depth >= MAX_DEPTH) return true;
+
+   // Quadrants: 0 south-west, 1 south-east, 2 north-west, 3 north-east
+   size_t midy = entryPartition(entries, lo, hi, 1, cy);
+   size_t bounds[5] = {lo, entryPartition(entries, lo, midy, 0, cx), midy,
+                       entryPartition(entries, midy, hi, 0, cx), hi};
+
+   if (pd->nnodes + 4 > pd->capacity) {
+      size_t capacity = 2 * pd->capacity;
+      QNode *nodes = realloc(pd->nodes, capacity * sizeof(QNode));
+      if (nodes == NULL) return false;
+      pd->nodes = nodes;
+      pd->capacity = capacity;
+   }
+   size_t child = pd->nnodes;
+   pd->nnodes += 4;
+   pd->nodes[node].child = child; // (n may have moved)
+
+   double h = half / 2;
+   for (int q = 0; q < 4; q++) {
+      pd->nodes[child + q].start = bounds[q];
+      pd->nodes[child + q].end = bounds[q + 1];
+      if (!quadBuildRec(pd, entries, child + q, q % 2 ? cx + h : cx - h,
+                        q / 2 ? cy + h : cy - h, h, depth + 1))
+         return false;
+   }
+   return true;
+}
+
+PointDct *pdctCreate(List *lpoints, List *lvalues) {
+   assert(lpoints != NULL && lvalues != NULL);
+   assert(listSize(lpoints) == listSize(lvalues));
+
+   size_t n = listSize(lpoints);
+   PointDct *pd = malloc(sizeof(PointDct));
+   if (pd == NULL) {
+      printf("pdctCreate: allocation error\n");
+      return NULL;
+   }
+   pd->size = n;
+   pd->capacity = 1 + 4 * (n / QUAD_BUCKET + 1);
+   pd->nnodes = 1;
+   pd->nodes = malloc(pd->capacity * sizeof(QNode));
+   pd->x = malloc(n * sizeof(double));
+   pd->y = malloc(n * sizeof(double));
+   pd->values = malloc(n * sizeof(void *));
+   Entry *entries = malloc(n * sizeof(Entry));
+   if (pd->nodes == NULL ||
+       (n > 0 && (!pd->x || !pd->y || !pd->values || !entries))) {
+      printf("pdctCreate: allocation error\n");
+      free(entries);
+      pdctFree(pd);
+      return NULL;
+   }
+
+   size_t i = 0;
+   double xmin = INFINITY, xmax = -INFINITY;
+   double ymin = INFINITY, ymax = -INFINITY;
+   for (LNode *pp = lpoints->head, *pv = lvalues->head; pp != NULL;
+        pp = pp->next, pv = pv->next, i++) {
+      entries[i].x = ptGetx(pp->value);
+      entries[i].y = ptGety(pp->value);
+      entries[i].value = pv->value;
+      if (entries[i].x < xmin) xmin = entries[i].x;
+      if (entries[i].x > xmax) xmax = entries[i].x;
+      if (entries[i].y < ymin) ymin = entries[i].y;
+      if (entries[i].y > ymax) ymax = entries[i].y;
+   }
+
+   // Square region containing the bounding box
+   pd->cx = n > 0 ? (xmin + xmax) / 2 : 0;
+   pd->cy = n > 0 ? (ymin + ymax) / 2 : 0;
+   pd->half = n > 0 ? fmax(xmax - xmin, ymax - ymin) / 2 : 0;
+
+   pd->nodes[0].start = 0;
+   pd->nodes[0].end = n;
+   if (!quadBuildRec(pd, entries, 0, pd->cx, pd->cy, pd->half, 0)) {
+      printf("pdctCreate: allocation error\n");
+      free(entries);
+      pdctFree(pd);
+      return NULL;
+   }
+
+   for (i = 0; i < n; i++) {
+      pd->x[i] = entries[i].x;
+      pd->y[i] = entries[i].y;
+      pd->values[i] = entries[i].value;
+   }
+   free(entries);
+   return pd;
+}
+
+void pdctFree(PointDct *pd) {
+   assert(pd != NULL);
+   free(pd->nodes);
+   free(pd->x);
+   free(pd->y);
+   free(pd->values);
+   free(pd);
+}
+
+size_t pdctSize(PointDct *pd) {
+   assert(pd != NULL);
+   return pd->size;
+}
+
+void *pdctExactSearch(PointDct *pd, Point *p) {
+   assert(pd != NULL && p != NULL);
+   double x = ptGetx(p), y = ptGety(p);
+
+   // Descend in the quadrant containing p (as in quadBuildRec)
+   double cx = pd->cx, cy = pd->cy, half = pd->half;
+   QNode *n = &pd->nodes[0];
+   while (n->child != 0) {
+      int q = (y >= cy) * 2 + (x >= cx);
+      half /= 2;
+      cx += x >= cx ? half : -half;
+      cy += y >= cy ? half : -half;
+      n = &pd->nodes[n->child + q];
+   }
+   for (size_t i = n->start; i < n->end; i++) {
+      if (pd->x[i] == x && pd->y[i] == y) return pd->values[i];
+   }
+   return NULL;
+}
+
+static double quadBoxSqrDistance(QNode *n, double qx, double qy) {
+   if (n->start == n->end) return INFINITY;
+   double dx = qx < n->xmin ? n->xmin - qx : (qx > n->xmax ? qx - n->xmax : 0);
+   double dy = qy < n->ymin ? n->ymin - qy : (qy > n->ymax ? qy - n->ymax : 0);
+   return dx * dx + dy * dy;
+}
+
+static bool quadBoxInBall(QNode *n, double qx, double qy, double r2) {
+   double fx = fmax(qx - n->xmin, n->xmax - qx);
+   double fy = fmax(qy - n->ymin, n->ymax - qy);
+   return fx * fx + fy * fy <= r2;
+}
+
+static bool quadBallVisitRec(PointDct *pd, size_t node, double qx, double qy,
+                             double r2, bool visit(void *value, void *ctx),
+                             void *ctx) {
+   QNode *n = &pd->nodes[node];
+   if (quadBoxSqrDistance(n, qx, qy) > r2) return true;
+
+   if (quadBoxInBall(n, qx, qy, r2)) { // No need to test the positions
+      for (size_t i = n->start; i < n->end; i++) {
+         if (!visit(pd->values[i], ctx)) return false;
+      }
+      return true;
+   }
+   if (n->child == 0) {
+      for (size_t i = n->start; i < n->end; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         if (dx * dx + dy * dy <= r2 && !visit(pd->values[i], ctx))
+            return false;
+      }
+      return true;
+   }
+   for (size_t c = n->child; c < n->child + 4; c++) {
+      if (!quadBallVisitRec(pd, c, qx, qy, r2, visit, ctx)) return false;
+   }
+   return true;
+}
+
+bool pdctBallVisit(PointDct *pd, Point *q, double r,
+                   bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && q != NULL && r >= 0 && visit != NULL);
+   return quadBallVisitRec(pd, 0, ptGetx(q), ptGety(q), r * r, visit, ctx);
+}
+
+static size_t quadBallCountRec(PointDct *pd, size_t node, double qx,
+                               double qy, double r2) {
+   QNode *n = &pd->nodes[node];
+   if (quadBoxSqrDistance(n, qx, qy) > r2) return 0;
+   if (quadBoxInBall(n, qx, qy, r2)) return n->end - n->start;
+
+   size_t count = 0;
+   if (n->child == 0) {
+      for (size_t i = n->start; i < n->end; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         count += dx * dx + dy * dy <= r2;
+      }
+      return count;
+   }
+   for (size_t c = n->child; c < n->child + 4; c++)
+      count += quadBallCountRec(pd, c, qx, qy, r2);
+   return count;
+}
+
+size_t pdctBallCount(PointDct *pd, Point *q, double r) {
+   assert(pd != NULL && q != NULL && r >= 0);
+   return quadBallCountRec(pd, 0, ptGetx(q), ptGety(q), r * r);
+}
+
+static bool quadBoxVisitRec(PointDct *pd, size_t node, double xmin,
+                            double ymin, double xmax, double ymax,
+                            bool visit(void *value, void *ctx), void *ctx) {
+   QNode *n = &pd->nodes[node];
+   if (n->start == n->end || n->xmin > xmax || n->xmax < xmin ||
+       n->ymin > ymax || n->ymax < ymin)
+      return true;
+
+   bool inside = n->xmin >= xmin && n->xmax <= xmax && n->ymin >= ymin &&
+                 n->ymax <= ymax;
+   if (inside || n->child == 0) {
+      for (size_t i = n->start; i < n->end; i++) {
+         // (No need to test the positions of a box inside the query)
+         if ((inside || (pd->x[i] >= xmin && pd->x[i] <= xmax &&
+                         pd->y[i] >= ymin && pd->y[i] <= ymax)) &&
+             !visit(pd->values[i], ctx))
+            return false;
+      }
+      return true;
+   }
+   for (size_t c = n->child; c < n->child + 4; c++) {
+      if (!quadBoxVisitRec(pd, c, xmin, ymin, xmax, ymax, visit, ctx))
+         return false;
+   }
+   return true;
+}
+
+bool pdctBoxVisit(PointDct *pd, double xmin, double ymin, double xmax,
+                  double ymax, bool visit(void *value, void *ctx), void *ctx) {
+   assert(pd != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+   return quadBoxVisitRec(pd, 0, xmin, ymin, xmax, ymax, visit, ctx);
+}
+
+static void quadKnnRec(PointDct *pd, size_t node, double qx, double qy,
+                       KnnHeap *heap) {
+   QNode *n = &pd->nodes[node];
+   if (n->child == 0) {
+      for (size_t i = n->start; i < n->end; i++) {
+         double dx = pd->x[i] - qx;
+         double dy = pd->y[i] - qy;
+         knnOffer(heap, dx * dx + dy * dy, pd->values[i]);
+      }
+      return;
+   }
+
+   // Children sorted by distance of their box to q (insertion sort)
+   size_t order[4];
+   double dist[4];
+   for (int c = 0; c < 4; c++) {
+      double d = quadBoxSqrDistance(&pd->nodes[n->child + c], qx, qy);
+      int j = c;
+      while (j > 0 && dist[j - 1] > d) {
+         order[j] = order[j - 1];
+         dist[j] = dist[j - 1];
+         j--;
+      }
+      order[j] = n->child + c;
+      dist[j] = d;
+   }
+   for (int c = 0; c < 4 && dist[c] < knnBound(heap); c++)
+      quadKnnRec(pd, order[c], qx, qy, heap);
+}
+
+size_t pdctKnn(PointDct *pd, Point *q, size_t k, void **values,
+               double *dists) {
+   assert(pd != NULL && q != NULL);
+   KnnHeap heap;
+   knnInit(&heap, values, dists, k);
+   if (pd->size > 0 && k > 0) quadKnnRec(pd, 0, ptGetx(q), ptGety(q), &heap);
+   return knnFinish(&heap);
+}
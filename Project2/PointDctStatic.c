@@ -0,0 +1,28 @@
+/* ========================================================================= *
+ * PointDct definition (updates of the static implementations)
+ *
+ * The implementations that are built once by pdctCreate and never modified
+ * (all but BST2d) link this file: pdctRemove and pdctMove always fail.
+ * ========================================================================= */
+
+#include <stdbool.h>
+
+#include "Point.h"
+#include "PointDct.h"
+
+// Functions definitions
+
+bool pdctRemove(PointDct *pd, Point *p, void *value) {
+   (void)pd;
+   (void)p;
+   (void)value;
+   return false;
+}
+
+bool pdctMove(PointDct *pd, Point *p, void *value, Point *newp) {
+   (void)pd;
+   (void)p;
+   (void)value;
+   (void)newp;
+   return false;
+}
@@ -0,0 +1,220 @@
+/* ========================================================================= *
+ * PointHash definition
+ * ========================================================================= */
+
+#include "PointHash.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimal number of slots (a power of 2)
+#define PH_MIN_CAPACITY 16
+
+// Structures
+
+struct PointHash_t {
+   size_t size;     // Number of positions (of slots in use)
+   size_t capacity; // Number of slots (a power of 2), at least 2 * size
+   double *keysX;   // NaN in an empty slot
+   double *keysY;
+   void **values;
+   size_t *counts; // Number of pairs of the position of each slot
+};
+
+// Prototypes of static functions
+
+/**
+ * \brief Hash of a position, computed on the bit patterns of its
+ * coordinates (0.0 and -0.0, which compare equal, get the same hash)
+ *
+ * \param x x coordinate
+ * \param y y coordinate
+ * \return The hash
+ */
+static uint64_t phHash(double x, double y);
+
+/**
+ * \brief Allocate the slots of a hash table and mark them empty
+ *
+ * \param ph The hash table
+ * \param capacity The number of slots (a power of 2)
+ * \return false in case of allocation error
+ */
+static bool phAllocSlots(PointHash *ph, size_t capacity);
+
+/**
+ * \brief Double the number of slots and reinsert the positions
+ *
+ * \param ph The hash table
+ * \return false in case of allocation error (the table is unchanged)
+ */
+static bool phGrow(PointHash *ph);
+
+// Function definitions
+
+static uint64_t phHash(double x, double y) {
+   uint64_t bx, by;
+   x += 0.0; // -0.0 + 0.0 == 0.0
+   y += 0.0;
+   memcpy(&bx, &x, sizeof(bx));
+   memcpy(&by, &y, sizeof(by));
+
+   // Mix of the two patterns (finalizer of splitmix64)
+   uint64_t h = bx ^ (by * 0x9E3779B97F4A7C15ULL);
+   h ^= h >> 30;
+   h *= 0xBF58476D1CE4E5B9ULL;
+   h ^= h >> 27;
+   h *= 0x94D049BB133111EBULL;
+   h ^= h >> 31;
+   return h;
+}
+
+static bool phAllocSlots(PointHash *ph, size_t capacity) {
+   double *keysX = malloc(capacity * sizeof(double));
+   double *keysY = malloc(capacity * sizeof(double));
+   void **values = malloc(capacity * sizeof(void *));
+   size_t *counts = malloc(capacity * sizeof(size_t));
+   if (keysX == NULL || keysY == NULL || values == NULL || counts == NULL) {
+      printf("phAllocSlots: allocation error\n");
+      free(keysX);
+      free(keysY);
+      free(values);
+      free(counts);
+      return false;
+   }
+   for (size_t i = 0; i < capacity; i++)
+      keysX[i] = NAN;
+   ph->capacity = capacity;
+   ph->keysX = keysX;
+   ph->keysY = keysY;
+   ph->values = values;
+   ph->counts = counts;
+   return true;
+}
+
+PointHash *phNew(size_t n) {
+   PointHash *ph = malloc(sizeof(PointHash));
+   if (ph == NULL) {
+      printf("phNew: allocation error\n");
+      return NULL;
+   }
+   size_t capacity = PH_MIN_CAPACITY;
+   while (capacity < 2 * n)
+      capacity *= 2;
+   ph->size = 0;
+   if (!phAllocSlots(ph, capacity)) {
+      free(ph);
+      return NULL;
+   }
+   return ph;
+}
+
+void phFree(PointHash *ph) {
+   assert(ph != NULL);
+   free(ph->keysX);
+   free(ph->keysY);
+   free(ph->values);
+   free(ph->counts);
+   free(ph);
+}
+
+size_t phSize(PointHash *ph) {
+   assert(ph != NULL);
+   return ph->size;
+}
+
+static bool phGrow(PointHash *ph) {
+   PointHash old = *ph;
+   if (!phAllocSlots(ph, 2 * old.capacity)) return false;
+
+   // The positions are distinct: each one goes to the first empty slot of
+   // its probe sequence
+   size_t mask = ph->capacity - 1;
+   for (size_t j = 0; j < old.capacity; j++) {
+      if (isnan(old.keysX[j])) continue;
+      size_t i = phHash(old.keysX[j], old.keysY[j]) & mask;
+      while (!isnan(ph->keysX[i]))
+         i = (i + 1) & mask;
+      ph->keysX[i] = old.keysX[j];
+      ph->keysY[i] = old.keysY[j];
+      ph->values[i] = old.values[j];
+      ph->counts[i] = old.counts[j];
+   }
+   free(old.keysX);
+   free(old.keysY);
+   free(old.values);
+   free(old.counts);
+   return true;
+}
+
+bool phInsert(PointHash *ph, double x, double y, void *value) {
+   assert(ph != NULL && !isnan(x) && !isnan(y));
+   size_t mask = ph->capacity - 1;
+   size_t i = phHash(x, y) & mask;
+   for (; !isnan(ph->keysX[i]); i = (i + 1) & mask) {
+      if (ph->keysX[i] == x && ph->keysY[i] == y) {
+         ph->counts[i]++;
+         return true;
+      }
+   }
+
+   // New position: i is the empty slot ending its probe sequence, unless
+   // the table grows
+   if (2 * (ph->size + 1) > ph->capacity) {
+      if (!phGrow(ph)) return false;
+      mask = ph->capacity - 1;
+      i = phHash(x, y) & mask;
+      while (!isnan(ph->keysX[i]))
+         i = (i + 1) & mask;
+   }
+   ph->keysX[i] = x;
+   ph->keysY[i] = y;
+   ph->values[i] = value;
+   ph->counts[i] = 1;
+   ph->size++;
+   return true;
+}
+
+bool phRemove(PointHash *ph, double x, double y, void *first) {
+   assert(ph != NULL);
+   size_t mask = ph->capacity - 1;
+   size_t i = phHash(x, y) & mask;
+   while (ph->keysX[i] != x || ph->keysY[i] != y) {
+      if (isnan(ph->keysX[i])) return false;
+      i = (i + 1) & mask;
+   }
+   if (--ph->counts[i] > 0) {
+      ph->values[i] = first;
+      return true;
+   }
+
+   // Backward shift: the following slots of the cluster move into the hole
+   // when it is between their home slot and them (no tombstones needed)
+   size_t hole = i;
+   for (size_t j = (i + 1) & mask; !isnan(ph->keysX[j]);
+        j = (j + 1) & mask) {
+      size_t home = phHash(ph->keysX[j], ph->keysY[j]) & mask;
+      if (((j - home) & mask) < ((j - hole) & mask)) continue;
+      ph->keysX[hole] = ph->keysX[j];
+      ph->keysY[hole] = ph->keysY[j];
+      ph->values[hole] = ph->values[j];
+      ph->counts[hole] = ph->counts[j];
+      hole = j;
+   }
+   ph->keysX[hole] = NAN;
+   ph->size--;
+   return true;
+}
+
+void *phSearch(PointHash *ph, double x, double y) {
+   assert(ph != NULL);
+   size_t mask = ph->capacity - 1;
+   for (size_t i = phHash(x, y) & mask; !isnan(ph->keysX[i]);
+        i = (i + 1) & mask) {
+      if (ph->keysX[i] == x && ph->keysY[i] == y) return ph->values[i];
+   }
+   return NULL;
+}
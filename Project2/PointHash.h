@@ -0,0 +1,109 @@
+/* ========================================================================= *
+ * PointHash interface
+ * Hash table from positions (x,y) to values, used by the PointDct
+ * implementations for their exact searches. Open addressing with linear
+ * probing on the bit patterns of the coordinates; the keys are stored as
+ * two arrays of doubles (structure of arrays). A position has one slot,
+ * whatever its number of values: the slot keeps one value and counts the
+ * others, which the PointDct stores anyway.
+ * ========================================================================= */
+
+#ifndef _POINTHASH_H_
+#define _POINTHASH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Opaque Structure */
+typedef struct PointHash_t PointHash;
+
+/* ------------------------------------------------------------------------- *
+ * Creates an empty hash table.
+ *
+ * The PointHash must later be deleted by calling phFree().
+ *
+ * PARAMETERS
+ * n            The expected number of positions (the table grows if more
+ *              are inserted)
+ *
+ * RETURN
+ * ph           A pointer to the PointHash, or NULL in case of error
+ * ------------------------------------------------------------------------- */
+
+PointHash *phNew(size_t n);
+
+/* ------------------------------------------------------------------------- *
+ * Frees a hash table (but not its values).
+ *
+ * PARAMETERS
+ * ph           A valid pointer to a PointHash object
+ * ------------------------------------------------------------------------- */
+
+void phFree(PointHash *ph);
+
+/* ------------------------------------------------------------------------- *
+ * Returns the number of distinct positions in the hash table.
+ *
+ * PARAMETERS
+ * ph           A valid pointer to a PointHash object
+ *
+ * RETURN
+ * size         The number of positions
+ * ------------------------------------------------------------------------- */
+
+size_t phSize(PointHash *ph);
+
+/* ------------------------------------------------------------------------- *
+ * Inserts a position-value pair. A position may be inserted several times,
+ * with the same or different values: the value of a position already in
+ * the table is kept, and its number of pairs is incremented.
+ *
+ * PARAMETERS
+ * ph           A valid pointer to a PointHash object
+ * x            The x coordinate of the position (not NaN)
+ * y            The y coordinate of the position (not NaN)
+ * value        The value
+ *
+ * RETURN
+ * res          true on success, false in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+bool phInsert(PointHash *ph, double x, double y, void *value);
+
+/* ------------------------------------------------------------------------- *
+ * Removes one of the pairs of a position. The slot of the position is freed
+ * with its last pair, and otherwise its value is replaced by first.
+ *
+ * PARAMETERS
+ * ph           A valid pointer to a PointHash object
+ * x            The x coordinate of the position
+ * y            The y coordinate of the position
+ * first        The value of the position among its remaining pairs (the
+ *              table does not keep them: the caller finds it, for instance
+ *              in its own bucket of the position). Ignored if no pair
+ *              remains.
+ *
+ * RETURN
+ * res          true if a pair was removed, false if the position is not in
+ *              the table
+ * ------------------------------------------------------------------------- */
+
+bool phRemove(PointHash *ph, double x, double y, void *first);
+
+/* ------------------------------------------------------------------------- *
+ * Finds a value of a position.
+ *
+ * PARAMETERS
+ * ph           A valid pointer to a PointHash object
+ * x            The x coordinate of the position
+ * y            The y coordinate of the position
+ *
+ * RETURN
+ * value        The value of the position (the first inserted, or the last
+ *              one given to phRemove), or NULL if the position is not in
+ *              the table
+ * ------------------------------------------------------------------------- */
+
+void *phSearch(PointHash *ph, double x, double y);
+
+#endif // !_POINTHASH_H_
@@ -0,0 +1,193 @@
+/* ========================================================================= *
+ * PointKey definition
+ * ========================================================================= */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "KnnHeap.h"
+#include "Point.h"
+#include "PointKey.h"
+
+// Structures
+
+// Context of a ball search
+
+typedef struct Ball_t Ball;
+
+struct Ball_t {
+   double x;
+   double y;
+   double r2;
+   bool (*visit)(void *value, void *ctx);
+   void *ctx;
+};
+
+// Context of a box search (the keys visited are already in the x range)
+
+typedef struct Box_t Box;
+
+struct Box_t {
+   double ymin;
+   double ymax;
+   bool (*visit)(void *value, void *ctx);
+   void *ctx;
+};
+
+// Context of a k nearest neighbours search
+
+typedef struct Knn_t Knn;
+
+struct Knn_t {
+   double x;
+   double y;
+   KnnHeap heap;
+};
+
+// Functions prototypes
+
+/**
+ * \brief Visitor of the range search forwarding the values in the ball
+ *
+ * \param key Key of the element (a PointKey)
+ * \param value Value of the element
+ * \param ctx The Ball
+ * \return false if the visitor of the ball stopped
+ */
+static bool visitInBall(void *key, void *value, void *ctx);
+
+/**
+ * \brief Visitor of the range search forwarding the values in the box
+ *
+ * \param key Key of the element (a PointKey)
+ * \param value Value of the element
+ * \param ctx The Box
+ * \return false if the visitor of the box stopped
+ */
+static bool visitInBox(void *key, void *value, void *ctx);
+
+/**
+ * \brief Visitor of the range search offering the values to the heap of the
+ * k nearest neighbours
+ *
+ * \param key Key of the element (a PointKey)
+ * \param value Value of the element
+ * \param ctx The Knn
+ * \return false once the keys are too far along x
+ */
+static bool visitKnn(void *key, void *value, void *ctx);
+
+/**
+ * \brief Visitor counting the values
+ *
+ * \param value Value in the ball (unused)
+ * \param ctx Counter (size_t) to increment
+ * \return true
+ */
+static bool countValue(void *value, void *ctx);
+
+// Functions definitions
+
+int pkCompare(void *k1, void *k2) {
+   PointKey *key1 = (PointKey *)k1;
+   PointKey *key2 = (PointKey *)k2;
+   // Same order as ptCompare
+   if (key1->x != key2->x) return key1->x < key2->x ? -1 : +1;
+   if (key1->y != key2->y) return key1->y < key2->y ? -1 : +1;
+   return 0;
+}
+
+static bool visitInBall(void *key, void *value, void *ctx) {
+   PointKey *k = (PointKey *)key;
+   Ball *ball = (Ball *)ctx;
+
+   double dx = k->x - ball->x;
+   double dy = k->y - ball->y;
+   if (dx * dx + dy * dy > ball->r2) return true;
+   return ball->visit(value, ball->ctx);
+}
+
+bool pkBallVisit(PkRangeVisit range, void *set, Point *q, double r,
+                 bool visit(void *value, void *ctx), void *ctx) {
+   assert(range != NULL && q != NULL && r >= 0 && visit != NULL);
+
+   // First we get the points of the slab between q-r and q+r along x, then
+   // we filter the points that are not in the circle. x - r and x + r are
+   // rounded: the slab is widened by one ulp so that the points at distance
+   // exactly r are left to the filter, with the same arithmetic as it
+   Ball ball = {ptGetx(q), ptGety(q), r * r, visit, ctx};
+   PointKey minKey = {nextafter(ball.x - r, -INFINITY), -INFINITY};
+   PointKey maxKey = {nextafter(ball.x + r, INFINITY), INFINITY};
+
+   return range(set, &minKey, &maxKey, visitInBall, &ball);
+}
+
+static bool countValue(void *value, void *ctx) {
+   (void)value;
+   (*(size_t *)ctx)++;
+   return true;
+}
+
+size_t pkBallCount(PkRangeVisit range, void *set, Point *q, double r) {
+   size_t count = 0;
+   pkBallVisit(range, set, q, r, countValue, &count);
+   return count;
+}
+
+static bool visitInBox(void *key, void *value, void *ctx) {
+   PointKey *k = (PointKey *)key;
+   Box *box = (Box *)ctx;
+
+   if (k->y < box->ymin || k->y > box->ymax) return true;
+   return box->visit(value, box->ctx);
+}
+
+bool pkBoxVisit(PkRangeVisit range, void *set, double xmin, double ymin,
+                double xmax, double ymax, bool visit(void *value, void *ctx),
+                void *ctx) {
+   assert(range != NULL && xmin <= xmax && ymin <= ymax && visit != NULL);
+
+   // The keys between (xmin, ymin) and (xmax, ymax) in the order of
+   // ptCompare are those with xmin <= x <= xmax, except some with x equal
+   // to xmin or xmax that are outside the box anyway: only y is filtered
+   Box box = {ymin, ymax, visit, ctx};
+   PointKey minKey = {xmin, ymin};
+   PointKey maxKey = {xmax, ymax};
+
+   return range(set, &minKey, &maxKey, visitInBox, &box);
+}
+
+static bool visitKnn(void *key, void *value, void *ctx) {
+   PointKey *k = (PointKey *)key;
+   Knn *knn = (Knn *)ctx;
+
+   // Keys are visited by increasing x from q or in the slab left of q:
+   // once dx alone is too large, no further key can be closer
+   double dx = k->x - knn->x;
+   double dy = k->y - knn->y;
+   if (dx > 0 && dx * dx >= knnBound(&knn->heap)) return false;
+   knnOffer(&knn->heap, dx * dx + dy * dy, value);
+   return true;
+}
+
+size_t pkKnn(PkRangeVisit range, void *set, Point *q, size_t k,
+             void **values, double *dists) {
+   assert(range != NULL && q != NULL);
+
+   Knn knn = {ptGetx(q), ptGety(q), {NULL, NULL, 0, 0}};
+   knnInit(&knn.heap, values, dists, k);
+   if (k == 0) return 0;
+
+   // First the keys right of q, in increasing order, until they are too
+   // far along x. Then the keys left of q that are close enough along x
+   PointKey qKey = {knn.x, -INFINITY};
+   PointKey maxKey = {INFINITY, INFINITY};
+   range(set, &qKey, &maxKey, visitKnn, &knn);
+
+   PointKey minKey = {nextafter(knn.x - sqrt(knnBound(&knn.heap)), -INFINITY),
+                      -INFINITY};
+   range(set, &minKey, &qKey, visitKnn, &knn);
+   return knnFinish(&knn.heap);
+}
@@ -0,0 +1,132 @@
+/* ========================================================================= *
+ * PointKey interface
+ * Searches of the PointDct implementations that keep their points sorted
+ * by (x, y), in the order of ptCompare (BST, FrozenBST, BST template). A
+ * ball, box or k nearest neighbours search is turned into visits of
+ * ranges of keys, given by the implementation as a PkRangeVisit function.
+ * ========================================================================= */
+
+#ifndef _POINTKEY_H_
+#define _POINTKEY_H_
+
+#include "Point.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Structure (not opaque, so that the keys can live in arenas or on the
+ * stack): a copy of the coordinates of a point, so that the comparisons
+ * do not go through the Point objects */
+typedef struct PointKey_t PointKey;
+
+struct PointKey_t {
+   double x;
+   double y;
+};
+
+/* ------------------------------------------------------------------------- *
+ * Range visit of a sorted set of keys: calls visit on the elements whose
+ * key is in [keyMin, keyMax], in the order of pkCompare, until visit
+ * returns false (see bstRangeVisit()).
+ *
+ * PARAMETERS
+ * set          The set of keys of the implementation
+ * keyMin       Lower bound of the range (a PointKey, inclusive)
+ * keyMax       Upper bound of the range (a PointKey, inclusive)
+ * visit        Function called with the key (a PointKey), the value of each
+ *              element and ctx. Returns true to continue, false to stop.
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if the whole range was visited, false if visit stopped
+ * ------------------------------------------------------------------------- */
+
+typedef bool (*PkRangeVisit)(void *set, void *keyMin, void *keyMax,
+                             bool visit(void *key, void *value, void *ctx),
+                             void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Compares two keys in the order of ptCompare (x, then y).
+ *
+ * PARAMETERS
+ * k1, k2       Two valid pointers to PointKey objects
+ *
+ * RETURN
+ * res          -1, 0 or +1 if k1 is before, equal to or after k2
+ * ------------------------------------------------------------------------- */
+
+int pkCompare(void *k1, void *k2);
+
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values of the keys in a ball (see pdctBallVisit()).
+ *
+ * PARAMETERS
+ * range        The range visit of the set
+ * set          The set of keys
+ * q            Center of the ball
+ * r            Radius of the ball (r >= 0)
+ * visit        Function called with each value and ctx
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the values in the ball were visited
+ * ------------------------------------------------------------------------- */
+
+bool pkBallVisit(PkRangeVisit range, void *set, Point *q, double r,
+                 bool visit(void *value, void *ctx), void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Counts the keys in a ball (see pdctBallCount()).
+ *
+ * PARAMETERS
+ * range        The range visit of the set
+ * set          The set of keys
+ * q            Center of the ball
+ * r            Radius of the ball (r >= 0)
+ *
+ * RETURN
+ * nb           The number of keys in the ball
+ * ------------------------------------------------------------------------- */
+
+size_t pkBallCount(PkRangeVisit range, void *set, Point *q, double r);
+
+/* ------------------------------------------------------------------------- *
+ * Calls visit on the values of the keys in the box [xmin, xmax] x
+ * [ymin, ymax] (see pdctBoxVisit()).
+ *
+ * PARAMETERS
+ * range        The range visit of the set
+ * set          The set of keys
+ * xmin, ymin   Lower bounds of the box
+ * xmax, ymax   Upper bounds of the box
+ * visit        Function called with each value and ctx
+ * ctx          Pointer passed as is to visit
+ *
+ * RETURN
+ * res          true if all the values in the box were visited
+ * ------------------------------------------------------------------------- */
+
+bool pkBoxVisit(PkRangeVisit range, void *set, double xmin, double ymin,
+                double xmax, double ymax, bool visit(void *value, void *ctx),
+                void *ctx);
+
+/* ------------------------------------------------------------------------- *
+ * Finds the k keys closest to q (see pdctKnn()): first the keys right of q
+ * in increasing order, until they are too far along x, then the keys of
+ * the slab left of q that are close enough along x.
+ *
+ * PARAMETERS
+ * range        The range visit of the set
+ * set          The set of keys
+ * q            The query point
+ * k            The number of neighbours searched
+ * values       Array of at least k pointers, set to the values found
+ * dists        Array of at least k doubles, set to their distances
+ *
+ * RETURN
+ * nb           The number of neighbours found (min(k, size of the set))
+ * ------------------------------------------------------------------------- */
+
+size_t pkKnn(PkRangeVisit range, void *set, Point *q, size_t k,
+             void **values, double *dists);
+
+#endif // !_POINTKEY_H_
@@ -0,0 +1,251 @@
+/* ========================================================================= *
+ * Concurrent inserts and reads on the skip list implementation of BST.h
+ * (BSTSkipList.c): writer threads insert keys while reader threads search
+ * the keys already inserted and visit ranges, then the content is checked
+ * ========================================================================= */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "BST.h"
+#include "List.h"
+
+#define NWRITERS 8
+#define NKEYS 50000
+#define NREADERS 2
+#define KEYMAX 1000000
+#define RANGE 1000
+
+// State shared by the threads
+
+typedef struct Shared_t Shared;
+
+struct Shared_t {
+   BST *bst;
+   int *keys;      // keys[i] is inserted with the value &keys[i]
+   size_t nkeys;   // Keys per writer: writer w inserts keys[w * nkeys...]
+   size_t nwriters;
+   size_t *counts; // counts[w]: keys inserted by writer w (atomic)
+   int done;       // Set once the writers are done (atomic)
+};
+
+typedef struct Writer_t Writer;
+
+struct Writer_t {
+   Shared *shared;
+   size_t id;
+};
+
+typedef struct Reader_t Reader;
+
+struct Reader_t {
+   Shared *shared;
+   unsigned long seed; // State of the random generator of the thread
+   size_t nsearches;
+   size_t nvisits;
+   bool error;
+};
+
+// Bounds of a range visit, and the last key visited
+
+typedef struct Range_t Range;
+
+struct Range_t {
+   int min;
+   int max;
+   int last;
+   bool error;
+};
+
+// Comparison of the keys (int)
+static int compareInt(void *a, void *b) {
+   int x = *(int *)a, y = *(int *)b;
+   return (x > y) - (x < y);
+}
+
+// Wall-clock time in seconds (clock() sums the times of all the threads)
+static double wallTime(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Random number of a thread (rand() has a shared state)
+static size_t nextRandom(unsigned long *seed) {
+   *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+   return (size_t)(*seed >> 33);
+}
+
+// Visitor checking that the keys are in the range and in increasing order
+static bool checkRange(void *key, void *value, void *ctx) {
+   Range *range = ctx;
+   int k = *(int *)key;
+   if (k < range->min || k > range->max || k < range->last ||
+       value != key)
+      range->error = true;
+   range->last = k;
+   return true;
+}
+
+static void *writerTask(void *arg) {
+   Writer *writer = arg;
+   Shared *shared = writer->shared;
+   int *keys = shared->keys + writer->id * shared->nkeys;
+   for (size_t i = 0; i < shared->nkeys; i++) {
+      if (!bstInsert(shared->bst, &keys[i], &keys[i])) {
+         printf("  Error: insertion failed\n");
+         break;
+      }
+      // The readers may search the keys counted once they are inserted
+      __atomic_store_n(&shared->counts[writer->id], i + 1, __ATOMIC_RELEASE);
+   }
+   return NULL;
+}
+
+static void *readerTask(void *arg) {
+   Reader *reader = arg;
+   Shared *shared = reader->shared;
+   while (!__atomic_load_n(&shared->done, __ATOMIC_ACQUIRE)) {
+      // A key whose insertion completed must be found
+      size_t w = nextRandom(&reader->seed) % shared->nwriters;
+      size_t count = __atomic_load_n(&shared->counts[w], __ATOMIC_ACQUIRE);
+      if (count > 0) {
+         int *key = &shared->keys[w * shared->nkeys +
+                                  nextRandom(&reader->seed) % count];
+         int *value = bstSearch(shared->bst, key);
+         if (value == NULL || *value != *key) reader->error = true;
+         reader->nsearches++;
+      }
+
+      // The keys being inserted may or may not be visited, but the range
+      // remains sorted
+      int min = (int)(nextRandom(&reader->seed) % KEYMAX);
+      Range range = {min, min + RANGE, INT_MIN, false};
+      bstRangeVisit(shared->bst, &range.min, &range.max, checkRange, &range);
+      if (range.error) reader->error = true;
+      reader->nvisits++;
+   }
+   return NULL;
+}
+
+int main(int argc, char **argv) {
+
+   size_t nwriters = NWRITERS;
+   size_t nkeys = NKEYS;
+   size_t nreaders = NREADERS;
+
+   srand(time(NULL));
+
+   if (argc > 1) nwriters = atoi(argv[1]);
+   if (argc > 2) nkeys = atoi(argv[2]);
+   if (argc > 3) nreaders = atoi(argv[3]);
+   if (nwriters == 0) nwriters = 1;
+
+   size_t ntotal = nwriters * nkeys;
+   Shared shared;
+   shared.bst = bstNew(compareInt);
+   shared.keys = malloc((ntotal > 0 ? ntotal : 1) * sizeof(int));
+   shared.nkeys = nkeys;
+   shared.nwriters = nwriters;
+   shared.counts = calloc(nwriters, sizeof(size_t));
+   shared.done = 0;
+   Writer *writers = malloc(nwriters * sizeof(Writer));
+   Reader *readers = malloc((nreaders > 0 ? nreaders : 1) * sizeof(Reader));
+   pthread_t *threads = malloc((nwriters + nreaders) * sizeof(pthread_t));
+   if (!shared.bst || !shared.keys || !shared.counts || !writers ||
+       !readers || !threads) {
+      fprintf(stderr, "Allocation error. Exiting...\n");
+      exit(EXIT_FAILURE);
+   }
+   for (size_t i = 0; i < ntotal; i++)
+      shared.keys[i] = rand() % KEYMAX;
+
+   //****************************
+   // Concurrent inserts and reads
+
+   printf("Testing concurrent inserts and reads:\n");
+   printf("   %zu writers inserting %zu keys each, %zu readers...", nwriters,
+          nkeys, nreaders);
+   fflush(stdout);
+   bool error = false;
+
+   double start = wallTime();
+   size_t nreaderThreads = 0;
+   for (size_t r = 0; r < nreaders; r++) {
+      readers[r] = (Reader){&shared, (unsigned long)rand() + r, 0, 0, false};
+      if (pthread_create(&threads[nreaderThreads], NULL, readerTask,
+                         &readers[r]) == 0)
+         nreaderThreads++;
+   }
+   size_t nwriterThreads = 0;
+   for (size_t w = 0; w < nwriters; w++) {
+      writers[w] = (Writer){&shared, w};
+      if (pthread_create(&threads[nreaderThreads + nwriterThreads], NULL,
+                         writerTask, &writers[w]) != 0)
+         writerTask(&writers[w]); // Inserted by this thread instead
+      else
+         nwriterThreads++;
+   }
+   for (size_t t = 0; t < nwriterThreads; t++)
+      pthread_join(threads[nreaderThreads + t], NULL);
+   __atomic_store_n(&shared.done, 1, __ATOMIC_RELEASE);
+   for (size_t t = 0; t < nreaderThreads; t++)
+      pthread_join(threads[t], NULL);
+   double end = wallTime();
+   printf("Done in %fs (wall-clock)\n", end - start);
+
+   size_t nsearches = 0, nvisits = 0;
+   for (size_t r = 0; r < nreaderThreads; r++) {
+      nsearches += readers[r].nsearches;
+      nvisits += readers[r].nvisits;
+      if (readers[r].error) {
+         printf("  Error: a reader saw a missing key or an unsorted range\n");
+         error = true;
+      }
+   }
+   printf("   %zu searches and %zu range visits by the readers\n", nsearches,
+          nvisits);
+
+   //****************************
+   // Content once the writers are done
+
+   printf("   Checking the %zu keys...", ntotal);
+   fflush(stdout);
+   bool content = bstSize(shared.bst) == ntotal;
+   int min = INT_MIN, max = INT_MAX;
+   List *l = bstRangeSearch(shared.bst, &min, &max);
+   content = content && l != NULL && listSize(l) == ntotal;
+   int last = INT_MIN;
+   for (LNode *p = l ? l->head : NULL; content && p != NULL; p = p->next) {
+      content = *(int *)p->value >= last;
+      last = *(int *)p->value;
+   }
+   for (size_t i = 0; content && i < ntotal; i++) {
+      int *value = bstSearch(shared.bst, &shared.keys[i]);
+      content = value != NULL && *value == shared.keys[i];
+   }
+   printf("Done\n");
+   if (!content) {
+      printf("  Error: wrong content after the inserts\n");
+      error = true;
+   }
+   if (error) printf("   Warning: there were some errors\n");
+
+   //****************************
+   // Free
+
+   if (l != NULL) listFree(l, false);
+   bstFree(shared.bst, false, false);
+   free(shared.keys);
+   free(shared.counts);
+   free(writers);
+   free(readers);
+   free(threads);
+   return error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,11 +2,16 @@
  * Compute CPU times on random points for a PointDct implementation
  * ========================================================================= */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "List.h"
 #include "Point.h"
@@ -15,6 +20,8 @@
 #define N 1000
 #define NSEARCH 1000
 #define RADIUS 0.1
+#define NCHECK 100 // Searches compared with a scan of the points
+#define GRID 16    // Steps of the grid of the tie-heavy points
 
 typedef struct Data_t Data;
 
@@ -22,6 +29,135 @@ struct Data_t {
    Point *point;
 };
 
+// Wall-clock time in seconds (clock() sums the times of all the threads)
+static double wallTime(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Order of the values by address
+static int compareAddresses(const void *a, const void *b) {
+   uintptr_t va = (uintptr_t) * (void *const *)a;
+   uintptr_t vb = (uintptr_t) * (void *const *)b;
+   return va < vb ? -1 : va > vb;
+}
+
+// The values of a list sorted by address, to compare results that do not
+// come in the same order (NULL in case of allocation error)
+static void **sortedValues(List *l) {
+   void **values = malloc((listSize(l) > 0 ? listSize(l) : 1) *
+                          sizeof(void *));
+   if (values == NULL) return NULL;
+   size_t n = 0;
+   for (LNode *p = l->head; p != NULL; p = p->next)
+      values[n++] = p->value;
+   qsort(values, n, sizeof(void *), compareAddresses);
+   return values;
+}
+
+// Whether two results of a search hold the same values
+static bool sameValues(List *l1, List *l2) {
+   if (listSize(l1) != listSize(l2)) return false;
+   void **v1 = sortedValues(l1);
+   void **v2 = sortedValues(l2);
+   bool same = v1 != NULL && v2 != NULL;
+   for (size_t i = 0; same && i < listSize(l1); i++)
+      same = v1[i] == v2[i];
+   free(v1);
+   free(v2);
+   return same;
+}
+
+// Whether two results of a search for values that are identifiers (size_t)
+// hold the same identifiers. The values of the two lists may be in
+// different copies of the identifiers, in the same order.
+static bool sameIds(List *l1, List *l2) {
+   if (listSize(l1) != listSize(l2)) return false;
+   void **v1 = sortedValues(l1);
+   void **v2 = sortedValues(l2);
+   bool same = v1 != NULL && v2 != NULL;
+   for (size_t i = 0; same && i < listSize(l1); i++)
+      same = *(size_t *)v1[i] == *(size_t *)v2[i];
+   free(v1);
+   free(v2);
+   return same;
+}
+
+// Whether the ball search and count of pd agree with a scan of the n
+// points, inserted with the values
+static bool checkBall(PointDct *pd, Point **points, Data **values, size_t n,
+                      Point *q, double r) {
+   List *expected = listNew();
+   for (size_t i = 0; i < n; i++) {
+      double dx = ptGetx(points[i]) - ptGetx(q);
+      double dy = ptGety(points[i]) - ptGety(q);
+      if (dx * dx + dy * dy <= r * r) listInsertLast(expected, values[i]);
+   }
+   List *l = pdctBallSearch(pd, q, r);
+   bool same = l != NULL && sameValues(l, expected) &&
+               pdctBallCount(pd, q, r) == listSize(expected);
+   if (l != NULL) listFree(l, false);
+   listFree(expected, false);
+   return same;
+}
+
+// Whether the box search of pd agrees with a scan of the n points, inserted
+// with the values (the box is closed)
+static bool checkBox(PointDct *pd, Point **points, Data **values, size_t n,
+                     double xmin, double ymin, double xmax, double ymax) {
+   List *expected = listNew();
+   for (size_t i = 0; i < n; i++) {
+      double x = ptGetx(points[i]), y = ptGety(points[i]);
+      if (x >= xmin && x <= xmax && y >= ymin && y <= ymax)
+         listInsertLast(expected, values[i]);
+   }
+   List *l = pdctBoxSearch(pd, xmin, ymin, xmax, ymax);
+   bool same = l != NULL && sameValues(l, expected);
+   if (l != NULL) listFree(l, false);
+   listFree(expected, false);
+   return same;
+}
+
+// Increasing order of doubles
+static int compareDoubles(const void *a, const void *b) {
+   double da = *(const double *)a, db = *(const double *)b;
+   return (da > db) - (da < db);
+}
+
+// Distance from a point to q, with the arithmetic of the dictionaries
+static double distance(Point *p, Point *q) {
+   double dx = ptGetx(p) - ptGetx(q);
+   double dy = ptGety(p) - ptGety(q);
+   return sqrt(dx * dx + dy * dy);
+}
+
+// Whether the k nearest neighbours found by pd are at the k smallest
+// distances of a scan of the n points (the neighbours kept among ties may
+// differ), and at the distances given
+static bool checkKnn(PointDct *pd, Point **points, size_t n, Point *q,
+                     size_t k) {
+   double *expected = malloc((n > 0 ? n : 1) * sizeof(double));
+   void **values = malloc((k > 0 ? k : 1) * sizeof(void *));
+   double *dists = malloc((k > 0 ? k : 1) * sizeof(double));
+   bool same = expected != NULL && values != NULL && dists != NULL;
+   if (same) {
+      for (size_t i = 0; i < n; i++)
+         expected[i] = distance(points[i], q);
+      qsort(expected, n, sizeof(double), compareDoubles);
+      size_t found = pdctKnn(pd, q, k, values, dists);
+      same = found == (k < n ? k : n);
+      for (size_t j = 0; same && j < found; j++) {
+         same = dists[j] == expected[j] &&
+                distance(((Data *)values[j])->point, q) == dists[j];
+      }
+   }
+   free(expected);
+   free(values);
+   free(dists);
+   return same;
+}
+
 int main(int argc, char **argv) {
 
    size_t npoints = N;
@@ -61,6 +197,30 @@ int main(int argc, char **argv) {
    }
    printf("Done\n");
 
+   // Positions on a grid, each one inserted 1 to 3 times: queries on the
+   // grid have many points at the same distance, computed exactly
+   size_t ngrid = npoints < 1000 ? npoints : 1000;
+   printf("   Generating %zu points on a grid...", ngrid);
+   Point **gp = malloc((3 * ngrid > 0 ? 3 * ngrid : 1) * sizeof(Point *));
+   Data **gv = malloc((3 * ngrid > 0 ? 3 * ngrid : 1) * sizeof(Data *));
+   size_t ngridTotal = 0;
+   List *gpoints = listNew();
+   List *gvalues = listNew();
+
+   for (size_t i = 0; i < ngrid; i++) {
+      Data *d = malloc(sizeof(Data));
+      d->point = ptNew((double)(rand() % GRID) / GRID,
+                       (double)(rand() % GRID) / GRID);
+      for (size_t c = 0; c <= i % 3; c++) {
+         gp[ngridTotal] = d->point;
+         gv[ngridTotal++] = d;
+         listInsertLast(gpoints, d->point);
+         listInsertLast(gvalues, d);
+      }
+   }
+   PointDct *gpd = pdctCreate(gpoints, gvalues);
+   printf("Done\n");
+
    //****************************
    // Create dictionary
 
@@ -113,6 +273,63 @@ int main(int argc, char **argv) {
 
    if (error) printf("   Warning: there were some errors\n");
 
+   printf("   %zu searches of all the values of a position...", nsearch);
+   error = false;
+   start = clock();
+   for (size_t i = 0; i < nsearch && !error; i++) {
+      size_t rp = (size_t)rand() % npoints;
+      List *l = pdctExactSearchAll(pd, lp[rp]);
+      bool found = false;
+      for (LNode *p = l ? l->head : NULL; p != NULL; p = p->next) {
+         found = found || p->value == lv[rp];
+         if (ptCompare(((Data *)p->value)->point, lp[rp]) != 0) error = true;
+      }
+      if (l == NULL || !found || error) {
+         printf("  Error: wrong values of a position\n");
+         error = true;
+      }
+      if (l != NULL) listFree(l, false);
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   if (error) printf("   Warning: there were some errors\n");
+
+   // Positions with several values (point i inserted 1 + i % 3 times),
+   // compared with a scan of the pairs
+   size_t ndup = npoints < 1000 ? npoints : 1000;
+   printf("   Searches at %zu positions with duplicates...", ndup);
+   error = false;
+   List *dpoints = listNew();
+   List *dvalues = listNew();
+   for (size_t i = 0; i < ndup; i++) {
+      for (size_t c = 0; c <= i % 3; c++) {
+         listInsertLast(dpoints, lp[i]);
+         listInsertLast(dvalues, lv[i]);
+      }
+   }
+   PointDct *dpd = pdctCreate(dpoints, dvalues);
+   start = clock();
+   for (size_t i = 0; dpd != NULL && i < ndup && !error; i++) {
+      size_t expected = 0;
+      for (LNode *p = dpoints->head; p != NULL; p = p->next)
+         expected += ptCompare(p->value, lp[i]) == 0;
+      List *l = pdctExactSearchAll(dpd, lp[i]);
+      if (l == NULL || listSize(l) != expected) error = true;
+      for (LNode *p = l ? l->head : NULL; p != NULL; p = p->next) {
+         if (ptCompare(((Data *)p->value)->point, lp[i]) != 0) error = true;
+      }
+      if (l != NULL) listFree(l, false);
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   if (dpd == NULL || error) {
+      printf("  Error: wrong number of values of a position\n");
+      printf("   Warning: there were some errors\n");
+   }
+   if (dpd != NULL) pdctFree(dpd);
+   listFree(dpoints, false);
+   listFree(dvalues, false);
+
    //****************************
    // Ball searches
 
@@ -131,6 +348,323 @@ int main(int argc, char **argv) {
    printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
    printf("   Average list size: %f\n", avgsize);
 
+   printf("   %zu ball searches into a buffer...", nsearch);
+   void **buf = malloc(npoints * sizeof(void *));
+   avgsize = 0;
+
+   start = clock();
+   for (size_t i = npoints; i < ntotal; i++) {
+      size_t n;
+      if (!pdctBallSearchInto(pd, lp[i], radius, buf, npoints, &n)) {
+         printf("  Error: the buffer was too small\n");
+         error = true;
+      }
+      avgsize += (double)n / (double)nsearch;
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   printf("   Average number of values: %f\n", avgsize);
+   if (error) printf("   Warning: there were some errors\n");
+   free(buf);
+
+   printf("   %zu ball counts...", nsearch);
+   avgsize = 0;
+
+   start = clock();
+   for (size_t i = npoints; i < ntotal; i++) {
+      avgsize += (double)pdctBallCount(pd, lp[i], radius) / (double)nsearch;
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   printf("   Average count: %f\n", avgsize);
+
+   // Radii of the grid queries from 0 to 5 steps, with points on the circles
+   size_t ncheck = nsearch < NCHECK ? nsearch : NCHECK;
+   printf("   %zu ball searches and counts checked against a scan...", ncheck);
+   error = gpd == NULL;
+   for (size_t i = 0; i < ncheck && !error; i++) {
+      error = !checkBall(pd, lp, lv, npoints, lp[npoints + i], radius) ||
+              (ngridTotal > 0 &&
+               !checkBall(gpd, gp, gv, ngridTotal, gp[i % ngridTotal],
+                          (double)(i % 6) / GRID));
+   }
+   printf("Done\n");
+   if (error) {
+      printf("  Error: different from the scan of the points\n");
+      printf("   Warning: there were some errors\n");
+   }
+
+   //****************************
+   // Box searches
+
+   printf("\nTesting box searches:\n");
+   printf("   %zu searches of boxes of side %f...", nsearch, 2 * radius);
+   avgsize = 0;
+
+   start = clock();
+   for (size_t i = npoints; i < ntotal; i++) {
+      double x = ptGetx(lp[i]), y = ptGety(lp[i]);
+      List *l = pdctBoxSearch(pd, x - radius, y - radius, x + radius,
+                              y + radius);
+      avgsize += (double)listSize(l) / (double)nsearch;
+      listFree(l, false);
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   printf("   Average list size: %f\n", avgsize);
+
+   // Sides of the grid boxes from 0 to 6 steps, with points on the edges
+   printf("   %zu box searches checked against a scan...", ncheck);
+   error = gpd == NULL;
+   for (size_t i = 0; i < ncheck && !error; i++) {
+      double x = ptGetx(lp[npoints + i]), y = ptGety(lp[npoints + i]);
+      error = !checkBox(pd, lp, lv, npoints, x - radius, y - radius,
+                        x + radius, y + radius);
+      if (!error && ngridTotal > 0) {
+         x = ptGetx(gp[i % ngridTotal]);
+         y = ptGety(gp[i % ngridTotal]);
+         error = !checkBox(gpd, gp, gv, ngridTotal,
+                           x - (double)(i % 3) / GRID,
+                           y - (double)(i % 4) / GRID,
+                           x + (double)(i % 4) / GRID,
+                           y + (double)(i % 3) / GRID);
+      }
+   }
+   printf("Done\n");
+   if (error) {
+      printf("  Error: different from the scan of the points\n");
+      printf("   Warning: there were some errors\n");
+   }
+
+   //****************************
+   // k nearest neighbours
+
+   size_t k = 10;
+   void *knnValues[10];
+   double knnDists[10];
+   printf("\nTesting k nearest neighbours searches:\n");
+   printf("   %zu searches of the %zu nearest neighbours...", nsearch, k);
+   double avgdist = 0;
+
+   start = clock();
+   for (size_t i = npoints; i < ntotal; i++) {
+      size_t n = pdctKnn(pd, lp[i], k, knnValues, knnDists);
+      if (n > 0) avgdist += knnDists[n - 1] / (double)nsearch;
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   printf("   Average distance of the k-th neighbour: %f\n", avgdist);
+
+   printf("   %zu searches checked against a scan...", ncheck);
+   error = gpd == NULL;
+   for (size_t i = 0; i < ncheck && !error; i++) {
+      error = !checkKnn(pd, lp, npoints, lp[npoints + i], k) ||
+              (ngridTotal > 0 &&
+               !checkKnn(gpd, gp, ngridTotal, gp[i % ngridTotal], k));
+   }
+   printf("Done\n");
+   if (error) {
+      printf("  Error: different from the scan of the points\n");
+      printf("   Warning: there were some errors\n");
+   }
+
+   //****************************
+   // Batches of searches on all the processors
+
+   printf("\nTesting batches of searches:\n");
+   printf("   %zu positive searches in a batch...", nsearch);
+   error = false;
+   void **exactResults = malloc(nsearch * sizeof(void *));
+
+   double wstart = wallTime();
+   if (!pdctExactSearchBatch(pd, lp, nsearch, exactResults, 0))
+      error = true;
+   double wend = wallTime();
+   printf("Done in %fs (wall-clock)\n", wend - wstart);
+   for (size_t i = 0; !error && i < nsearch; i++) {
+      if (exactResults[i] != lv[i % npoints]) {
+         printf("  Error: associated data is wrong\n");
+         error = true;
+      }
+   }
+   if (error) printf("   Warning: there were some errors\n");
+   free(exactResults);
+
+   printf("   %zu ball searches in a batch...", nsearch);
+   error = false;
+   double *radii = malloc(nsearch * sizeof(double));
+   List **ballResults = malloc(nsearch * sizeof(List *));
+   for (size_t i = 0; i < nsearch; i++)
+      radii[i] = radius;
+   avgsize = 0;
+
+   wstart = wallTime();
+   if (!pdctBallSearchBatch(pd, lp + npoints, radii, nsearch, ballResults,
+                            0))
+      error = true;
+   wend = wallTime();
+   printf("Done in %fs (wall-clock)\n", wend - wstart);
+   for (size_t i = 0; !error && i < nsearch; i++) {
+      avgsize += (double)listSize(ballResults[i]) / (double)nsearch;
+      List *l = pdctBallSearch(pd, lp[npoints + i], radius);
+      if (!sameValues(ballResults[i], l)) {
+         printf("  Error: different from the sequential search\n");
+         error = true;
+      }
+      listFree(l, false);
+   }
+   for (size_t i = 0; i < nsearch && ballResults[i] != NULL; i++)
+      listFree(ballResults[i], false);
+   printf("   Average list size: %f\n", avgsize);
+   if (error) printf("   Warning: there were some errors\n");
+   free(radii);
+   free(ballResults);
+
+   // Empty batches come without arrays
+   printf("   Empty batches...");
+   error = !pdctExactSearchBatch(pd, NULL, 0, NULL, 2) ||
+           !pdctBallSearchBatch(pd, NULL, NULL, 0, NULL, 2);
+   printf("Done\n");
+   if (error) printf("  Error: an empty batch failed\n");
+
+   //****************************
+   // Snapshots
+
+   printf("\nTesting snapshots:\n");
+   printf("   Saving and mapping %zu points...", npoints);
+   fflush(stdout);
+   error = false;
+
+   // The values of a snapshot must lie in one block: identifiers of the
+   // points, read back from the copy of the block in the file
+   size_t *ids = malloc((npoints > 0 ? npoints : 1) * sizeof(size_t));
+   List *lids = listNew();
+   for (size_t i = 0; i < npoints; i++) {
+      ids[i] = i;
+      listInsertLast(lids, &ids[i]);
+   }
+   PointDct *spd = pdctCreate(lpoints, lids);
+   char path[] = "pdctsnapshotXXXXXX";
+   int fd = mkstemp(path);
+   if (fd >= 0) close(fd);
+
+   start = clock();
+   bool saved = spd != NULL && fd >= 0 &&
+                pdctSave(spd, path, ids, npoints * sizeof(size_t));
+   const void *block = NULL;
+   size_t blockSize = 0;
+   PointDct *mpd = saved ? pdctLoadMapped(path, &block, &blockSize) : NULL;
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+   if (!saved) {
+      printf("   Not supported by this dictionary\n");
+   } else if (mpd == NULL) {
+      printf("  Error: the snapshot could not be mapped\n");
+      error = true;
+   } else {
+      if (pdctSize(mpd) != npoints || blockSize != npoints * sizeof(size_t)) {
+         printf("  Error: wrong size of the mapped dictionary\n");
+         error = true;
+      }
+      for (size_t i = 0; !error && i < nsearch && npoints > 0; i++) {
+         size_t rp = (size_t)rand() % npoints;
+         size_t *val = pdctExactSearch(mpd, lp[rp]);
+         if (val == NULL || *val != rp) {
+            printf("  Error: wrong value of a mapped point\n");
+            error = true;
+         }
+      }
+      for (size_t i = npoints; !error && i < ntotal; i++) {
+         List *l1 = pdctBallSearch(spd, lp[i], radius);
+         List *l2 = pdctBallSearch(mpd, lp[i], radius);
+         if (!sameIds(l1, l2)) {
+            printf("  Error: different ball searches once mapped\n");
+            error = true;
+         }
+         listFree(l1, false);
+         listFree(l2, false);
+
+         void *values2[10];
+         double dists2[10];
+         size_t n1 = pdctKnn(spd, lp[i], k, knnValues, knnDists);
+         size_t n2 = pdctKnn(mpd, lp[i], k, values2, dists2);
+         for (size_t j = 0; !error && j < n1; j++) {
+            if (n1 != n2 || knnDists[j] != dists2[j] ||
+                *(size_t *)knnValues[j] != *(size_t *)values2[j]) {
+               printf("  Error: different neighbours once mapped\n");
+               error = true;
+            }
+         }
+      }
+      pdctFree(mpd);
+
+      // The header is checked against the size of the file
+      printf("   Mapping truncated, empty and missing files...\n");
+      struct stat st;
+      if (stat(path, &st) != 0 || truncate(path, st.st_size / 2) != 0 ||
+          (mpd = pdctLoadMapped(path, NULL, NULL)) != NULL ||
+          truncate(path, 0) != 0 ||
+          (mpd = pdctLoadMapped(path, NULL, NULL)) != NULL ||
+          unlink(path) != 0 ||
+          (mpd = pdctLoadMapped(path, NULL, NULL)) != NULL) {
+         printf("  Error: an invalid snapshot was not rejected\n");
+         if (mpd != NULL) pdctFree(mpd);
+         error = true;
+      }
+   }
+   if (error) printf("   Warning: there were some errors\n");
+   unlink(path);
+   if (spd != NULL) pdctFree(spd);
+   listFree(lids, false);
+   free(ids);
+
+   //****************************
+   // Moves and removals
+
+   printf("\nTesting moves and removals:\n");
+   size_t nmove = nsearch < npoints ? nsearch : npoints;
+   printf("   %zu moves...", nmove);
+   error = false;
+   start = clock();
+   for (size_t i = 0; i < nmove; i++) {
+      // (The points after npoints are not in the dictionary)
+      if (!pdctMove(pd, lp[i], lv[i], lp[npoints + i])) {
+         error = true;
+         break;
+      }
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   if (error) {
+      printf("   Not supported by this dictionary\n");
+   } else {
+      for (size_t i = 0; i < nmove; i++) {
+         if (pdctExactSearch(pd, lp[npoints + i]) != lv[i]) {
+            printf("  Error: a moved point was not found\n");
+            error = true;
+            break;
+         }
+      }
+
+      printf("   %zu removals...", nmove);
+      start = clock();
+      for (size_t i = 0; i < nmove; i++) {
+         if (!pdctRemove(pd, lp[npoints + i], lv[i])) {
+            printf("  Error: a moved point could not be removed\n");
+            error = true;
+            break;
+         }
+      }
+      end = clock();
+      printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+      if (pdctSize(pd) != npoints - nmove) {
+         printf("  Error: wrong size after the removals\n");
+         error = true;
+      }
+      if (error) printf("   Warning: there were some errors\n");
+   }
+
    //****************************
    // Average Node Depth
 
@@ -153,6 +687,18 @@ int main(int argc, char **argv) {
    pdctFree(pd);
    listFree(lpoints, false);
    listFree(lvalues, false);
+
+   if (gpd != NULL) pdctFree(gpd);
+   for (size_t i = 0; i < ngridTotal; i++) {
+      if (i == 0 || gv[i] != gv[i - 1]) {
+         ptFree(gp[i]);
+         free(gv[i]);
+      }
+   }
+   listFree(gpoints, false);
+   listFree(gvalues, false);
+   free(gp);
+   free(gv);
    for (size_t i = 0; i < ntotal; i++) {
       ptFree(lp[i]);
       free(lv[i]);
@@ -0,0 +1,140 @@
+/* ========================================================================= *
+ * Check the range cursors of a BST implementation against a brute-force
+ * scan of its keys: random ranges, bounded or not (NULL bounds), by
+ * increasing and decreasing keys, read in full or only partly
+ * ========================================================================= */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "BST.h"
+
+#define N 100000
+#define NCURSORS 1000
+#define KEYMAX 10000 // Small enough for duplicate keys
+
+// Comparison of the keys (int)
+static int compareInt(void *a, void *b) {
+   int x = *(int *)a, y = *(int *)b;
+   return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+
+   size_t nkeys = N;
+   size_t ncursors = NCURSORS;
+   clock_t start, end;
+
+   srand(time(NULL));
+
+   if (argc > 1) nkeys = atoi(argv[1]);
+   if (argc > 2) ncursors = atoi(argv[2]);
+
+   //****************************
+   // Create the BST (keys[i] is inserted with the value &keys[i])
+
+   printf("Preparation:\n");
+   printf("   Inserting %zu keys...", nkeys);
+   int *keys = malloc((nkeys > 0 ? nkeys : 1) * sizeof(int));
+   bool *seen = malloc((nkeys > 0 ? nkeys : 1) * sizeof(bool));
+   BST *bst = bstNew(compareInt);
+   if (!keys || !seen || !bst) {
+      fprintf(stderr, "Allocation error. Exiting...\n");
+      exit(EXIT_FAILURE);
+   }
+   start = clock();
+   for (size_t i = 0; i < nkeys; i++) {
+      keys[i] = rand() % KEYMAX;
+      if (!bstInsert(bst, &keys[i], &keys[i])) {
+         fprintf(stderr, "Allocation error. Exiting...\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+   //****************************
+   // Cursors
+
+   printf("\nTesting range cursors:\n");
+   printf("   %zu cursors...", ncursors);
+   fflush(stdout);
+   bool error = false;
+   size_t nread = 0;
+
+   start = clock();
+   for (size_t c = 0; c < ncursors && !error; c++) {
+      // Either bound may be missing, and the range may be empty
+      int lo = rand() % (KEYMAX + 2) - 1;
+      int hi = rand() % (KEYMAX + 2) - 1;
+      bool hasMin = rand() % 4 != 0;
+      bool hasMax = rand() % 4 != 0;
+      bool reverse = rand() % 2;
+      // Stop early once in a while (a reader of the first elements)
+      size_t limit = rand() % 4 == 0 ? (size_t)(rand() % 16) : nkeys + 1;
+
+      size_t expected = 0;
+      for (size_t i = 0; i < nkeys; i++) {
+         seen[i] = false;
+         if ((!hasMin || keys[i] >= lo) && (!hasMax || keys[i] <= hi))
+            expected++;
+      }
+      if (expected > limit) expected = limit;
+
+      BSTCursor *cursor = bstRangeCursorOpen(bst, hasMin ? &lo : NULL,
+                                             hasMax ? &hi : NULL, reverse);
+      if (cursor == NULL) {
+         printf("  Error: the cursor could not be opened\n");
+         error = true;
+         break;
+      }
+      size_t count = 0;
+      int last = reverse ? KEYMAX : -1;
+      void *key, *value;
+      while (count < limit && bstRangeCursorNext(cursor, &key, &value)) {
+         // Each element once, in the range, in order, with its value
+         int k = *(int *)key;
+         size_t i = (size_t)((int *)value - keys);
+         if (value != key || i >= nkeys || seen[i] ||
+             (hasMin && k < lo) || (hasMax && k > hi) ||
+             (reverse ? k > last : k < last)) {
+            error = true;
+            break;
+         }
+         seen[i] = true;
+         last = k;
+         count++;
+      }
+      // Once done, the cursor remains at the end
+      if (!error && count < limit &&
+          bstRangeCursorNext(cursor, &key, &value))
+         error = true;
+      bstRangeCursorClose(cursor);
+      if (error || count != expected) {
+         char min[16] = "-inf", max[16] = "+inf";
+         if (hasMin) snprintf(min, sizeof(min), "%d", lo);
+         if (hasMax) snprintf(max, sizeof(max), "%d", hi);
+         printf("  Error: wrong elements in [%s, %s]%s\n", min, max,
+                reverse ? " in reverse" : "");
+         error = true;
+      }
+      nread += count;
+   }
+   end = clock();
+   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   printf("   Average number of elements read: %f\n",
+          ncursors > 0 ? (double)nread / (double)ncursors : 0.0);
+   if (error) printf("   Warning: there were some errors\n");
+
+   //****************************
+   // Free
+
+   bstFree(bst, false, false);
+   free(keys);
+   free(seen);
+   return error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
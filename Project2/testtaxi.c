@@ -2,12 +2,22 @@
  * Load and query from a file of taxi trips (in csv format)
  * ========================================================================= */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "Arena.h"
 #include "List.h"
 #include "Point.h"
 #include "PointDct.h"
@@ -26,12 +36,62 @@ struct Trip_t {
    double latitude;
 };
 
+// Strings of the trips, packed one after the other (without alignment) in
+// chunks taken from an arena. The taxi IDs, shared by many trips, are
+// interned: each one is stored once per chunk of the file (see parseCsv).
+
+typedef struct Strings_t Strings;
+
+struct Strings_t {
+   Arena *arena;
+   char *next; // Free space of the current chunk: [next, end)
+   char *end;
+   char **taxiIDs;  // Open-addressing hash table of the interned taxi IDs
+   size_t capacity; // Size of taxiIDs (a power of 2)
+   size_t count;    // Number of interned taxi IDs
+};
+
+// Chunk of the CSV file, made of whole lines, parsed by its own thread into
+// its own arrays and arena
+
+typedef struct Chunk_t Chunk;
+
+struct Chunk_t {
+   const char *begin; // The lines of the chunk: [begin, end)
+   const char *end;
+   Arena *arena;   // Strings and points of the trips of the chunk
+   Trip *trips;    // The trips of the chunk
+   Point **points; // points[i]: projected position of trips[i]
+   size_t ntrips;
+};
+
+// Trip of a snapshot (see flattenTrips): no pointer, the strings are offsets
+// from the start of the block of the trips
+
+typedef struct SnapshotTrip_t SnapshotTrip;
+
+struct SnapshotTrip_t {
+   uint64_t tripID;
+   uint64_t taxiID;
+   uint64_t date;
+   double longitude;
+   double latitude;
+};
+
 // Prototypes
-static Point *transformToXY(double longitude, double latitude);
+static Point *transformToXY(Arena *arena, double longitude, double latitude);
 static Point *transformToLL(double x, double y);
-static List *parseCsv(const char *filename);
+static char *stringsCopy(Strings *strings, const char *str, size_t len);
+static char *stringsIntern(Strings *strings, const char *str, size_t len);
+static double parseDecimal(const char *str, const char *end);
+static void parseChunk(Chunk *chunk);
+static void *parseChunkTask(void *arg);
+static Chunk *parseCsv(const char *filename, List *lpoints, List *ltrips,
+                       size_t *nchunks);
+static void freeChunks(Chunk *chunks, size_t nchunks);
 static void printTrip(Trip *trip);
-static void freeTrip(Trip *trip);
+static char *flattenTrips(List *ltrips, size_t *size);
+static void printSnapshotTrip(const char *block, SnapshotTrip *trip);
 
 /* ------------------------------------------------------------------------- *
  * Print information about a trip.
@@ -46,17 +106,299 @@ static void printTrip(Trip *trip) {
 }
 
 /* ------------------------------------------------------------------------- *
- * Free a Trip object.
+ * Print information about a trip of a snapshot.
+ *
+ * PARAMETERS
+ * block      The block of the trips (see flattenTrips)
+ * trip       The trip to print, in the block
+ * ------------------------------------------------------------------------- */
+
+static void printSnapshotTrip(const char *block, SnapshotTrip *trip) {
+   printf("(%f, %f) %s %s %s\n", trip->longitude, trip->latitude,
+          block + trip->tripID, block + trip->taxiID, block + trip->date);
+}
+
+/* ------------------------------------------------------------------------- *
+ * Copy the trips into one block without pointers, which can be saved with a
+ * snapshot of the dictionary (see pdctSave): an array of SnapshotTrip,
+ * followed by their strings. Each interned taxi ID is copied once, so a
+ * taxi ID is copied once per chunk of the file in which it appears.
+ *
+ * PARAMETERS
+ * ltrips       The list of the trips
+ * size         Set to the size of the block in bytes
+ *
+ * RETURN
+ * block        The block, to be freed with free(). The i-th trip of the
+ *              list is the i-th SnapshotTrip of the block.
+ * ------------------------------------------------------------------------- */
+
+static char *flattenTrips(List *ltrips, size_t *size) {
+   // The taxi IDs are interned per chunk (see stringsIntern): each interned
+   // copy goes into the block with the first trip that points to it, the
+   // other trips of its chunk share its offset
+   size_t n = listSize(ltrips);
+   size_t total = n * sizeof(SnapshotTrip);
+   for (LNode *p = ltrips->head; p != NULL; p = p->next) {
+      Trip *trip = p->value;
+      total += strlen(trip->tripID) + strlen(trip->date) + 2;
+      total += strlen(trip->taxiID) + 1; // upper bound
+   }
+   // Open-addressing table from the interned copies to their offsets
+   size_t capacity = 1;
+   while (capacity < 2 * n)
+      capacity *= 2;
+   char *block = malloc(total > 0 ? total : 1);
+   char **seen = calloc(capacity, sizeof(char *));
+   uint64_t *seenOffsets = malloc(capacity * sizeof(uint64_t));
+   if (!block || !seen || !seenOffsets) {
+      fprintf(stderr, "Allocation error. Exiting...\n");
+      exit(EXIT_FAILURE);
+   }
+
+   SnapshotTrip *trips = (SnapshotTrip *)block;
+   uint64_t next = n * sizeof(SnapshotTrip);
+   size_t i = 0;
+   for (LNode *p = ltrips->head; p != NULL; p = p->next, i++) {
+      Trip *trip = p->value;
+      size_t len = strlen(trip->tripID) + 1;
+      memcpy(block + next, trip->tripID, len);
+      trips[i].tripID = next;
+      next += len;
+
+      size_t h = ((uintptr_t)trip->taxiID >> 3) & (capacity - 1);
+      while (seen[h] != NULL && seen[h] != trip->taxiID)
+         h = (h + 1) & (capacity - 1);
+      if (seen[h] == NULL) {
+         len = strlen(trip->taxiID) + 1;
+         memcpy(block + next, trip->taxiID, len);
+         seen[h] = trip->taxiID;
+         seenOffsets[h] = next;
+         next += len;
+      }
+      trips[i].taxiID = seenOffsets[h];
+
+      len = strlen(trip->date) + 1;
+      memcpy(block + next, trip->date, len);
+      trips[i].date = next;
+      next += len;
+
+      trips[i].longitude = trip->longitude;
+      trips[i].latitude = trip->latitude;
+   }
+   free(seen);
+   free(seenOffsets);
+
+   *size = (size_t)next;
+   return block;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Copy a string into the arena of the strings.
+ *
+ * PARAMETERS
+ * strings    The strings of the trips
+ * str        The characters of the string (not null-terminated)
+ * len        The number of characters
+ *
+ * RETURN
+ * copy       The null-terminated copy, or NULL in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+// Size of the chunks of characters taken from the arena
+static const size_t STRINGS_CHUNK = 1 << 16;
+
+static char *stringsCopy(Strings *strings, const char *str, size_t len) {
+   if ((size_t)(strings->end - strings->next) < len + 1) {
+      size_t size = len + 1 > STRINGS_CHUNK ? len + 1 : STRINGS_CHUNK;
+      strings->next = arenaAlloc(strings->arena, size);
+      if (!strings->next) return NULL;
+      strings->end = strings->next + size;
+   }
+   char *copy = strings->next;
+   memcpy(copy, str, len);
+   copy[len] = '\0';
+   strings->next += len + 1;
+   return copy;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Return the interned copy of a taxi ID, copying it into the arena of the
+ * strings the first time it is met in their chunk.
+ *
+ * PARAMETERS
+ * strings    The strings of the trips
+ * str        The characters of the ID (not null-terminated)
+ * len        The number of characters
+ *
+ * RETURN
+ * copy       The interned copy, or NULL in case of allocation error
+ * ------------------------------------------------------------------------- */
+
+static char *stringsIntern(Strings *strings, const char *str, size_t len) {
+   // The table is kept at most half full
+   if (2 * (strings->count + 1) > strings->capacity) {
+      size_t capacity = strings->capacity ? 2 * strings->capacity : 1024;
+      char **table = calloc(capacity, sizeof(char *));
+      if (!table) return NULL;
+      for (size_t i = 0; i < strings->capacity; i++) {
+         char *id = strings->taxiIDs[i];
+         if (!id) continue;
+         uint64_t h = 14695981039346656037u; // FNV-1a
+         for (const char *c = id; *c; c++)
+            h = (h ^ (unsigned char)*c) * 1099511628211u;
+         size_t j = h & (capacity - 1);
+         while (table[j])
+            j = (j + 1) & (capacity - 1);
+         table[j] = id;
+      }
+      free(strings->taxiIDs);
+      strings->taxiIDs = table;
+      strings->capacity = capacity;
+   }
+
+   uint64_t h = 14695981039346656037u;
+   for (size_t i = 0; i < len; i++)
+      h = (h ^ (unsigned char)str[i]) * 1099511628211u;
+   size_t j = h & (strings->capacity - 1);
+   while (strings->taxiIDs[j]) {
+      char *id = strings->taxiIDs[j];
+      if (strncmp(id, str, len) == 0 && id[len] == '\0') return id;
+      j = (j + 1) & (strings->capacity - 1);
+   }
+   char *copy = stringsCopy(strings, str, len);
+   if (!copy) return NULL;
+   strings->taxiIDs[j] = copy;
+   strings->count++;
+   return copy;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Parse a decimal number [+-]digits[.digits] (without exponent). The digits
+ * are accumulated in a 64-bit integer, then divided once by a power of 10:
+ * the result is correctly rounded for up to 15 significant digits.
+ *
+ * PARAMETERS
+ * str        The first character of the number
+ * end        The end of the field: the number stops at end or at the first
+ *            character that does not belong to it
+ *
+ * RETURN
+ * x          The number (0 if str does not start with a number)
+ * ------------------------------------------------------------------------- */
+
+static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                               1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                               1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Beyond this mantissa, further digits are dropped
+static const uint64_t MANTISSA_MAX = 100000000000000000u; // 1e17
+
+static double parseDecimal(const char *str, const char *end) {
+   bool negative = false;
+   if (str < end && (*str == '-' || *str == '+')) negative = *str++ == '-';
+
+   uint64_t mantissa = 0;
+   int exponent = 0; // x = mantissa * 10^exponent
+   for (; str < end && *str >= '0' && *str <= '9'; str++) {
+      if (mantissa < MANTISSA_MAX)
+         mantissa = 10 * mantissa + (uint64_t)(*str - '0');
+      else
+         exponent++;
+   }
+   if (str < end && *str == '.') {
+      for (str++; str < end && *str >= '0' && *str <= '9'; str++) {
+         if (mantissa < MANTISSA_MAX) {
+            mantissa = 10 * mantissa + (uint64_t)(*str - '0');
+            exponent--;
+         }
+      }
+   }
+
+   double x = (double)mantissa;
+   if (exponent < 0)
+      x /= -exponent < 23 ? POW10[-exponent] : pow(10, -exponent);
+   else if (exponent > 0)
+      x *= exponent < 23 ? POW10[exponent] : pow(10, exponent);
+   return negative ? -x : x;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Parse the lines of a chunk of a CSV file of taxi trips (see parseCsv)
+ * and project their positions (see transformToXY).
  *
  * PARAMETERS
- * trip       The trip to free
+ * chunk        The chunk, whose begin and end are set. Its other fields are
+ *              set by the function.
  * ------------------------------------------------------------------------- */
 
-static void freeTrip(Trip *trip) {
-   free(trip->tripID);
-   free(trip->taxiID);
-   free(trip->date);
-   free(trip);
+static void parseChunk(Chunk *chunk) {
+   const char *end = chunk->end;
+
+   // One trip per line (the last one may lack its newline)
+   size_t nlines = 0;
+   for (const char *c = chunk->begin; c < end; nlines++) {
+      const char *nl = memchr(c, '\n', (size_t)(end - c));
+      c = nl ? nl + 1 : end;
+   }
+   chunk->arena = arenaNew(0);
+   chunk->trips = malloc((nlines > 0 ? nlines : 1) * sizeof(Trip));
+   chunk->points = malloc((nlines > 0 ? nlines : 1) * sizeof(Point *));
+   if (!chunk->arena || !chunk->trips || !chunk->points) {
+      fprintf(stderr, "Allocation error. Exiting...\n");
+      exit(EXIT_FAILURE);
+   }
+   Strings strings = {chunk->arena, NULL, NULL, NULL, 0, 0};
+
+   size_t n = 0;
+   for (const char *line = chunk->begin; line < end;) {
+      const char *nl = memchr(line, '\n', (size_t)(end - line));
+      const char *eol = nl ? nl : end;
+
+      // The start of each of the five fields, then the end of the line
+      const char *fields[6];
+      fields[0] = line;
+      int nfields = 1;
+      while (nfields < 5) {
+         const char *start = fields[nfields - 1];
+         const char *delim = memchr(start, ';', (size_t)(eol - start));
+         if (!delim) break;
+         fields[nfields++] = delim + 1;
+      }
+      fields[5] = eol + 1;
+      line = nl ? nl + 1 : end;
+      if (eol == fields[0] || (eol == fields[0] + 1 && *fields[0] == '\r'))
+         continue; // empty line
+      if (nfields < 5) {
+         fprintf(stderr, "Missing fields in line '%.*s'. Exiting...\n",
+                 (int)(eol - fields[0]), fields[0]);
+         exit(EXIT_FAILURE);
+      }
+
+      Trip *trip = &chunk->trips[n];
+      trip->tripID = stringsCopy(&strings, fields[0],
+                                 (size_t)(fields[1] - fields[0] - 1));
+      trip->taxiID = stringsIntern(&strings, fields[1],
+                                   (size_t)(fields[2] - fields[1] - 1));
+      trip->date = stringsCopy(&strings, fields[2],
+                               (size_t)(fields[3] - fields[2] - 1));
+      if (!trip->tripID || !trip->taxiID || !trip->date) {
+         fprintf(stderr, "Allocation error. Exiting...\n");
+         exit(EXIT_FAILURE);
+      }
+      trip->longitude = parseDecimal(fields[3], fields[4] - 1);
+      trip->latitude = parseDecimal(fields[4], eol);
+      chunk->points[n++] =
+          transformToXY(chunk->arena, trip->longitude, trip->latitude);
+   }
+   free(strings.taxiIDs);
+   chunk->ntrips = n;
+}
+
+static void *parseChunkTask(void *arg) {
+   parseChunk(arg);
+   return NULL;
 }
 
 /* ------------------------------------------------------------------------- *
@@ -68,117 +410,114 @@ static void freeTrip(Trip *trip) {
  *   4) Longitude: the longitude of the starting point of the trip (in degree)
  *   5) Latitude: the latitude of the starting point of the trip (in degree)
  *
+ * The file is mapped in memory and split at line boundaries into one chunk
+ * per processor. The chunks are parsed in place (with memchr) by as many
+ * threads, each one into its own arrays and arena. Meanwhile, the calling
+ * thread appends the trips and points of the chunks to the lists, in the
+ * order of the file, as soon as each chunk is done.
+ *
  * PARAMETERS
  * filename     A null-terminated string containing the name of the CSV file
+ * lpoints      The list to which the positions of the trips are appended
+ *              (projected by transformToXY)
+ * ltrips       The list to which the trips are appended
+ * nchunks      Set to the number of chunks
  *
  * RETURN
- * ltrips       A linked list containing the trips
+ * chunks       The chunks holding the trips and points, to be freed with
+ *              freeChunks()
  * ------------------------------------------------------------------------- */
 
-// Max length of a single line in a .csv file
-static const size_t LINE_SIZE = 1024;
-
-static List *parseCsv(const char *filename) {
-   printf("Loading file %s", filename);
-   fflush(stdout);
-
-   // Opens the file
-   FILE *fileObj = fopen(filename, "r");
-   if (fileObj == NULL) {
+static Chunk *parseCsv(const char *filename, List *lpoints, List *ltrips,
+                       size_t *nchunks) {
+   // Maps the file
+   int fd = open(filename, O_RDONLY);
+   struct stat st;
+   if (fd < 0 || fstat(fd, &st) != 0) {
       fprintf(stderr, "Could not open file '%s'. Exiting...\n", filename);
       exit(EXIT_FAILURE);
    }
-   List *ltrips = listNew();
-   if (!ltrips) {
+   size_t size = (size_t)st.st_size;
+   char *map = NULL;
+   if (size > 0) {
+      map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED) {
+         fprintf(stderr, "Could not map file '%s'. Exiting...\n", filename);
+         exit(EXIT_FAILURE);
+      }
+   }
+   close(fd);
+
+   long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+   size_t n = nproc > 0 ? (size_t)nproc : 1;
+   printf("Loading file %s on %zu threads", filename, n);
+   fflush(stdout);
+
+   Chunk *chunks = malloc(n * sizeof(Chunk));
+   pthread_t *threads = malloc(n * sizeof(pthread_t));
+   bool *started = malloc(n * sizeof(bool));
+   if (!chunks || !threads || !started) {
       fprintf(stderr, "Allocation error. Exiting...\n");
       exit(EXIT_FAILURE);
    }
 
-   // Start reading the file, line by line (N.B.: fgets() reads until next \n or
-   // EOF character)
-   char line[LINE_SIZE];
-   size_t nbLine = 0;
-   char delim = ';';
-   Trip *trip;
+   // Each chunk ends after the first newline following its share of the
+   // file (a chunk may be empty)
+   const char *end = map + size;
+   const char *begin = map;
+   for (size_t i = 0; i < n; i++) {
+      const char *cut = i + 1 < n ? map + size / n * (i + 1) : end;
+      if (cut < begin) cut = begin;
+      const char *nl = cut < end ? memchr(cut, '\n', (size_t)(end - cut))
+                                 : NULL;
+      chunks[i].begin = begin;
+      chunks[i].end = nl ? nl + 1 : end;
+      begin = chunks[i].end;
+      started[i] =
+          pthread_create(&threads[i], NULL, parseChunkTask, &chunks[i]) == 0;
+      if (!started[i]) parseChunk(&chunks[i]);
+   }
 
-   while (fgets(line, sizeof(line), fileObj) != NULL) {
-      if ((nbLine % 50000) == 0) {
-         printf(".");
-         fflush(stdout);
+   // The chunks are consumed in order, while the next ones are parsed
+   size_t ntrips = 0;
+   for (size_t i = 0; i < n; i++) {
+      if (started[i]) pthread_join(threads[i], NULL);
+      for (size_t j = 0; j < chunks[i].ntrips; j++) {
+         if (!listInsertLast(lpoints, chunks[i].points[j]) ||
+             !listInsertLast(ltrips, &chunks[i].trips[j])) {
+            fprintf(stderr, "Allocation error. Exiting...\n");
+            exit(EXIT_FAILURE);
+         }
       }
-
-      trip = malloc(sizeof(Trip));
-      if (!trip) {
-         fprintf(stderr, "Allocation error at line %zu. Exiting...\n", nbLine);
-         exit(EXIT_FAILURE);
-      }
-      trip->latitude = 0.0;
-      trip->longitude = 0.0;
-      trip->tripID = NULL;
-      trip->taxiID = NULL;
-      trip->date = NULL;
-
-      size_t currChar = 0;
-
-      // ---- tripID
-      while (line[currChar] != delim)
-         currChar++;
-      trip->tripID = malloc(sizeof(char) * (currChar + 1));
-      if (!trip->tripID) {
-         fprintf(stderr, "Allocation error: tripID at line %zu. Exiting...\n",
-                 nbLine);
-         exit(EXIT_FAILURE);
-      }
-      memcpy(trip->tripID, line, sizeof(char) * currChar);
-      trip->tripID[currChar] = '\0';
-
-      // ---- taxiID
-      int start = ++currChar;
-      while (line[currChar] != delim)
-         currChar++;
-      trip->taxiID = malloc(sizeof(char) * (currChar - start + 1));
-      if (!trip->taxiID) {
-         fprintf(stderr, "Allocation error: taxiID at line %zu. Exiting...\n",
-                 nbLine);
-         exit(EXIT_FAILURE);
-      }
-      memcpy(trip->taxiID, line + start, sizeof(char) * (currChar - start));
-      trip->tripID[currChar - start] = '\0';
-
-      // ---- Date
-      start = ++currChar;
-      while (line[currChar] != delim)
-         currChar++;
-      trip->date = malloc(sizeof(char) * (currChar - start + 1));
-      if (!trip->date) {
-         fprintf(stderr, "Allocation error: date at line %zu. Exiting...\n",
-                 nbLine);
-         exit(EXIT_FAILURE);
-      }
-      memcpy(trip->date, line + start, sizeof(char) * (currChar - start));
-      trip->date[currChar - start] = '\0';
-
-      // ---- Longitude and latitude
-      start = ++currChar;
-      trip->longitude = strtod(line + start, NULL);
-      while (line[currChar] != delim)
-         currChar++;
-      start = ++currChar;
-      trip->latitude = strtod(line + start, NULL);
-
-      if (!listInsertLast(ltrips, trip)) {
-         fprintf(stderr,
-                 "Allocation error: listInsertLast at line %zu. Exiting...\n",
-                 nbLine);
-         exit(EXIT_FAILURE);
-      }
-      nbLine++;
+      ntrips += chunks[i].ntrips;
+      printf(".");
+      fflush(stdout);
    }
-   fclose(fileObj);
+   if (map) munmap(map, size);
+   free(threads);
+   free(started);
 
-   printf(" Done (read %zu trips)\n", listSize(ltrips));
+   printf(" Done (read %zu trips)\n", ntrips);
 
-   return ltrips;
+   *nchunks = n;
+   return chunks;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Free the chunks returned by parseCsv, with their trips and points.
+ *
+ * PARAMETERS
+ * chunks       The chunks
+ * nchunks      The number of chunks
+ * ------------------------------------------------------------------------- */
+
+static void freeChunks(Chunk *chunks, size_t nchunks) {
+   for (size_t i = 0; i < nchunks; i++) {
+      arenaFree(chunks[i].arena);
+      free(chunks[i].trips);
+      free(chunks[i].points);
+   }
+   free(chunks);
 }
 
 #define REARTH 6371.0
@@ -192,17 +531,19 @@ static List *parseCsv(const char *filename) {
  * corresponding geographical coordinates.
  *
  * PARAMETERS
+ * arena        the arena in which the point is allocated, or NULL to
+ *              allocate it with ptNew
  * longitude    the longitude of the position (in degress, double)
  * latitude     the latitude of the position (in degress, double)
  * RETURN
  * p            A Point structure with the (x,y) coordinates.
  * ------------------------------------------------------------------------- */
 
-static Point *transformToXY(double longitude, double latitude) {
+static Point *transformToXY(Arena *arena, double longitude, double latitude) {
    double x = REARTH * M_PI * longitude / 180 * cos(PORTOLAT / 180 * M_PI);
    double y = REARTH * M_PI * latitude / 180;
 
-   Point *newp = ptNew(x, y);
+   Point *newp = arena ? ptNewInArena(arena, x, y) : ptNew(x, y);
    if (!newp) {
       fprintf(stderr, "Allocation error in transformToXY. Exiting...\n");
       exit(EXIT_FAILURE);
@@ -235,8 +576,17 @@ static Point *transformToLL(double x, double y) {
 
 int main(int argc, char **argv) {
 
+   // With --snapshot, the dictionary is mapped from the file if it exists,
+   // and otherwise built from the CSV file then saved into it
+   const char *snapshot = NULL;
+   if (argc == 6 && strcmp(argv[1], "--snapshot") == 0) {
+      snapshot = argv[2];
+      argv += 2;
+      argc -= 2;
+   }
    if (argc != 4) {
-      printf("Usage: ./testtaxi longitude latitude radius\n");
+      printf("Usage: ./testtaxi [--snapshot file] longitude latitude "
+             "radius\n");
       printf("(longitude and latitude in degrees, radius in km.)\n");
       printf("Example: ./testtaxi -8.6291 41.1579 0.5\n");
       exit(EXIT_FAILURE);
@@ -247,30 +597,88 @@ int main(int argc, char **argv) {
    double radius = strtod(argv[3], NULL);
    printf("Testing long=%f, lat=%f, radius=%f\n", longitude, latitude, radius);
 
-   Point *query = transformToXY(longitude, latitude);
+   Point *query = transformToXY(NULL, longitude, latitude);
 
-   char *filename = "taxitripsporto.csv";
-   List *ltrips = parseCsv(filename);
-
-   printf("Creating points...");
-   List *lpoints = listNew();
-   for (LNode *p = ltrips->head; p != NULL; p = p->next) {
-      Point *newp = transformToXY(((Trip *)p->value)->longitude,
-                                  ((Trip *)p->value)->latitude);
-      listInsertLast(lpoints, newp);
+   // The lists live in an arena, released at once
+   Arena *arena = arenaNew(0);
+   List *lpoints = arena ? listNewInArena(arena) : NULL;
+   List *ltrips = arena ? listNewInArena(arena) : NULL;
+   if (!lpoints || !ltrips) {
+      fprintf(stderr, "Allocation error. Exiting...\n");
+      exit(EXIT_FAILURE);
    }
-   printf("Done\n");
 
-   printf("Creating dictionary...");
-   clock_t start = clock();
-   PointDct *pd = pdctCreate(lpoints, ltrips);
-   clock_t end = clock();
-   printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+   PointDct *pd;
+   Chunk *chunks = NULL;
+   size_t nchunks = 0;
+   char *flat = NULL;         // Block of the trips saved with the snapshot
+   const char *block = NULL; // Block of the values of pd, if a snapshot
+   struct timespec t0, t1;
+
+   if (snapshot && access(snapshot, F_OK) == 0) {
+      printf("Mapping snapshot %s...", snapshot);
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      const void *mapped;
+      pd = pdctLoadMapped(snapshot, &mapped, NULL);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      if (!pd) {
+         fprintf(stderr, "Could not map snapshot '%s'. Exiting...\n",
+                 snapshot);
+         exit(EXIT_FAILURE);
+      }
+      block = mapped;
+      printf("Done in %fs (%zu trips)\n",
+             (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+             pdctSize(pd));
+   } else {
+      // The trips and their points are loaded together
+      char *filename = "taxitripsporto.csv";
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      chunks = parseCsv(filename, lpoints, ltrips, &nchunks);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      printf("Loaded in %fs\n",
+             (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+      // The values of a snapshot are the trips of one block
+      List *lvalues = ltrips;
+      size_t flatSize = 0;
+      if (snapshot) {
+         flat = flattenTrips(ltrips, &flatSize);
+         lvalues = listNewInArena(arena);
+         SnapshotTrip *trips = (SnapshotTrip *)flat;
+         for (size_t i = 0; lvalues && i < listSize(ltrips); i++) {
+            if (!listInsertLast(lvalues, &trips[i])) lvalues = NULL;
+         }
+         if (!lvalues) {
+            fprintf(stderr, "Allocation error. Exiting...\n");
+            exit(EXIT_FAILURE);
+         }
+         block = flat;
+      }
+
+      printf("Creating dictionary...");
+      clock_t start = clock();
+      pd = pdctCreate(lpoints, lvalues);
+      clock_t end = clock();
+      printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+      if (snapshot) {
+         printf("Saving snapshot %s...", snapshot);
+         fflush(stdout);
+         start = clock();
+         bool saved = pdctSave(pd, snapshot, flat, flatSize);
+         end = clock();
+         if (saved)
+            printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+         else
+            printf("Not supported by this dictionary\n");
+      }
+   }
 
    printf("Searching...");
-   start = clock();
+   clock_t start = clock();
    List *l = pdctBallSearch(pd, query, radius);
-   end = clock();
+   clock_t end = clock();
    printf("Done in %fs\n", ((double)(end - start)) / CLOCKS_PER_SEC);
    printf("%zu trips found at the position\n", listSize(l));
 
@@ -279,14 +687,17 @@ int main(int argc, char **argv) {
       int i = 0;
       for (LNode *p = l->head; p != NULL && i < 10; p = p->next, i++) {
          printf("  ");
-         printTrip(p->value);
+         if (block)
+            printSnapshotTrip(block, p->value);
+         else
+            printTrip(p->value);
       }
    }
 
    listFree(l, false);
    pdctFree(pd);
-   listFree(lpoints, true);
-   for (LNode *p = ltrips->head; p != NULL; p = p->next)
-      freeTrip(p->value);
-   listFree(ltrips, false);
+   free(flat);
+   arenaFree(arena);
+   if (chunks) freeChunks(chunks, nchunks);
+   ptFree(query);
 }